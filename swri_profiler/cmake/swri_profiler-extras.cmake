@@ -0,0 +1,16 @@
+# Compile-time filters for SWRI_PROFILE_L and SWRI_PROFILE_CAT.  Set
+# these when configuring the workspace (e.g. catkin_make
+# -DSWRI_PROFILER_LEVEL=1) to compile out the finer-grained blocks in
+# every package that uses swri_profiler.  Leave them empty to compile
+# every block.
+set(SWRI_PROFILER_LEVEL "" CACHE STRING
+  "Highest SWRI_PROFILE_L level to compile (0-255, empty for all)")
+set(SWRI_PROFILER_CATEGORIES "" CACHE STRING
+  "Mask of the SWRI_PROFILE_CAT categories to compile (e.g. 0x5, empty for all)")
+
+if(NOT "${SWRI_PROFILER_LEVEL}" STREQUAL "")
+  add_definitions(-DSWRI_PROFILER_LEVEL=${SWRI_PROFILER_LEVEL})
+endif()
+if(NOT "${SWRI_PROFILER_CATEGORIES}" STREQUAL "")
+  add_definitions(-DSWRI_PROFILER_CATEGORIES=${SWRI_PROFILER_CATEGORIES})
+endif()
@@ -114,12 +114,28 @@ var RosProfilerAdapter = function(ros) {
   // Map of node names -> (map of integer labels -> string labels)
   this.indices = {};
 
+  // Map of node names -> sequence number of the latest index message.
+  this.index_sequences = {};
+
+  // Map of node names -> time (ms) we last requested a full index.
+  this.index_requests = {};
+
+  this.ros = ros;
+
+  // Map of node names -> (map of string labels -> last data item).
+  // Reports between keyframes omit the blocks that didn't run, so we
+  // fill them in from here.
+  this.last_items = {};
+
   // Default data handler just logs to the console.
   this.data_handler = function(node_name, t, msg) { 
     console.log("Data for " + node_name + " at " + formatDuration(t));
     console.log(items);
   };
 
+  // Default metrics handler ignores the metrics.
+  this.metrics_handler = function(node_name, t, items) {};
+
   this.index_sub = new ROSLIB.Topic({
     ros : ros,
     name : '/profiler/index',
@@ -134,6 +150,13 @@ var RosProfilerAdapter = function(ros) {
   });
   this.data_sub.subscribe(this.handleData.bind(this));
 
+  this.metrics_sub = new ROSLIB.Topic({
+    ros : ros,
+    name : '/profiler/metrics',
+    messageType : 'swri_profiler_msgs/ProfileMetricArray'
+  });
+  this.metrics_sub.subscribe(this.handleMetrics.bind(this));
+
   return this;
 }
 
@@ -146,12 +169,23 @@ RosProfilerAdapter.prototype.dataHandler = function(f) {
   }
 }
 
-// Close the adapter's subscriptions and release the data_handler
-// reference.
+// Set/get the metrics handler for the adapter.
+RosProfilerAdapter.prototype.metricsHandler = function(f) {
+  if (f == undefined) {
+    return this.metrics_handler;
+  } else {
+    this.metrics_handler = f;
+  }
+}
+
+// Close the adapter's subscriptions and release the handler
+// references.
 RosProfilerAdapter.prototype.close = function() {
   this.index_sub.unsubscribe();
   this.data_sub.unsubscribe();
+  this.metrics_sub.unsubscribe();
   this.data_handler = function(node_name, t, msg) {};
+  this.metrics_handler = function(node_name, t, items) {};
 }
 
 RosProfilerAdapter.prototype.handleIndex = function(msg) {
@@ -159,11 +193,50 @@ RosProfilerAdapter.prototype.handleIndex = function(msg) {
 
   var node_name = trimSlash(msg.header.frame_id);
   console.log('Received new index for ' + node_name);
-  var index = {}
+
+  // Full indices (and those from publishers that predate incremental
+  // indices) replace the node's index.  Otherwise we add the new
+  // blocks, and ask for the full index if we missed a message.
+  var sequence = this.index_sequences[node_name] || 0;
+  var full = msg.full || msg.sequence == 0;
+  if (full && (msg.sequence <= 1 || msg.sequence >= sequence)) {
+    this.indices[node_name] = {};
+    sequence = msg.sequence;
+  } else if (!full && msg.sequence > sequence + 1) {
+    this.requestIndex(msg.header.frame_id);
+  }
+  this.index_sequences[node_name] = Math.max(sequence, msg.sequence);
+
+  if (!(node_name in this.indices)) {
+    this.indices[node_name] = {};
+  }
+  var index = this.indices[node_name];
   for (var i = 0; i < msg.data.length; i++) {
     index[msg.data[i].key] = trimSlash(msg.data[i].label);
   }
-  this.indices[node_name] = index;
+};
+
+// Requests the full index from a node's get_index service.  Data
+// keeps arriving while we wait, so we only ask every few seconds.
+RosProfilerAdapter.prototype.requestIndex = function(frame_id) {
+  var node_name = trimSlash(frame_id);
+  var now = Date.now();
+  if (node_name in this.index_requests &&
+      now - this.index_requests[node_name] < 5000) {
+    return;
+  }
+  this.index_requests[node_name] = now;
+
+  var service = new ROSLIB.Service({
+    ros : this.ros,
+    name : frame_id + '/swri_profiler/get_index',
+    serviceType : 'swri_profiler_msgs/GetProfileIndex'
+  });
+  service.callService(new ROSLIB.ServiceRequest({}),
+                      function(result) { this.handleIndex(result.index); }.bind(this),
+                      function(error) {
+                        console.log('Failed to get index for ' + node_name + ': ' + error);
+                      });
 };
 
 RosProfilerAdapter.prototype.handleData = function(msg) {
@@ -172,6 +245,7 @@ RosProfilerAdapter.prototype.handleData = function(msg) {
   var node_name = trimSlash(msg.header.frame_id);
   if (!(node_name in this.indices)) {
     console.log('Dropping profile data for node without index: ' + node_name);
+    this.requestIndex(msg.header.frame_id);
     return;
   }
 
@@ -209,12 +283,18 @@ RosProfilerAdapter.prototype.handleData = function(msg) {
     return trimSlash(label);
   }.bind(this);
 
+  if (msg.keyframe || !(node_name in this.last_items)) {
+    this.last_items[node_name] = {};
+  }
+  var last_items = this.last_items[node_name];
+
   var keys = []
   var items = {}
   for (var i = 0; i < msg.data.length; i++) {
     var item = msg.data[i];
     var label = fullNameFromKey(item.key)
     if (label == undefined) {  
+      this.requestIndex(msg.header.frame_id);
       continue;
     }
 
@@ -225,10 +305,50 @@ RosProfilerAdapter.prototype.handleData = function(msg) {
       rel_total_duration: toNSec(item.rel_total_duration),
       rel_max_duration: toNSec(item.rel_max_duration)
     };
+    last_items[label] = items[label];
   } 
+
+  // Omitted blocks didn't run since the last report.
+  for (var label in last_items) {
+    if (!(label in items)) {
+      items[label] = {
+        label: label,
+        abs_call_count: last_items[label].abs_call_count,
+        abs_total_duration: last_items[label].abs_total_duration,
+        rel_total_duration: 0,
+        rel_max_duration: 0
+      };
+    }
+  }
   this.data_handler(node_name, secs, items);
 };
 
+// Metrics are keyed by their name and don't need an index.  Their
+// reports are stamped like the data reports, so they are rounded to
+// the same timebase.
+RosProfilerAdapter.prototype.handleMetrics = function(msg) {
+  if (ROS_BLOCK) { return; };
+
+  var node_name = trimSlash(msg.header.frame_id);
+  var secs = Math.round(toNSec(msg.header.stamp)/1e9);
+
+  var items = {};
+  for (var i = 0; i < msg.metrics.length; i++) {
+    var metric = msg.metrics[i];
+    var label = node_name + "/" + trimSlash(metric.name);
+    items[label] = {
+      label: label,
+      type: metric.type,
+      rel_count: metric.rel_count,
+      rel_sum: metric.rel_sum,
+      rel_min: metric.rel_min,
+      rel_max: metric.rel_max,
+      last: metric.last
+    };
+  }
+  this.metrics_handler(node_name, secs, items);
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Profile Data Objects /////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
@@ -270,20 +390,45 @@ Block.prototype.findPreviousValidData = function(start_index) {
   return i;
 }
 
+// A MetricItem stores a single report of a counter or gauge.  value
+// is what we plot: a counter's change over the report period, or a
+// gauge's average (or its latest value if it wasn't updated).
+var MetricItem = function() {
+  this.valid = false;
+  this.value = 0;
+  this.rel_count = 0;
+  this.rel_min = 0;
+  this.rel_max = 0;
+  this.last = 0;
+};
+
+var COUNTER_METRIC = 0;
+
+var Metric = function(size, type) {
+  this.type = type;
+  this.data = new Array(size);
+  for (var i = 0; i < size; i++) {
+    this.data[i] = new MetricItem();
+  }
+}
+
+Metric.prototype.findPreviousValidData = Block.prototype.findPreviousValidData;
+
 // The GlobalProfile is the top level object containing all of the
 // data and providing the functionality to extract various parts.
 var GlobalProfile = function() {
   this.timeline = [];
   this.blocks = {"" : new Block(0)};
+  this.metrics = {};
   this.tree_index = undefined;
 
   this.max_size = 300;
 };
 
-GlobalProfile.prototype.addData = function(node_name, t, items) {
-  // Find the index in the timeline for this time.  If the time isn't
-  // in the timeline, we need to add it and insert a corresponding
-  // entry in every block's data array.
+// Find the index in the timeline for this time.  If the time isn't in
+// the timeline, we need to add it and insert a corresponding entry in
+// every block's and metric's data array.
+GlobalProfile.prototype.timeIndex = function(t) {
   var time_index = findTime(this.timeline, t)
   if (this.timeline[time_index] != t) {
     this.timeline.splice(time_index, 0, t);
@@ -291,7 +436,52 @@ GlobalProfile.prototype.addData = function(node_name, t, items) {
       var block = this.blocks[block_name];
       block.data.splice(time_index, 0, new BlockItem());
     }
+    for (var metric_name in this.metrics) {
+      this.metrics[metric_name].data.splice(time_index, 0, new MetricItem());
+    }
   }
+  return time_index;
+};
+
+// Drops the oldest time once the timeline is full.
+GlobalProfile.prototype.trimTimeline = function() {
+  if (this.max_size > 0 && this.timeline.length > this.max_size) {
+    this.timeline.shift();
+    for (var block_name in this.blocks) {
+      this.blocks[block_name].data.shift();
+    }
+    for (var metric_name in this.metrics) {
+      this.metrics[metric_name].data.shift();
+    }
+  }
+};
+
+GlobalProfile.prototype.addMetrics = function(node_name, t, items) {
+  var time_index = this.timeIndex(t);
+  for (var name in items) {
+    var src = items[name];
+    if (!(name in this.metrics)) {
+      this.metrics[name] = new Metric(this.timeline.length, src.type);
+    }
+
+    var item = this.metrics[name].data[time_index];
+    item.valid = true;
+    item.rel_count = src.rel_count;
+    item.rel_min = src.rel_min;
+    item.rel_max = src.rel_max;
+    item.last = src.last;
+    if (src.type == COUNTER_METRIC) {
+      item.value = src.rel_sum;
+    } else {
+      item.value = src.rel_count > 0 ? src.rel_sum / src.rel_count : src.last;
+    }
+  }
+
+  this.trimTimeline();
+};
+
+GlobalProfile.prototype.addData = function(node_name, t, items) {
+  var time_index = this.timeIndex(t);
 
   // Write the new items into the block data.  We touch each block to
   // make sure it and all of its parents exist in the blocks map.
@@ -320,12 +510,7 @@ GlobalProfile.prototype.addData = function(node_name, t, items) {
   // and exclusive costs in the tree.  
   this.updateDerivedData(time_index);
  
-  if (this.max_size > 0 && this.timeline.length > this.max_size) {
-    this.timeline.shift();
-    for (var block_name in this.blocks) {
-      this.blocks[block_name].data.shift();
-    }
-  }      
+  this.trimTimeline();
 };
 
 GlobalProfile.prototype.touchBlock = function(name) {
@@ -616,6 +801,72 @@ var drawStreamgraph = function(global_profile) {
 
 }
 
+// Plots the metrics as lines on the streamgraph's time axis.  Each
+// metric is scaled to its own range, so the plot shows when a metric
+// rises and falls rather than how the metrics compare.  The values
+// are shown when hovering over a line.
+var drawMetrics = function(global_profile) {
+  var timeline = global_profile.timeline;
+  var x_scale = d3.scale.linear()
+    .domain([timeline[0], timeline[timeline.length-1]])
+    .range([0, svg3.attr("width")]);
+
+  var all_data = [];
+  for (var name in global_profile.metrics) {
+    var metric = global_profile.metrics[name];
+    var values = [];
+    var min_v = null;
+    var max_v = null;
+    for (var j = 0; j < metric.data.length; j++) {
+      var item = metric.data[j];
+      values.push([timeline[j], item.value, item.valid]);
+      if (item.valid) {
+        min_v = nullMin(min_v, item.value);
+        max_v = nullMax(max_v, item.value);
+      }
+    }
+    all_data.push({ "name": name, "values": values, "min": min_v, "max": max_v,
+                    "latest": metric.data[metric.findPreviousValidData()] });
+  }
+
+  var height = svg3.attr("height");
+  var lineFor = function(d) {
+    var span = d.max - d.min;
+    var line = d3.svg.line()
+      .defined(function(v) { return v[2]; })
+      .x(function(v) { return x_scale(v[0]); })
+      .y(function(v) {
+        var frac = span > 0 ? (v[1] - d.min) / span : 0.5;
+        return height - 2 - frac * (height - 4);
+      });
+    return line(d.values);
+  };
+
+  var describe = function(d) {
+    var text = "/" + d.name + " [" + d.min + ", " + d.max + "]";
+    if (d.latest) {
+      text += "\nlatest: " + d.latest.value + " (" + d.latest.rel_count +
+        " updates, min " + d.latest.rel_min + ", max " + d.latest.rel_max + ")";
+    }
+    return text;
+  };
+
+  var sel = svg3.selectAll("path")
+    .data(all_data, function (d) { return d.name; });
+
+  sel.attr("d", lineFor)
+    .select("title").text(describe);
+
+  sel.enter().append("path")
+    .attr("d", lineFor)
+    .style("fill", "none")
+    .style("stroke", function(d) { return colorForName(d.name); })
+    .style("stroke-width", 2)
+    .append("title").text(describe);
+
+  sel.exit().remove();
+}
+
 var showTooltip = function(name) {
   var tooltip = d3.select("#tooltip");
   tooltip.style("left", d3.event.pageX + "px")
@@ -694,6 +945,7 @@ var drawCanvasRect = function(global_profile) {
 
 var svg1 = d3.select("#partition_svg");
 var svg2 = d3.select("#stream_svg");
+var svg3 = d3.select("#metrics_svg");
 
 var update_timer = null;
 var handleUpdateTimer = function() {
@@ -701,6 +953,7 @@ var handleUpdateTimer = function() {
   if (profile_data.timeline.length > 0) {
     drawCanvasRect(profile_data);
     drawStreamgraph(profile_data);
+    drawMetrics(profile_data);
   }
 }
 
@@ -726,6 +979,10 @@ ros.on('connection', function() {
     profile_data.addData(n,t,m);
     update();
   });
+  ros_adapter.metricsHandler(function(n,t,m) {
+    profile_data.addMetrics(n,t,m);
+    update();
+  });
 });
 ros.on('error', function(error) { console.log('Error connecting to websocket server: ', error); });
 ros.on('close', function() { 
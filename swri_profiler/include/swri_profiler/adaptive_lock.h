@@ -0,0 +1,83 @@
+#ifndef SWRI_PROFILER_ADAPTIVE_LOCK_H_
+#define SWRI_PROFILER_ADAPTIVE_LOCK_H_
+
+#include <stdint.h>
+#include <atomic>
+
+namespace swri_profiler
+{
+// LockWaitStats summarizes how often threads had to wait for an
+// AdaptiveLock and for how long.  sleeps counts the waits that
+// gave up spinning and slept in the kernel.  Waits are timed with
+// CLOCK_MONOTONIC rather than the profiler's clock because locks are
+// used while the profiler's clock is being initialized.
+struct LockWaitStats
+{
+  uint64_t waits;
+  uint64_t sleeps;
+  int64_t wait_ns;
+  int64_t max_wait_ns;
+  LockWaitStats() : waits(0), sleeps(0), wait_ns(0), max_wait_ns(0) {}
+};
+
+// AdaptiveLock is a mutex for short critical sections.  Taking an
+// uncontended lock is a single atomic operation.  A thread that finds
+// the lock taken spins for a while, pausing with exponential backoff
+// so that it doesn't steal cycles from the holder (which may share
+// its core), and then sleeps on a futex until the lock is released
+// so that it doesn't burn its whole timeslice when the holder is
+// descheduled.
+//
+// The waits of every lock are counted (except those of one thread,
+// see ignoreWaitsOfThisThread()) so that the profiler can report its
+// own contention.  The counters are only touched after waiting, so
+// they cost nothing when the lock is uncontended.
+class AdaptiveLock
+{
+  // 0 when unlocked, 1 when locked, and 2 when locked and a thread
+  // may be sleeping on the futex.
+  std::atomic<int> state_;
+
+  void acquireContended();
+  void wake();
+
+ public:
+  constexpr AdaptiveLock() : state_(0) {}
+
+  void acquire()
+  {
+    int expected = 0;
+    if (!state_.compare_exchange_strong(expected, 1,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+      acquireContended();
+    }
+  }
+
+  void release()
+  {
+    if (state_.exchange(0, std::memory_order_release) == 2) {
+      wake();
+    }
+  }
+
+  // Returns the wait statistics of every lock since the last call,
+  // and resets them.
+  static LockWaitStats takeWaitStats();
+
+  // Stops counting the waits of the calling thread.  The publishing
+  // thread uses this so that only the profiled threads' waits are
+  // reported.
+  static void ignoreWaitsOfThisThread();
+};
+
+class AdaptiveLockGuard
+{
+  AdaptiveLock &lock_;
+  
+ public:
+  AdaptiveLockGuard(AdaptiveLock &lock) : lock_(lock) { lock_.acquire(); }
+  ~AdaptiveLockGuard() { lock_.release(); }
+};
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_ADAPTIVE_LOCK_H_
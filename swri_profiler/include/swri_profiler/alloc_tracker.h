@@ -0,0 +1,61 @@
+#ifndef SWRI_PROFILER_ALLOC_TRACKER_H_
+#define SWRI_PROFILER_ALLOC_TRACKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace swri_profiler
+{
+// AllocCounters are a thread's running totals of heap allocations.
+struct AllocCounters
+{
+  uint64_t count;
+  uint64_t bytes;
+};
+
+// Allocation tracking is enabled by the swri_profiler_alloc library,
+// which replaces malloc and friends (and through them operator new)
+// when it is linked into a program or loaded with LD_PRELOAD.  The
+// replacements call the hooks below, and the profiler attributes the
+// counts to the innermost open block.  The profiler leaves its own
+// allocations (registering blocks and labels, and growing a thread's
+// buffers) out of the counts.  The exception is a label that isn't a
+// string literal: if the caller builds a temporary std::string for
+// it, that allocation happens before the block opens and is counted
+// in the enclosing block.
+//
+// The counters use the initial-exec TLS model so that the hooks can
+// reach them without calling into the dynamic loader, which may
+// itself allocate.  Because of that, swri_profiler takes space in the
+// static TLS block.  That is always fine when the program links
+// against it, but if swri_profiler is only loaded with dlopen (e.g.
+// by a nodelet or plugin that uses it), the space comes from glibc's
+// small reserve for such libraries and dlopen fails with "cannot
+// allocate memory in static TLS block" once it runs out.  Link the
+// program against swri_profiler (or add it to LD_PRELOAD) in that
+// case.
+extern __thread AllocCounters thread_alloc_counters_ __attribute__((tls_model("initial-exec")));
+extern bool alloc_tracking_enabled_;
+
+void enableAllocTracking();
+
+inline void recordAlloc(size_t bytes)
+{
+  AllocCounters &counters = thread_alloc_counters_;
+  counters.count++;
+  counters.bytes += bytes;
+}
+}  // namespace swri_profiler
+
+// The hooks that swri_profiler_alloc calls.  The library doesn't link
+// against swri_profiler (so it can be preloaded into any process); it
+// references these as weak symbols and only calls them if the
+// process has loaded swri_profiler.
+extern "C"
+{
+// Called when the allocation library is loaded, before main.
+void swri_profiler_enable_alloc_tracking();
+// Called for every allocation.  This must not allocate.
+void swri_profiler_record_alloc(size_t bytes);
+}
+#endif  // SWRI_PROFILER_ALLOC_TRACKER_H_
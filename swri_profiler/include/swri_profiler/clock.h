@@ -0,0 +1,120 @@
+#ifndef SWRI_PROFILER_CLOCK_H_
+#define SWRI_PROFILER_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <ros/time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace swri_profiler
+{
+// Ticks are raw timestamps (or durations) from the profiler's clock.
+// The length of a tick depends on the clock's source, so ticks must
+// be converted with Clock::toNSec() before they are reported.
+typedef int64_t Ticks;
+
+// Clock provides the timestamps for profiled blocks.  Reading the
+// clock is on the instrumentation hot path, so it only returns raw
+// ticks.  Converting ticks to real time is left to the publishing
+// thread.
+class Clock
+{
+ public:
+  enum Source
+  {
+    // clock_gettime(CLOCK_MONOTONIC_RAW).  This is the fallback when
+    // the TSC is not reliable.
+    SOURCE_MONOTONIC_RAW = 0,
+    // The CPU's invariant timestamp counter (or the generic timer's
+    // virtual counter on ARM), calibrated against CLOCK_MONOTONIC.
+    SOURCE_TSC,
+    // ros::WallTime::now().  This is what the profiler originally
+    // used and is mostly useful for comparison.
+    SOURCE_WALL,
+  };
+
+  static Ticks now()
+  {
+    switch (source_) {
+    case SOURCE_TSC:
+      return readCounter();
+    case SOURCE_WALL:
+      return ros::WallTime::now().toNSec();
+    default:
+      return readMonotonicRaw();
+    }
+  }
+
+  // Selects the clock source.  The source is selected when the
+  // profiler is initialized, before any timestamps are taken.  By
+  // default the TSC is used if the CPU reports an invariant TSC and
+  // the kernel is also using it as its clocksource.  The
+  // SWRI_PROFILER_CLOCK environment variable ("tsc", "monotonic_raw",
+  // or "wall") can be used to override the default.
+  static void initialize();
+  static Source source() { return source_; }
+  static const char* sourceName();
+
+  // Updates the tick rate calibration against CLOCK_MONOTONIC.  The
+  // calibration is measured from the time initialize() was called,
+  // so it becomes more precise each time it is updated.  This is
+  // called by the publishing thread.
+  static void calibrate();
+
+  // Converts a duration in ticks to nanoseconds.
+  static int64_t toNSec(Ticks ticks)
+  {
+    return static_cast<int64_t>(ticks * ns_per_tick_);
+  }
+
+  static double nsPerTick() { return ns_per_tick_; }
+
+  static ros::WallDuration toWallDuration(Ticks ticks)
+  {
+    ros::WallDuration duration;
+    duration.fromNSec(toNSec(ticks));
+    return duration;
+  }
+
+  // Returns the CPU time used by the calling thread in nanoseconds.
+  // Unlike the clock itself, this is a system call, so it is only
+  // read when the profiler is measuring CPU time.
+  static int64_t threadCpuNSec()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+  }
+
+ private:
+  static Source source_;
+  static double ns_per_tick_;
+
+  static Ticks readCounter()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return readMonotonicRaw();
+#endif
+  }
+
+  static Ticks readMonotonicRaw()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return static_cast<Ticks>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+  }
+
+  static bool counterIsReliable();
+};  // class Clock
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_CLOCK_H_
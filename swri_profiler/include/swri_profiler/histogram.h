@@ -0,0 +1,172 @@
+#ifndef SWRI_PROFILER_HISTOGRAM_H_
+#define SWRI_PROFILER_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace swri_profiler
+{
+// LatencyHistogram is a fixed-size log-linear histogram (in the style
+// of HdrHistogram) of block durations.  Values below SUB_BUCKET_COUNT
+// get a bucket each.  Above that, each power of two is split into
+// SUB_BUCKET_COUNT linear buckets, so a bucket's width is never more
+// than 1/16 of its lower bound.  Values are in whatever unit the
+// caller uses (clock ticks for the profiler), and values beyond the
+// range of the histogram are counted in the last bucket.
+//
+// The histogram is not thread safe.  The profiler keeps one per
+// block in each thread's local storage and merges them when it
+// publishes.
+class LatencyHistogram
+{
+ public:
+  static const int SUB_BUCKET_BITS = 4;
+  static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+  static const int MAX_EXPONENT = 40;
+  static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+  LatencyHistogram() { clear(); }
+
+  static int bucketIndex(uint64_t value)
+  {
+    if (value < static_cast<uint64_t>(SUB_BUCKET_COUNT)) {
+      return static_cast<int>(value);
+    }
+
+    const int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) {
+      return BUCKET_COUNT - 1;
+    }
+
+    const int shift = exponent - SUB_BUCKET_BITS;
+    return shift * SUB_BUCKET_COUNT + static_cast<int>(value >> shift);
+  }
+
+  // Returns the smallest value that is counted in a bucket.
+  static uint64_t bucketLowerBound(int index)
+  {
+    if (index < 2*SUB_BUCKET_COUNT) {
+      return index;
+    }
+    const int shift = index / SUB_BUCKET_COUNT - 1;
+    return static_cast<uint64_t>(index - shift * SUB_BUCKET_COUNT) << shift;
+  }
+
+  void add(uint64_t value) { counts_[bucketIndex(value)]++; }
+
+  void merge(const LatencyHistogram &other)
+  {
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+      counts_[i] += other.counts_[i];
+    }
+  }
+
+  void clear() { std::memset(counts_, 0, sizeof(counts_)); }
+
+  uint32_t count(int index) const { return counts_[index]; }
+
+ private:
+  uint32_t counts_[BUCKET_COUNT];
+};  // class LatencyHistogram
+
+// HistogramDecoder estimates statistics from a histogram as it is
+// reported (see ProfileHistogram.msg): the indices of the nonempty
+// buckets, in increasing order, and their counts.  A report's
+// sub_bucket_bits may differ from LatencyHistogram::SUB_BUCKET_BITS,
+// so the decoder is built from the report's value, and values are in
+// the histogram's units times scale (e.g. the report's
+// histogram_ns_per_unit).  Buckets and Counts can be any indexable
+// containers.
+class HistogramDecoder
+{
+ public:
+  HistogramDecoder(int sub_bucket_bits, double scale)
+    :
+    sub_bucket_count_(1 << sub_bucket_bits),
+    scale_(scale)
+  {
+  }
+
+  // Returns the smallest value (unscaled) that is counted in a
+  // bucket.
+  double bucketLowerBound(int index) const
+  {
+    if (index < 2*sub_bucket_count_) {
+      return index;
+    }
+    const int shift = index / sub_bucket_count_ - 1;
+    return std::ldexp(static_cast<double>(index - shift*sub_bucket_count_), shift);
+  }
+
+  // Estimates the requested percentiles (0.0 to 1.0, in increasing
+  // order) and stores them in values.  Values are interpolated
+  // linearly within the bucket that contains the percentile, and are
+  // zero if the histogram is empty.
+  template <class Buckets, class Counts>
+  void percentiles(uint64_t *values,
+                   const double *percentiles,
+                   size_t count,
+                   const Buckets &buckets,
+                   const Counts &counts) const
+  {
+    std::fill(values, values + count, 0);
+
+    const size_t size = std::min<size_t>(buckets.size(), counts.size());
+    double total = 0.0;
+    for (size_t i = 0; i < size; i++) {
+      total += counts[i];
+    }
+    if (total == 0.0) {
+      return;
+    }
+
+    size_t p = 0;
+    double cumulative = 0.0;
+    for (size_t i = 0; i < size && p < count; i++) {
+      const double bucket_count = counts[i];
+      const double lower = bucketLowerBound(buckets[i]);
+      const double upper = bucketLowerBound(buckets[i]+1);
+      while (p < count && cumulative + bucket_count >= percentiles[p]*total) {
+        double fraction = bucket_count ? (percentiles[p]*total - cumulative) / bucket_count : 0.0;
+        fraction = std::max(0.0, std::min(1.0, fraction));
+        values[p] = (lower + fraction*(upper - lower)) * scale_;
+        p++;
+      }
+      cumulative += bucket_count;
+    }
+  }
+
+  // Returns the coefficient of variation (standard deviation / mean)
+  // of the values, using the midpoint of each bucket, or zero if
+  // there are fewer than two values.
+  template <class Buckets, class Counts>
+  double variation(const Buckets &buckets, const Counts &counts) const
+  {
+    const size_t size = std::min<size_t>(buckets.size(), counts.size());
+    double n = 0.0;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < size; i++) {
+      const double value = (bucketLowerBound(buckets[i]) + bucketLowerBound(buckets[i]+1)) / 2.0;
+      n += counts[i];
+      sum += counts[i] * value;
+      sum_sq += counts[i] * value * value;
+    }
+
+    if (n < 2.0 || sum <= 0.0) {
+      return 0.0;
+    }
+
+    const double mean = sum / n;
+    const double variance = std::max(0.0, (sum_sq - n*mean*mean) / (n - 1.0));
+    return std::sqrt(variance) / mean;
+  }
+
+ private:
+  int sub_bucket_count_;
+  double scale_;
+};  // class HistogramDecoder
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_HISTOGRAM_H_
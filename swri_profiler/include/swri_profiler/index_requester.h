@@ -0,0 +1,66 @@
+#ifndef SWRI_PROFILER_INDEX_REQUESTER_H_
+#define SWRI_PROFILER_INDEX_REQUESTER_H_
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <ros/callback_queue_interface.h>
+#include <ros/service_client.h>
+#include <ros/time.h>
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+
+namespace swri_profiler
+{
+// IndexRequester requests the full index of profiled nodes from their
+// get_index services, for subscribers that joined late or missed an
+// index message.  The requests are made on a separate thread, so a
+// node that is slow to answer (or gone) doesn't stall the caller's
+// subscriptions.  Each answer is passed to the callback from the
+// callback queue, so it is handled on the same thread as the
+// caller's other callbacks.
+class IndexRequester
+{
+ public:
+  typedef boost::function<void(const swri_profiler_msgs::ProfileIndexArray&)> Callback;
+
+  // The queue defaults to the global callback queue.
+  explicit IndexRequester(const Callback &callback,
+                          ros::CallbackQueueInterface *queue = NULL);
+  ~IndexRequester();
+
+  // Requests the full index of a node, unless it was requested in
+  // the last few seconds, so that we don't flood a node that can't
+  // answer.  Returns immediately.
+  void request(const std::string &node_name);
+
+ private:
+  Callback callback_;
+  ros::CallbackQueueInterface *queue_;
+
+  // When we last requested the full index from each node.  Only used
+  // by the caller's thread.
+  std::map<std::string, ros::WallTime> last_request_;
+
+  // The nodes to request, shared with the request thread.
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  std::deque<std::string> pending_;
+  bool stop_;
+
+  // A persistent connection to each node's service.  Only used by the
+  // request thread.
+  std::map<std::string, ros::ServiceClient> clients_;
+
+  boost::thread thread_;
+
+  void run();
+  bool call(const std::string &node_name, swri_profiler_msgs::ProfileIndexArray &index);
+};  // class IndexRequester
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_INDEX_REQUESTER_H_
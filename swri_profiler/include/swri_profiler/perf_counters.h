@@ -0,0 +1,84 @@
+#ifndef SWRI_PROFILER_PERF_COUNTERS_H_
+#define SWRI_PROFILER_PERF_COUNTERS_H_
+
+#include <stdint.h>
+
+namespace swri_profiler
+{
+// PerfCounterValues holds a reading of every counter.  Counters that
+// aren't available read as zero.
+struct PerfCounterValues
+{
+  enum Counter
+  {
+    INSTRUCTIONS = 0,
+    CACHE_MISSES,
+    CONTEXT_SWITCHES,
+    PAGE_FAULTS,
+    COUNT
+  };
+
+  uint64_t values[COUNT];
+
+  PerfCounterValues() { clear(); }
+
+  void clear()
+  {
+    for (int i = 0; i < COUNT; i++) {
+      values[i] = 0;
+    }
+  }
+
+  uint64_t& operator[](int counter) { return values[counter]; }
+  uint64_t operator[](int counter) const { return values[counter]; }
+
+  // Returns the counter's name as it is published.
+  static const char* name(int counter);
+};
+
+// PerfCounters is a group of Linux perf_event counters for the
+// thread that opened it.  The hardware counters (instructions and
+// cache misses) are often unavailable in containers and VMs, in
+// which case only the software counters (context switches and page
+// faults) are opened.  The whole group is read with a single read()
+// system call.  If the kernel multiplexes the hardware counters, the
+// values are scaled up from the time the group was counting, so they
+// are estimates and consecutive readings may even decrease slightly.
+class PerfCounters
+{
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  // Opens the counters for the calling thread.  Returns false if no
+  // counter could be opened.
+  bool open();
+  void close();
+  bool isOpen() const { return leader_fd_ >= 0; }
+
+  // Returns a mask with bit i set if counter i is open.
+  uint32_t openMask() const { return mask_; }
+
+  // Reads the current counter values.  Counters that aren't open are
+  // left unchanged.  This must be called by the thread that opened
+  // the counters.
+  void read(PerfCounterValues &values) const;
+
+  // Returns a mask of the counters that any thread has opened.
+  static uint32_t availableMask();
+
+ private:
+  int leader_fd_;
+  int fds_[PerfCounterValues::COUNT];
+  // The counters in the order they appear in the group's read
+  // format.
+  int order_[PerfCounterValues::COUNT];
+  int open_count_;
+  uint32_t mask_;
+
+  // Not copyable.
+  PerfCounters(const PerfCounters&);
+  PerfCounters& operator=(const PerfCounters&);
+};  // class PerfCounters
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_PERF_COUNTERS_H_
@@ -4,206 +4,1075 @@
 #include <algorithm>
 #include <limits>
 #include <unordered_map>
+#include <vector>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <pthread.h>
+
+#include <boost/thread/tss.hpp>
 
 #include <ros/time.h>
 #include <ros/console.h>
-#include <diagnostic_updater/diagnostic_updater.h>
+
+#include <swri_profiler/adaptive_lock.h>
+#include <swri_profiler/alloc_tracker.h>
+#include <swri_profiler/clock.h>
+#include <swri_profiler/histogram.h>
+#include <swri_profiler/perf_counters.h>
+#include <swri_profiler/trace_buffer.h>
+
+// Compile-time filters for SWRI_PROFILE_L and SWRI_PROFILE_CAT (see
+// below).  These are normally set for a whole workspace with the
+// CMake variables of the same names.  By default every block is
+// compiled.
+#if defined(SWRI_PROFILER_LEVEL) || defined(SWRI_PROFILER_CATEGORIES)
+#define SWRI_PROFILER_FILTERED
+#endif
+#ifndef SWRI_PROFILER_LEVEL
+#define SWRI_PROFILER_LEVEL 255
+#endif
+#ifndef SWRI_PROFILER_CATEGORIES
+#define SWRI_PROFILER_CATEGORIES 0xFFFFFFFF
+#endif
 
 namespace swri_profiler
 {
-class SpinLock
+class ProfilerSink;
+
+class Profiler
 {
-  std::atomic_flag locked_;
  public:
-  SpinLock() : locked_(ATOMIC_FLAG_INIT) {}
-    
-  void acquire()
-  { 
-    while (locked_.test_and_set(std::memory_order_acquire)) { ; }
+  // A Block is registered for each label the first time it is
+  // profiled and is never deleted.  id is the block's id in the call
+  // tree, and enabled is the block's runtime switch.
+  struct Block
+  {
+    int id;
+    std::atomic<bool> enabled;
+    Block() : id(0), enabled(true) {}
+  };
+
+  // A BlockSite caches the block of a profiled block whose label is a
+  // string literal.  SWRI_PROFILE declares one as a function-local
+  // static, so the label is only looked up the first time the block
+  // is executed.  It must have static storage so that it is zero
+  // initialized.  Labels that aren't literals are never cached, since
+  // a label built at runtime (e.g. in a char buffer) could change
+  // after it was cached.  See SWRI_PROFILER_LITERAL.
+  struct BlockSite
+  {
+    std::atomic<Block*> block;
+  };
+
+  // Runs the profiler without ROS (e.g. for benchmarks).  Reports are
+  // only passed to the sinks added with addSink() (or selected with
+  // SWRI_PROFILER_SINK), parameters are not read, and the publishing
+  // thread only runs between calls to startCollector() and
+  // stopCollector().  This must be called before anything is
+  // profiled.
+  //
+  // Programs that simply don't call ros::init() don't need this: the
+  // profiler uses ROS only once it has been initialized.
+  static void initializeOffline();
+
+  // Adds or removes a sink that receives the reports (see
+  // profiler_sink.h).  Sinks may be changed at any time.
+  static void addSink(const std::shared_ptr<ProfilerSink> &sink);
+  static void removeSink(const std::shared_ptr<ProfilerSink> &sink);
+
+  // Starts or stops the publishing thread.  The thread is started
+  // automatically unless the profiler is offline.  Stopping it
+  // publishes a final report.
+  static void startCollector();
+  static void stopCollector();
+
+  // Enables or disables profiling at runtime.  While profiling is
+  // disabled, profiled blocks only check this switch and the
+  // publishing thread idles.  The initial state is set by the
+  // SWRI_PROFILER_ENABLED environment variable or the
+  // ~swri_profiler/enabled parameter, and it can be changed with the
+  // ~swri_profiler/set_enabled service.
+  static void setEnabled(bool enabled);
+  static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Enables or disables every block with the given label.  Blocks
+  // nested inside a disabled block are reported as if they were
+  // called from the disabled block's parent.  The
+  // ~swri_profiler/disabled_labels parameter lists the labels that
+  // start disabled.
+  static void setLabelEnabled(const std::string &label, bool enabled);
+
+  // An AsyncToken identifies an async span that was started with
+  // beginAsync().  A default constructed token (or one returned
+  // while profiling is disabled) doesn't refer to any span.
+  struct AsyncToken
+  {
+    int node;
+    Ticks t0;
+    AsyncToken() : node(0), t0(0) {}
+  };
+
+  // Async spans measure work that isn't bound to a single thread's
+  // stack, such as a message that is received in a callback and
+  // processed by a worker pool.  The span starts when beginAsync() is
+  // called and ends when endAsync() is called with its token, from
+  // any thread.  Spans are reported like blocks under the /[async]
+  // branch of the call tree (e.g. /[async]/name), but they aren't
+  // reported until they end.  A span that never ends is simply
+  // dropped.
+  static AsyncToken beginAsync(const std::string &name);
+  static void endAsync(const AsyncToken &token);
+
+  // Counters and gauges are named values that are reported alongside
+  // the profiled blocks, such as queue sizes or the number of points
+  // processed.  A counter's updates are deltas that add up over time
+  // and a gauge's updates are samples of its current value.  Each
+  // thread aggregates its own updates (their count, sum, min, max, and
+  // the latest value) and the publishing thread combines them once
+  // per report period.  A name must always be used with the same type.
+  enum MetricType
+  {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE = 1
+  };
+
+  // A MetricSite caches the id of a metric whose name is a string
+  // literal, like a BlockSite.  SWRI_PROFILE_COUNT and
+  // SWRI_PROFILE_GAUGE declare one as a function-local static.
+  struct MetricSite
+  {
+    std::atomic<int> id;
+  };
+
+  // Records a metric whose name is a string literal.  The id is
+  // cached in site, so the name is only looked up once.
+  template <size_t N>
+  static void recordMetric(MetricSite &site, const char (&name)[N],
+                           MetricType type, double value, std::true_type)
+  {
+    if (!enabled_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    int id = site.id.load(std::memory_order_acquire);
+    if (id == 0) {
+      id = registerMetric(name, type);
+      site.id.store(id, std::memory_order_release);
+    }
+    addMetric(id, value);
   }
 
-  void release()
+  // Records a metric whose name may change at runtime.  The name is
+  // looked up in a thread local table on every call.
+  template <bool literal>
+  static void recordMetric(MetricSite &, const std::string &name,
+                           MetricType type, double value,
+                           std::integral_constant<bool, literal>)
   {
-    locked_.clear(std::memory_order_release);
+    if (!enabled_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    if (!tls_.get()) {
+      // See open().
+      initializeTLS();
+      if (!enabled_.load(std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    std::unordered_map<std::string, int> &metric_ids = tls_->metric_ids;
+    auto const it = metric_ids.find(name);
+    if (it != metric_ids.end()) {
+      addMetric(it->second, value);
+      return;
+    }
+
+    const int id = registerMetric(name, type);
+    if (id > 0) {
+      metric_ids[name] = id;
+    }
+    addMetric(id, value);
   }
-};
 
-class SpinLockGuard
-{
-  SpinLock &lock_;
-  
- public:
-  SpinLockGuard(SpinLock &lock) : lock_(lock) { lock_.acquire(); }
-  ~SpinLockGuard() { lock_.release(); }
-};
+  // Returns the compile-time filters that the profiled code was
+  // built with.  If translation units were built with different
+  // filters, these are the highest level and the union of the
+  // categories.  If no filters were set, everything was compiled
+  // (level 255 and every category).
+  static int compiledLevel();
+  static uint32_t compiledCategories();
 
-class Profiler
-{
+  // Records the filters of a translation unit.  This is called
+  // during static initialization by every translation unit that
+  // includes this header with filters set.
+  static void registerCompiledFilters(int level, uint32_t categories);
+
+ private:
   // OpenInfo stores data for profiled blocks that are currently
-  // executing.
+  // executing.  node is the block's id in the call tree and block is
+  // the id of its label.  Times are in raw clock ticks.  Sampled
+  // blocks only time some of their calls; t0 is not set when timed is
+  // false.  timed_opens and untimed_opens are the thread's open
+  // counters just after the block was opened, so that we can tell how
+  // many descendants the block opened (see TLS).  When CPU time is
+  // measured, cpu_t0 and cpu_last_report are the thread's CPU time in
+  // nanoseconds, and when perf counters are enabled, counters_t0 is
+  // their reading when the block was opened.  When allocations are
+  // tracked, allocs_t0 is the thread's allocation counters when the
+  // block was opened and child_allocs counts the allocations made
+  // inside the blocks nested in it.
   struct OpenInfo
   {
-    ros::WallTime t0;
-    ros::WallTime last_report_time;
-    OpenInfo() : last_report_time(0) {}
+    int node;
+    int block;
+    bool timed;
+    uint32_t sample_period;
+    Ticks t0;
+    Ticks last_report_time;
+    int64_t cpu_t0;
+    int64_t cpu_last_report;
+    PerfCounterValues counters_t0;
+    AllocCounters allocs_t0;
+    AllocCounters child_allocs;
+    uint64_t timed_opens;
+    uint64_t untimed_opens;
+    OpenInfo() : node(0), block(0), timed(false), sample_period(1), t0(0), last_report_time(0),
+                 cpu_t0(0), cpu_last_report(0), allocs_t0(), child_allocs(),
+                 timed_opens(0), untimed_opens(0) {}
   };
 
   // ClosedInfo stores data for profiled blocks that have finished
-  // executing.
+  // executing.  Durations are in raw clock ticks and are converted
+  // by the publishing thread.  The durations and histogram only
+  // cover the timed_count calls that were timed, which is less than
+  // count for sampled blocks.  The timed calls opened
+  // timed_descendants and untimed_descendants nested blocks, which
+  // is used to estimate how much of their time was the profiler's own
+  // overhead.  recursive_count is the number of recursive calls that
+  // were collapsed into the block's calls (see TLS).  cpu_duration
+  // and rel_cpu_duration are the thread CPU time (in nanoseconds) of
+  // the timed calls, when CPU time is measured, and counters are the
+  // perf counter deltas of the timed calls.  alloc_count and
+  // alloc_bytes are the heap allocations made directly in the block
+  // (not in the blocks nested in it) by every call.  The histogram
+  // is allocated the first time the block is opened (see
+  // addClosedNode) and is kept (cleared) after that.
   struct ClosedInfo
   {
     size_t count;
-    ros::WallDuration total_duration;
-    ros::WallDuration rel_duration;
-    ros::WallDuration max_duration;  
-    ClosedInfo() : count(0) {}
+    size_t timed_count;
+    uint32_t sample_period;
+    Ticks total_duration;
+    Ticks rel_duration;
+    Ticks max_duration;  
+    uint64_t timed_descendants;
+    uint64_t untimed_descendants;
+    uint64_t recursive_count;
+    int64_t cpu_duration;
+    int64_t rel_cpu_duration;
+    PerfCounterValues counters;
+    uint64_t alloc_count;
+    uint64_t alloc_bytes;
+    std::unique_ptr<LatencyHistogram> histogram;
+    ClosedInfo() : count(0), timed_count(0), sample_period(1), total_duration(0), rel_duration(0), max_duration(0),
+                   timed_descendants(0), untimed_descendants(0), recursive_count(0),
+                   cpu_duration(0), rel_cpu_duration(0), alloc_count(0), alloc_bytes(0) {}
+
+    void merge(const ClosedInfo &other)
+    {
+      if (other.count == 0) {
+        return;
+      }
+
+      if (timed_count == 0) {
+        total_duration = other.total_duration;
+        rel_duration = other.rel_duration;
+        max_duration = other.max_duration;
+      } else if (other.timed_count > 0) {
+        total_duration += other.total_duration;
+        rel_duration += other.rel_duration;
+        max_duration = std::max(max_duration, other.max_duration);
+      }
+      count += other.count;
+      timed_count += other.timed_count;
+      sample_period = std::max(sample_period, other.sample_period);
+      timed_descendants += other.timed_descendants;
+      untimed_descendants += other.untimed_descendants;
+      recursive_count += other.recursive_count;
+      cpu_duration += other.cpu_duration;
+      rel_cpu_duration += other.rel_cpu_duration;
+      for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+        counters[i] += other.counters[i];
+      }
+      alloc_count += other.alloc_count;
+      alloc_bytes += other.alloc_bytes;
+
+      if (other.histogram) {
+        if (!histogram) {
+          histogram.reset(new LatencyHistogram());
+        }
+        histogram->merge(*other.histogram);
+      }
+    }
+
+    // Adds the durations of a timed call.  The call must already be
+    // counted in count.  This never allocates, so the histogram is
+    // only updated if it has been allocated.
+    void addTimedCall(Ticks abs, Ticks rel)
+    {
+      timed_count++;
+      if (timed_count == 1) {
+        total_duration = abs;
+        max_duration = abs;
+        rel_duration = rel;
+      } else {
+        total_duration += abs;
+        rel_duration += rel;
+        max_duration = std::max(max_duration, abs);
+      }
+
+      // A duration can come out negative if the clock isn't
+      // synchronized across cores (e.g. an async span that ends on
+      // another core), and it would land in the last bucket.
+      if (histogram) {
+        histogram->add(abs > 0 ? abs : 0);
+      }
+    }
+
+    void reset()
+    {
+      count = 0;
+      timed_count = 0;
+      sample_period = 1;
+      total_duration = 0;
+      rel_duration = 0;
+      max_duration = 0;
+      timed_descendants = 0;
+      untimed_descendants = 0;
+      recursive_count = 0;
+      cpu_duration = 0;
+      rel_cpu_duration = 0;
+      counters.clear();
+      alloc_count = 0;
+      alloc_bytes = 0;
+      if (histogram) {
+        histogram->clear();
+      }
+    }
   };
 
-  // Thread local storage for the profiler.
+  // Closed block data is indexed by node id.
+  typedef std::vector<ClosedInfo> ClosedVector;
+
+  // MetricInfo aggregates the updates of a counter or gauge.  last is
+  // the value of the latest update and last_time is when it was made,
+  // so that the latest value can be found across threads.
+  struct MetricInfo
+  {
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+    double last;
+    Ticks last_time;
+    MetricInfo() : count(0), sum(0.0), min(0.0), max(0.0), last(0.0), last_time(0) {}
+
+    void add(double value, Ticks t)
+    {
+      if (count == 0) {
+        min = value;
+        max = value;
+      } else {
+        min = std::min(min, value);
+        max = std::max(max, value);
+      }
+      count++;
+      sum += value;
+      last = value;
+      last_time = t;
+    }
+
+    void merge(const MetricInfo &other)
+    {
+      if (other.count == 0) {
+        return;
+      }
+
+      if (count == 0) {
+        min = other.min;
+        max = other.max;
+      } else {
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+      }
+      count += other.count;
+      sum += other.sum;
+      if (other.last_time >= last_time) {
+        last = other.last;
+        last_time = other.last_time;
+      }
+    }
+
+    void reset()
+    {
+      *this = MetricInfo();
+    }
+  };
+
+  // Metric data is indexed by metric id.
+  typedef std::vector<MetricInfo> MetricVector;
+
+  // A ChildLink maps a block id to the call tree node reached by
+  // opening that block from a parent node.
+  typedef std::pair<int, int> ChildLink;
+
+  // Thread local storage for the profiler.  Each thread accumulates
+  // its data into its own buffers so that profiled threads never
+  // contend with each other.  The TLS objects are also registered
+  // with the profiler so that the publishing thread can harvest them.
   struct TLS
   {
     // We support multiple threads by tracking the call stack
     // independently per thread.  We also track the stack depth to
     // guard against problems from recursion.
     size_t stack_depth;
-    std::string stack_str;
-    std::string thread_prefix;
-  };
 
-  // open_blocks_ stores data for profiled blocks that are currently
-  // executing.  It maps a thread_prefix + stack_address to an OpenInfo
-  // block.  This is stored as a shared static variable instead of a
-  // TLS because the publishing thread needs to access it.
-  static std::unordered_map<std::string, OpenInfo> open_blocks_;
+    // The number of timed and untimed blocks this thread has opened.
+    // Each open/close pair adds some overhead to the blocks enclosing
+    // it, so the difference between these counters and a block's
+    // OpenInfo tells us how much overhead was added to the block.
+    uint64_t timed_opens;
+    uint64_t untimed_opens;
+
+    // open_blocks stores the blocks that are currently executing.
+    // It is indexed by stack depth and never shrinks, so the slots
+    // are reused without allocating.
+    std::vector<OpenInfo> open_blocks;
+
+    // children caches this thread's view of the call tree.  It is
+    // indexed by the parent node id and stores the (block, node)
+    // pairs that have been opened from that parent.  Nodes are only
+    // registered with the profiler the first time a thread reaches
+    // them, after that we only need a short linear search.
+    std::vector<std::vector<ChildLink> > children;
+
+    // When recursion is collapsed, open_calls is indexed by block id
+    // and stores one more than the number of recursive calls to each
+    // block that is open on this thread's stack, or zero if the block
+    // is not open.  A block that is opened again while it is already
+    // on the stack is only counted here, so its time is attributed to
+    // the outermost call and the call tree doesn't grow with the
+    // recursion depth.  Only this thread uses it.
+    std::vector<uint32_t> open_calls;
+
+    // Counts down the calls to each sampled node (indexed by node
+    // id) until the next call that is timed.
+    std::vector<uint32_t> sample_countdown;
+
+    // block_ids caches the blocks of labels that were not profiled
+    // with a static label.
+    std::unordered_map<std::string, Block*> block_ids;
+
+    // closed_blocks is double buffered.  The thread always writes to
+    // closed_blocks[active].  The publishing thread flips active
+    // and then reads the other buffer at its leisure.  The buffers
+    // are reset by zeroing their entries rather than clearing them
+    // so that the thread doesn't have to reallocate entries after
+    // every report.
+    ClosedVector closed_blocks[2];
+    size_t active;
+
+    // The number of entries in each closed_blocks buffer that have
+    // been allocated (see addClosedNode).
+    size_t closed_nodes[2];
 
-  // closed_blocks_ stored data for profiled blocks that have finished
-  // executing.  It maps a stack_address to a ClosedInfo block.  This
-  // map is cleared out regularly.
-  static std::unordered_map<std::string, ClosedInfo> closed_blocks_;
+    // metrics is double buffered with closed_blocks.  metric_ids
+    // caches the ids of metrics that were not recorded with a static
+    // name.
+    MetricVector metrics[2];
+    std::unordered_map<std::string, int> metric_ids;
+
+    // exited is set when the thread terminates.  The publishing
+    // thread deletes the TLS after harvesting its final data.
+    bool exited;
+
+    // trace records every call when trace mode is enabled, and is
+    // NULL otherwise.  It is a lock-free ring buffer that is drained
+    // by the publishing thread.
+    std::unique_ptr<TraceBuffer> trace;
+
+    // perf counts hardware and software events for the thread when
+    // perf counters are enabled and at least one is available, and
+    // is NULL otherwise.
+    std::unique_ptr<PerfCounters> perf;
+
+    // The thread's OS thread id, name, and handle.  The publishing
+    // thread uses the handle to read the thread's CPU time, which is
+    // only safe while the thread hasn't exited.
+    int tid;
+    std::string thread_name;
+    pthread_t thread;
+
+    // Set by the publishing thread once the thread's name has been
+    // written to the trace.
+    bool trace_named;
+
+    // This lock guards everything above that is read by the
+    // publishing thread (stack_depth, the open counters,
+    // open_blocks, active, closed_nodes, the active metrics, and
+    // exited).  It is only contended when the publishing thread
+    // takes its snapshot, so it is effectively free for the owning
+    // thread.
+    AdaptiveLock lock;
+
+    TLS() : stack_depth(0), timed_opens(0), untimed_opens(0), active(0), exited(false),
+            tid(0), trace_named(false)
+    {
+      closed_nodes[0] = 0;
+      closed_nodes[1] = 0;
+    }
+  };
 
   // tls_ stores the thread local storage so that the profiler can
   // maintain a separate stack for each thread.
   static boost::thread_specific_ptr<TLS> tls_;
 
-  // This spinlock guards access to open_blocks_ and closed_blocks_.
-  static SpinLock lock_;
+  // registered_tls_ stores every thread's local storage so that the
+  // publishing thread can collect their data.  It is guarded by
+  // lock_.
+  static std::vector<TLS*> registered_tls_;
+
+  // The global runtime switch (see setEnabled).
+  static std::atomic<bool> enabled_;
+
+  // Whether recursive calls are collapsed into the outermost call
+  // (see TLS::open_calls).  This is set when the profiler is
+  // initialized, before any thread local storage exists, from the
+  // SWRI_PROFILER_COLLAPSE_RECURSION environment variable or the
+  // ~swri_profiler/collapse_recursion parameter.
+  static bool collapse_recursion_;
+
+  // Whether profiled blocks also measure the thread's CPU time.  This
+  // is set when the profiler is initialized, like
+  // collapse_recursion_, from the SWRI_PROFILER_CPU_TIME environment
+  // variable or the ~swri_profiler/cpu_time parameter.
+  static bool cpu_time_;
+
+  // This lock guards profiler initialization, the registry of
+  // thread local storage, and the block and call tree registries.
+  // It is only taken when a thread reaches a block or call tree node
+  // for the first time and by the publishing thread.
+  static AdaptiveLock lock_;
 
   // Other static methods implemented in profiler.cpp
   static void initializeProfiler();
   static void initializeTLS();
+  static void releaseTLS(TLS *tls);
   static void profilerMain();
   static void collectAndPublish();
+  static void publishMetrics(const MetricVector &new_metrics,
+                             const ros::WallTime &wall_now,
+                             const ros::Time &ros_now);
+  static void calibrateOverhead();
+  static void drainTraces();
 
-  static bool open(const std::string &name, const ros::WallTime &t0)
+  // Returns the block with the given label, registering it if
+  // necessary.  Returns NULL for an invalid label.
+  static Block* registerBlock(const std::string &label);
+  // Returns the id of the call tree node reached by opening block
+  // from parent, registering it if necessary.
+  static int registerNode(int parent, int block);
+  // Returns the full path of a call tree node.  This is slow and
+  // only intended for error reporting.
+  static std::string nodePath(int node);
+  // Report stack errors.  These are out of line to keep logging out
+  // of open() and close().
+  static void reportStackOverflow(size_t depth, int parent);
+  static void reportEmptyStack();
+  // Builds the paths of call tree nodes that were registered since
+  // the last call.  This is only used by the publishing thread.
+  static void updateNodePaths();
+  // Returns the id of the metric with the given name, registering it
+  // if necessary.  Returns 0 for an invalid name or if the name was
+  // registered with a different type.
+  static int registerMetric(const std::string &name, MetricType type);
+
+  static void addMetric(int id, double value)
+  {
+    if (id <= 0) {
+      return;
+    }
+
+    if (!tls_.get()) {
+      // See open().
+      initializeTLS();
+      if (!enabled_.load(std::memory_order_relaxed)) {
+        return;
+      }
+    }
+    TLS &tls = *tls_;
+    const Ticks t = Clock::now();
+    AdaptiveLockGuard guard(tls.lock);
+    MetricVector &metrics = tls.metrics[tls.active];
+    if (metrics.size() <= static_cast<size_t>(id)) {
+      metrics.resize(id+1);
+    }
+    metrics[id].add(value, t);
+  }
+
+  static Block* findBlock(const std::string &label)
   {
     if (!tls_.get()) { initializeTLS(); }
+    std::unordered_map<std::string, Block*> &block_ids = tls_->block_ids;
+
+    auto const it = block_ids.find(label);
+    if (it != block_ids.end()) {
+      return it->second;
+    }
+
+    Block *block = registerBlock(label);
+    if (block) {
+      block_ids[label] = block;
+    }
+    return block;
+  }
+
+  // Adds an entry for node, with its histogram, to the thread's
+  // active closed_blocks buffer.  This is done when the thread opens
+  // the node for the first time, and the publishing thread adds the
+  // entry to the other buffer when it flips them, so that close()
+  // never allocates.  The allocations are left out of the thread's
+  // allocation counters.  This must be called with tls.lock held.
+  static void addClosedNode(TLS &tls, int node)
+  {
+    const AllocCounters allocs = thread_alloc_counters_;
+    ClosedVector &closed = tls.closed_blocks[tls.active];
+    if (closed.size() <= static_cast<size_t>(node)) {
+      closed.resize(node+1);
+    }
+    if (!closed[node].histogram) {
+      closed[node].histogram.reset(new LatencyHistogram());
+      tls.closed_nodes[tls.active]++;
+    }
+    thread_alloc_counters_ = allocs;
+  }
+
+  static int findChild(TLS &tls, int parent, int block)
+  {
+    if (tls.children.size() <= static_cast<size_t>(parent)) {
+      tls.children.resize(parent+1);
+    }
+
+    std::vector<ChildLink> &links = tls.children[parent];
+    for (auto const &link : links) {
+      if (link.first == block) {
+        return link.second;
+      }
+    }
+
+    int node = registerNode(parent, block);
+    links.push_back(ChildLink(block, node));
+    return node;
+  }
+
+  // Returns true for one of every sample_period calls to a node.
+  static bool sampleCall(TLS &tls, int node, uint32_t sample_period)
+  {
+    if (tls.sample_countdown.size() <= static_cast<size_t>(node)) {
+      tls.sample_countdown.resize(node+1, 0);
+    }
+
+    uint32_t &countdown = tls.sample_countdown[node];
+    if (countdown == 0) {
+      countdown = sample_period - 1;
+      return true;
+    }
+    countdown--;
+    return false;
+  }
 
-    if (name.empty()) {
-      ROS_ERROR("Profiler error: Profiled section has empty name. "
-                "Current stack is '%s'.",
-                tls_->stack_str.c_str());
+  // Returns true if block is already open on this thread's stack
+  // and recursion is collapsed, in which case the call has been
+  // counted and must not be opened.
+  static bool enterRecursion(int block)
+  {
+    if (!collapse_recursion_ || block <= 0) {
+      return false;
+    }
+
+    std::vector<uint32_t> &open_calls = tls_->open_calls;
+    if (open_calls.size() <= static_cast<size_t>(block)) {
+      open_calls.resize(block+1, 0);
+    }
+    if (open_calls[block] == 0) {
+      return false;
+    }
+    open_calls[block]++;
+    return true;
+  }
+
+  static bool open(int block, uint32_t sample_period)
+  {
+    // The bookkeeping below allocates when the thread sees a block
+    // or a deeper stack for the first time.  Those allocations are
+    // left out of the thread's allocation counters.
+    const AllocCounters allocs = thread_alloc_counters_;
+    if (!tls_.get()) {
+      // The first block loads the settings (including
+      // SWRI_PROFILER_ENABLED) after the caller checked enabled_.
+      initializeTLS();
+      if (!enabled_.load(std::memory_order_relaxed)) {
+        return false;
+      }
+    }
+    TLS &tls = *tls_;
+
+    if (block <= 0) {
+      return false;
+    }
+
+    if (enterRecursion(block)) {
+      thread_alloc_counters_ = allocs;
       return false;
     }
     
-    if (tls_->stack_depth >= 100) {
-      ROS_ERROR("Profiler error: reached max stack size (%zu) while "
-                "opening '%s'. Current stack is '%s'.",
-                tls_->stack_depth,
-                name.c_str(),
-                tls_->stack_str.c_str());
+    int parent = 0;
+    if (tls.stack_depth > 0) {
+      parent = tls.open_blocks[tls.stack_depth-1].node;
+    }
+
+    if (tls.stack_depth >= 100) {
+      reportStackOverflow(tls.stack_depth, parent);
       return false;
     }
 
-    tls_->stack_depth++;
-    tls_->stack_str = tls_->stack_str + "/" + name;
+    int node = findChild(tls, parent, block);
+
+    // Untimed calls to sampled blocks still go on the stack to keep
+    // the call tree intact, but skip reading the clock.
+    const bool timed = sample_period <= 1 || sampleCall(tls, node, sample_period);
 
-    std::string open_index = tls_->thread_prefix + tls_->stack_str;
     {
-      SpinLockGuard guard(lock_);
-      OpenInfo &info = open_blocks_[open_index];
-      info.t0 = t0;
-      info.last_report_time = ros::WallTime(0,0);
+      AdaptiveLockGuard guard(tls.lock);
+      const ClosedVector &closed = tls.closed_blocks[tls.active];
+      if (closed.size() <= static_cast<size_t>(node) || !closed[node].histogram) {
+        addClosedNode(tls, node);
+      }
+      if (tls.open_blocks.size() <= tls.stack_depth) {
+        tls.open_blocks.resize(tls.stack_depth+1);
+      }
+      OpenInfo &info = tls.open_blocks[tls.stack_depth];
+      info.node = node;
+      info.block = block;
+      info.timed = timed;
+      info.sample_period = sample_period;
+      info.last_report_time = 0;
+      info.cpu_last_report = 0;
+      if (timed) {
+        tls.timed_opens++;
+      } else {
+        tls.untimed_opens++;
+      }
+      info.timed_opens = tls.timed_opens;
+      info.untimed_opens = tls.untimed_opens;
+      tls.stack_depth++;
+      if (alloc_tracking_enabled_) {
+        thread_alloc_counters_ = allocs;
+        info.allocs_t0 = allocs;
+        info.child_allocs = AllocCounters();
+      }
+      // Read the clocks last so that the bookkeeping above is not
+      // included in the block's time.
+      if (timed && tls.perf) {
+        tls.perf->read(info.counters_t0);
+      }
+      info.cpu_t0 = timed && cpu_time_ ? Clock::threadCpuNSec() : 0;
+      info.t0 = timed ? Clock::now() : 0;
     }
 
+    if (collapse_recursion_) {
+      tls.open_calls[block] = 1;
+    }
     return true;
   }
   
-  static void close(const std::string &name, const ros::WallTime &tf)
+  static void close()
   {    
-    std::string open_index = tls_->thread_prefix + tls_->stack_str;
-    {
-      SpinLockGuard guard(lock_);
+    TLS &tls = *tls_;
+    // Only this thread modifies its stack, so we can peek at it
+    // without the lock to decide whether to read the clock.
+    const bool timed = tls.stack_depth > 0 && tls.open_blocks[tls.stack_depth-1].timed;
+    const Ticks tf = timed ? Clock::now() : 0;
+    const AllocCounters allocs_tf = alloc_tracking_enabled_ ? thread_alloc_counters_ : AllocCounters();
+    const int64_t cpu_tf = timed && cpu_time_ ? Clock::threadCpuNSec() : 0;
+    PerfCounterValues counters_tf;
+    if (timed && tls.perf) {
+      tls.perf->read(counters_tf);
+    }
+    AdaptiveLockGuard guard(tls.lock);
 
-      auto const open_it = open_blocks_.find(open_index);
-      if (open_it == open_blocks_.end()) {
-        ROS_ERROR("Missing entry for '%s' in open_index. Profiler is probably corrupted.",
-                  name.c_str());
-        return;
+    if (tls.stack_depth == 0) {
+      reportEmptyStack();
+      return;
+    }
+
+    // open() added the node to the active buffer.
+    const OpenInfo &open_info = tls.open_blocks[tls.stack_depth-1];
+    ClosedInfo &info = tls.closed_blocks[tls.active][open_info.node];
+    info.count++;
+    info.sample_period = open_info.sample_period;
+    if (collapse_recursion_) {
+      uint32_t &calls = tls.open_calls[open_info.block];
+      info.recursive_count += calls - 1;
+      calls = 0;
+    }
+    if (alloc_tracking_enabled_) {
+      // Allocations are attributed to the innermost block, so we
+      // leave out the ones made by nested blocks and pass ours on to
+      // the enclosing block.
+      const uint64_t count = allocs_tf.count - open_info.allocs_t0.count;
+      const uint64_t bytes = allocs_tf.bytes - open_info.allocs_t0.bytes;
+      info.alloc_count += count - open_info.child_allocs.count;
+      info.alloc_bytes += bytes - open_info.child_allocs.bytes;
+      if (tls.stack_depth > 1) {
+        AllocCounters &parent = tls.open_blocks[tls.stack_depth-2].child_allocs;
+        parent.count += count;
+        parent.bytes += bytes;
       }
-      
-      ros::WallDuration abs_duration = tf - open_it->second.t0;
-      ros::WallDuration rel_duration;
-      if (open_it->second.last_report_time > open_it->second.t0) {
-        rel_duration = tf - open_it->second.last_report_time;
-      } else {
-        rel_duration = tf - open_it->second.t0;
-      }
-      open_blocks_.erase(open_it);
-      
-      ClosedInfo &info = closed_blocks_[tls_->stack_str];
-      info.count++;
-      if (info.count == 1) {
-        info.total_duration = abs_duration;
-        info.max_duration = abs_duration;
-        info.rel_duration = rel_duration;
-      } else {
-        info.total_duration += abs_duration;
-        info.rel_duration += rel_duration;
-        info.max_duration = std::max(info.max_duration, abs_duration);
+    }
+    if (!timed) {
+      tls.stack_depth--;
+      return;
+    }
+
+    Ticks abs_duration = tf - open_info.t0;
+    Ticks rel_duration;
+    if (open_info.last_report_time > open_info.t0) {
+      rel_duration = tf - open_info.last_report_time;
+    } else {
+      rel_duration = tf - open_info.t0;
+    }
+
+    if (cpu_time_) {
+      info.cpu_duration += cpu_tf - open_info.cpu_t0;
+      info.rel_cpu_duration += cpu_tf - std::max(open_info.cpu_t0, open_info.cpu_last_report);
+    }
+    if (tls.perf) {
+      for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+        // Scaled readings of multiplexed counters may decrease.
+        if (counters_tf[i] > open_info.counters_t0[i]) {
+          info.counters[i] += counters_tf[i] - open_info.counters_t0[i];
+        }
       }
     }
 
-    const size_t len = name.size()+1;  
-    tls_->stack_str.erase(tls_->stack_str.size()-len, len);
-    tls_->stack_depth--;    
+    info.timed_descendants += tls.timed_opens - open_info.timed_opens;
+    info.untimed_descendants += tls.untimed_opens - open_info.untimed_opens;
+    info.addTimedCall(abs_duration, rel_duration);
+
+    if (tls.trace) {
+      tls.trace->push(open_info.node, open_info.t0, tf);
+    }
+
+    tls.stack_depth--;    
   }
 
  private:
-  std::string name_;
+  bool is_open_;
+
+  void openLabel(const std::string &name, uint32_t sample_period)
+  {
+    if (!enabled_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    // findBlock loads the settings the first time, so check again.
+    // Its allocations are left out of the thread's allocation
+    // counters, like addClosedNode's.
+    const AllocCounters allocs = thread_alloc_counters_;
+    Block *block = findBlock(name);
+    thread_alloc_counters_ = allocs;
+    if (block && block->enabled.load(std::memory_order_relaxed) &&
+        enabled_.load(std::memory_order_relaxed)) {
+      is_open_ = open(block->id, sample_period);
+    }
+  }
   
  public:
-  Profiler(const std::string &name)
+  // Profiles a block whose label is a string literal.  The block is
+  // cached in site so the label is only looked up once.  If
+  // sample_period is greater than one, only one of every
+  // sample_period calls is timed (every call is still counted).
+  template <size_t N>
+  Profiler(BlockSite &site, const char (&name)[N], uint32_t sample_period, std::true_type)
+    :
+    is_open_(false)
   {
-    if (open(name, ros::WallTime::now())) {
-      name_ = name;
-    } else {
-      name_ = "";
+    if (!enabled_.load(std::memory_order_relaxed)) {
+      return;
     }
+
+    Block *block = site.block.load(std::memory_order_acquire);
+    if (!block) {
+      const AllocCounters allocs = thread_alloc_counters_;
+      block = registerBlock(name);
+      thread_alloc_counters_ = allocs;
+      site.block.store(block, std::memory_order_release);
+    }
+    if (block && block->enabled.load(std::memory_order_relaxed)) {
+      is_open_ = open(block->id, sample_period);
+    }
+  }
+
+  // Profiles a block with a label that may change at runtime, such
+  // as ros::this_node::getName().  The label is looked up in a
+  // thread local table on every call.
+  template <bool literal>
+  Profiler(BlockSite &, const std::string &name, uint32_t sample_period,
+           std::integral_constant<bool, literal>)
+    :
+    is_open_(false)
+  {
+    openLabel(name, sample_period);
+  }
+
+  Profiler(const std::string &name, uint32_t sample_period = 1)
+    :
+    is_open_(false)
+  {
+    openLabel(name, sample_period);
   }
   
   ~Profiler()
   {
-    if (!name_.empty()) {
-      close(name_, ros::WallTime::now());
+    if (is_open_) {
+      close();
     }
   }
 };  
+
+// NullProfiler takes the place of a Profiler for blocks that are
+// filtered out at compile time.  It does nothing, so the compiler
+// removes it entirely.
+class NullProfiler
+{
+ public:
+  template <typename... Args>
+  explicit NullProfiler(Args&&...) {}
+};
+
+// ProfilerIf<compiled>::type is a Profiler if compiled is true and a
+// NullProfiler otherwise.
+template <bool compiled>
+struct ProfilerIf
+{
+  typedef Profiler type;
+};
+
+template <>
+struct ProfilerIf<false>
+{
+  typedef NullProfiler type;
+};
+
+// Calls Profiler::registerCompiledFilters() during static
+// initialization.
+struct CompiledFiltersRecorder
+{
+  CompiledFiltersRecorder(int level, uint32_t categories)
+  {
+    Profiler::registerCompiledFilters(level, categories);
+  }
+};
 }  // namespace swri_profiler
 
+#if defined(SWRI_PROFILER_FILTERED) && !defined(DISABLE_SWRI_PROFILER)
+namespace
+{
+const swri_profiler::CompiledFiltersRecorder swri_profiler_compiled_filters_(
+  SWRI_PROFILER_LEVEL, SWRI_PROFILER_CATEGORIES);
+}  // namespace
+#endif
+
 // Macros for string concatenation that work with built in macros.
 #define SWRI_PROFILER_CONCAT_DIRECT(s1,s2) s1##s2
 #define SWRI_PROFILER_CONCAT(s1, s2) SWRI_PROFILER_CONCAT_DIRECT(s1,s2)
 
-#define SWRI_PROFILER_IMP(block_var, name)             \
-  swri_profiler::Profiler block_var(name);             \
+// Evaluates to std::true_type if a label is spelled as a string
+// literal (after macro expansion) and std::false_type otherwise, so
+// that only literal labels are cached in their call site.  The
+// spelling is checked rather than the type because a char array
+// filled at runtime has the same type as a literal.
+#define SWRI_PROFILER_LITERAL(name)                               \
+  std::integral_constant<bool, (#name)[0] == '"'>()
+
+#define SWRI_PROFILER_IMP(block_var, name, sample_period)         \
+  static swri_profiler::Profiler::BlockSite                       \
+    SWRI_PROFILER_CONCAT(block_var, _site);                       \
+  swri_profiler::Profiler block_var(                              \
+    SWRI_PROFILER_CONCAT(block_var, _site), name, sample_period,  \
+    SWRI_PROFILER_LITERAL(name));                                 \
+
+#define SWRI_PROFILER_FILTERED_IMP(block_var, compiled, name)     \
+  static swri_profiler::Profiler::BlockSite                       \
+    SWRI_PROFILER_CONCAT(block_var, _site);                       \
+  swri_profiler::ProfilerIf<(compiled)>::type block_var(          \
+    SWRI_PROFILER_CONCAT(block_var, _site), name, 1,              \
+    SWRI_PROFILER_LITERAL(name));                                 \
+
+#define SWRI_PROFILER_METRIC_IMP(name, type, value)                     \
+  do {                                                                  \
+    static swri_profiler::Profiler::MetricSite swri_profiler_metric_site; \
+    swri_profiler::Profiler::recordMetric(                              \
+      swri_profiler_metric_site, name, type, value,                     \
+      SWRI_PROFILER_LITERAL(name));                                     \
+  } while (0)
 
 #ifndef DISABLE_SWRI_PROFILER
 #define SWRI_PROFILE(name) SWRI_PROFILER_IMP(      \
     SWRI_PROFILER_CONCAT(prof_block_, __LINE__),   \
-    name)
+    name, 1)
+// SWRI_PROFILE_SAMPLED only times one of every sample_period calls
+// to the block, for blocks that run so often that timing every call
+// would distort them.  Every call is still counted, and the reported
+// durations are scaled up to estimate the block's total time.
+#define SWRI_PROFILE_SAMPLED(name, sample_period) SWRI_PROFILER_IMP( \
+    SWRI_PROFILER_CONCAT(prof_block_, __LINE__),                     \
+    name, sample_period)
+// SWRI_PROFILE_L is only compiled if level (a constant from 0 to
+// 255, higher for finer-grained blocks) is at most
+// SWRI_PROFILER_LEVEL.  SWRI_PROFILE_CAT is only compiled if bit
+// category (a constant from 0 to 31) of SWRI_PROFILER_CATEGORIES is
+// set.  Blocks that are filtered out compile to nothing, but a label
+// that isn't a literal is still evaluated.
+#define SWRI_PROFILE_L(level, name) SWRI_PROFILER_FILTERED_IMP(  \
+    SWRI_PROFILER_CONCAT(prof_block_, __LINE__),                 \
+    (level) <= SWRI_PROFILER_LEVEL, name)
+#define SWRI_PROFILE_CAT(category, name)                         \
+  static_assert((category) >= 0 && (category) < 32,             \
+                "SWRI_PROFILE_CAT category must be from 0 to 31"); \
+  SWRI_PROFILER_FILTERED_IMP(                                    \
+    SWRI_PROFILER_CONCAT(prof_block_, __LINE__),                 \
+    ((SWRI_PROFILER_CATEGORIES >> (category)) & 1) != 0, name)
+// SWRI_PROFILE_COUNT adds delta to a counter and SWRI_PROFILE_GAUGE
+// records the current value of a gauge (see Profiler::MetricType).
+// Metrics are reported on their own topic rather than in the call
+// tree, so they can be used anywhere, inside or outside of profiled
+// blocks.
+#define SWRI_PROFILE_COUNT(name, delta) SWRI_PROFILER_METRIC_IMP(   \
+    name, swri_profiler::Profiler::METRIC_COUNTER, delta)
+#define SWRI_PROFILE_GAUGE(name, value) SWRI_PROFILER_METRIC_IMP(   \
+    name, swri_profiler::Profiler::METRIC_GAUGE, value)
 #else // ndef DISABLE_SWRI_PROFILER
 #define SWRI_PROFILE(name)
+#define SWRI_PROFILE_COUNT(name, delta)
+#define SWRI_PROFILE_GAUGE(name, value)
+#define SWRI_PROFILE_SAMPLED(name, sample_period)
+#define SWRI_PROFILE_L(level, name)
+#define SWRI_PROFILE_CAT(category, name)
 #endif // def DISABLE_SWRI_PROFILER
 
 #endif  // SWRI_PROFILER_PROFILER_H_
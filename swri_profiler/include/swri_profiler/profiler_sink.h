@@ -0,0 +1,136 @@
+#ifndef SWRI_PROFILER_PROFILER_SINK_H_
+#define SWRI_PROFILER_PROFILER_SINK_H_
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_msgs/ProfileMetricArray.h>
+
+namespace swri_profiler
+{
+// The types of reports.  Sinks that write serialized reports frame
+// each one with its type and size (see SerializedSink).
+enum ReportType
+{
+  REPORT_INDEX = 1,    // ProfileIndexArray
+  REPORT_DATA = 2,     // ProfileDataArray
+  REPORT_METRICS = 3,  // ProfileMetricArray
+};
+
+// A ProfilerSink receives the profiler's reports.  The publishing
+// thread collects a report from every profiled thread once per report
+// period and passes it to each sink, so sinks are only called from
+// that thread and never from profiled code.  A sink should not block
+// for long, since the next report waits for it.
+//
+// Sinks are added with Profiler::addSink() or selected at runtime
+// with the SWRI_PROFILER_SINK environment variable or the
+// ~swri_profiler/sink parameter (see createSink()).
+class ProfilerSink
+{
+ public:
+  virtual ~ProfilerSink() {}
+
+  virtual void publish(const swri_profiler_msgs::ProfileIndexArray &index) = 0;
+  virtual void publish(const swri_profiler_msgs::ProfileDataArray &data) = 0;
+  virtual void publish(const swri_profiler_msgs::ProfileMetricArray &metrics) = 0;
+};
+
+// A CallbackSink passes the reports to functions in the same
+// process, such as a test or a benchmark that checks what was
+// profiled.  Any of the callbacks may be empty.
+class CallbackSink : public ProfilerSink
+{
+ public:
+  typedef std::function<void(const swri_profiler_msgs::ProfileIndexArray&)> IndexCallback;
+  typedef std::function<void(const swri_profiler_msgs::ProfileDataArray&)> DataCallback;
+  typedef std::function<void(const swri_profiler_msgs::ProfileMetricArray&)> MetricsCallback;
+
+  CallbackSink(const IndexCallback &index_callback,
+               const DataCallback &data_callback,
+               const MetricsCallback &metrics_callback = MetricsCallback());
+
+  virtual void publish(const swri_profiler_msgs::ProfileIndexArray &index);
+  virtual void publish(const swri_profiler_msgs::ProfileDataArray &data);
+  virtual void publish(const swri_profiler_msgs::ProfileMetricArray &metrics);
+
+ private:
+  IndexCallback index_callback_;
+  DataCallback data_callback_;
+  MetricsCallback metrics_callback_;
+};
+
+// A SerializedSink writes each report as a serialized ROS message,
+// preceded by a frame header with the report's type and the
+// message's size in bytes (both uint32, in host byte order).
+// Subclasses provide the buffer that the report is serialized into.
+//
+// Index messages only include new blocks, so a reader that misses
+// one can't label those blocks.  The sink keeps the full index, and
+// if an index message is dropped (or a subclass calls
+// resendIndex()), the next report is preceded by the full index.
+class SerializedSink : public ProfilerSink
+{
+ public:
+  struct FrameHeader
+  {
+    uint32_t type;
+    uint32_t size;
+  };
+
+  SerializedSink();
+
+  virtual void publish(const swri_profiler_msgs::ProfileIndexArray &index);
+  virtual void publish(const swri_profiler_msgs::ProfileDataArray &data);
+  virtual void publish(const swri_profiler_msgs::ProfileMetricArray &metrics);
+
+ protected:
+  // Called before each report is written.
+  virtual void beginReport() {}
+  // Returns a buffer for a message of size bytes, or NULL to drop
+  // the report.  The message is serialized into the buffer and then
+  // passed on by commit(), which returns false if it was dropped
+  // after all.
+  virtual uint8_t* reserve(ReportType type, size_t size) = 0;
+  virtual bool commit() = 0;
+
+  // Writes the full index before the next report, e.g. for a reader
+  // that just connected.
+  void resendIndex();
+
+ private:
+  template <class M>
+  bool write(ReportType type, const M &msg);
+  // Writes the full index if one is pending.  Returns false if it
+  // was dropped again.
+  bool writePendingIndex();
+
+  swri_profiler_msgs::ProfileIndexArray full_index_;
+  bool full_index_pending_;
+};
+
+// Creates a sink from its runtime description:
+//
+//   ros          Publishes on the /profiler topics.  This is the
+//                default in ROS nodes.
+//   shm          Writes to a shared memory segment for the
+//                profiler_collector node.
+//   file:<path>  Appends serialized reports to a file.  Any "%p" in
+//                the path is replaced by the process id.
+//   record:<path>
+//                Writes a compact recording (see recording_format.h)
+//                that the profiler GUI can open.  "%p" is replaced
+//                as for file.
+//   unix:<path>  Sends serialized reports to a Unix domain stream
+//                socket that another process is listening on.
+//
+// Returns NULL if the description is invalid or the sink can't be
+// opened.  The ros sink can only be created after ros::init().
+std::shared_ptr<ProfilerSink> createSink(const std::string &description);
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_PROFILER_SINK_H_
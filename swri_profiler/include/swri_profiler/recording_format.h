@@ -0,0 +1,136 @@
+#ifndef SWRI_PROFILER_RECORDING_FORMAT_H_
+#define SWRI_PROFILER_RECORDING_FORMAT_H_
+
+#include <stdint.h>
+
+namespace swri_profiler
+{
+// The layout of profiler recordings (.sprec files), which store the
+// decoded profile data of every report in a compact, append-only
+// form.  They are written by RecordingWriter and read by the
+// profiler GUI in swri_profiler_tools.
+//
+// A recording starts with a RecordingFileHeader, followed by chunks.
+// Each chunk is a RecordingChunkHeader followed by size bytes of
+// payload, padded to a multiple of 8 bytes.  All values are in host
+// byte order.
+//
+// - A strings chunk adds strings (node names and block labels) to
+//   the string table.  Each string is written once, and strings are
+//   numbered consecutively from 0 in the order they are written.
+//   The payload is the number of strings (uint32), followed by each
+//   string as its length (uint32) and its bytes.
+//
+// - An interval chunk holds one report from one node: a
+//   RecordingInterval, followed by RECORDING_COLUMN_COUNT columns of
+//   count 8-byte values each (one row per block).  A column is
+//   contiguous, so a reader can scan one value of every block
+//   without touching the others.  Only the blocks in the report are
+//   included; see RecordingInterval::keyframe.
+//
+// - An index chunk is written when the recording is closed.  Its
+//   payload is a RecordingIndex, followed by the offsets (uint64) of
+//   the strings chunks and a RecordingIndexEntry for every interval
+//   chunk, in the order they were written.  It is followed by a
+//   RecordingTrailer at the very end of the file, so a reader can
+//   find everything without scanning the file.  A recording without
+//   an index (e.g. because the recorder was killed) is still valid,
+//   and readers scan its chunks instead.
+//
+// Recordings only hold the profile data.  Metrics (see
+// ProfileMetricArray.msg) are not persisted; the recorder doesn't
+// subscribe to them and the record sink discards them.
+static const char RECORDING_MAGIC[8] = {'S', 'W', 'R', 'I', 'R', 'E', 'C', '1'};
+static const char RECORDING_INDEX_MAGIC[8] = {'S', 'W', 'R', 'I', 'I', 'D', 'X', '1'};
+static const uint32_t RECORDING_VERSION = 1;
+
+struct RecordingFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+enum RecordingChunkType
+{
+  RECORDING_CHUNK_STRINGS = 1,
+  RECORDING_CHUNK_INTERVAL = 2,
+  RECORDING_CHUNK_INDEX = 3,
+};
+
+struct RecordingChunkHeader
+{
+  uint32_t type;
+  uint32_t size;
+};
+
+struct RecordingInterval
+{
+  // The end of the interval (the report's wall time and ROS time)
+  // and its length (the report period).
+  uint64_t wall_stamp_ns;
+  uint64_t ros_stamp_ns;
+  uint64_t period_ns;
+  // The string id of the node's name.
+  uint32_t node;
+  // The number of rows.
+  uint32_t count;
+  uint32_t compiled_categories;
+  uint8_t compiled_level;
+  // Keyframes include every block of the node.  Otherwise, blocks
+  // that are not included didn't run during the interval: their
+  // cumulative values are unchanged and their incremental values
+  // are zero.
+  uint8_t keyframe;
+  uint16_t reserved;
+};
+
+// The columns of an interval, in order.  Every column is a uint64,
+// except RECORDING_COLUMN_DURATION_ERROR, which is a double.
+// Durations are in nanoseconds, and the incremental values cover the
+// interval.
+enum RecordingColumn
+{
+  // The string id of the block's label.
+  RECORDING_COLUMN_LABEL = 0,
+  RECORDING_COLUMN_CUMULATIVE_CALL_COUNT,
+  RECORDING_COLUMN_CUMULATIVE_DURATION,
+  RECORDING_COLUMN_DURATION,
+  RECORDING_COLUMN_MAX_DURATION,
+  // Duration percentiles of the calls that finished during the
+  // interval, decoded from the report's histograms.
+  RECORDING_COLUMN_P50_DURATION,
+  RECORDING_COLUMN_P90_DURATION,
+  RECORDING_COLUMN_P99_DURATION,
+  RECORDING_COLUMN_P999_DURATION,
+  RECORDING_COLUMN_CPU_DURATION,
+  RECORDING_COLUMN_ALLOC_COUNT,
+  RECORDING_COLUMN_ALLOC_BYTES,
+  RECORDING_COLUMN_SAMPLE_PERIOD,
+  // The estimated relative standard error of the duration of a
+  // sampled block.
+  RECORDING_COLUMN_DURATION_ERROR,
+  RECORDING_COLUMN_COUNT
+};
+
+struct RecordingIndex
+{
+  uint32_t strings_count;
+  uint32_t reserved;
+  uint64_t interval_count;
+};
+
+struct RecordingIndexEntry
+{
+  uint64_t wall_stamp_ns;
+  uint64_t offset;
+};
+
+struct RecordingTrailer
+{
+  // The offset of the index chunk's header.
+  uint64_t index_offset;
+  char magic[8];
+};
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_RECORDING_FORMAT_H_
@@ -0,0 +1,66 @@
+#ifndef SWRI_PROFILER_RECORDING_WRITER_H_
+#define SWRI_PROFILER_RECORDING_WRITER_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <swri_profiler/recording_format.h>
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+
+namespace swri_profiler
+{
+// RecordingWriter writes profiler reports to a recording (see
+// recording_format.h).  It decodes each data report with the index
+// reports that preceded it, so the recording doesn't need the index
+// or the histograms, and it can record the reports of any number of
+// nodes.  Every chunk is flushed as it is written, so the recording
+// is readable up to the last report if the process is killed.
+class RecordingWriter
+{
+ public:
+  RecordingWriter();
+  ~RecordingWriter();
+
+  // Opens the recording, replacing any existing file.  Any "%p" in
+  // the filename is replaced by the process id.
+  bool open(const std::string &filename);
+  // Writes the index and closes the file.
+  void close();
+  bool isOpen() const { return file_ != NULL; }
+  const std::string& filename() const { return filename_; }
+
+  void addIndex(const swri_profiler_msgs::ProfileIndexArray &msg);
+  // Writes a data report.  Returns false if the report has blocks
+  // that are missing from the node's index, which are not recorded.
+  // The full index should be requested from the node.
+  bool addData(const swri_profiler_msgs::ProfileDataArray &msg);
+
+ private:
+  FILE *file_;
+  std::string filename_;
+  uint64_t offset_;
+
+  // The string table, and the strings that haven't been written yet.
+  std::unordered_map<std::string, uint32_t> string_ids_;
+  std::vector<std::string> new_strings_;
+
+  // The label string id of each block of each node, by key.
+  std::map<std::string, std::map<uint32_t, uint32_t> > labels_;
+
+  // Locations of the chunks for the index.
+  std::vector<uint64_t> strings_offsets_;
+  std::vector<RecordingIndexEntry> intervals_;
+
+  std::vector<uint64_t> columns_;
+
+  uint32_t stringId(const std::string &value);
+  void writeStrings();
+  void writeChunk(uint32_t type, const void *data, size_t size);
+};  // class RecordingWriter
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_RECORDING_WRITER_H_
@@ -0,0 +1,94 @@
+#ifndef SWRI_PROFILER_SHM_RING_H_
+#define SWRI_PROFILER_SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace swri_profiler
+{
+struct ShmRingHeader;
+
+// ShmRing is a single-producer/single-consumer ring of variable
+// length records in a POSIX shared memory segment.  A profiled
+// process creates its own segment and writes its reports to it, and
+// the per-host collector (the profiler_collector node) maps every
+// segment it finds, deserializes each record from the ring, and
+// republishes it before releasing the record.  Like the
+// TraceBuffer, neither side ever waits for the other: when the ring
+// is full, new records are dropped and counted.
+//
+// Each record has a nonzero type.  The profiler writes each report as
+// a serialized message with its ReportType.
+//
+// Segments are named /swri_profiler.<pid>.  A segment outlives its
+// process so that the collector can read the final reports, and the
+// collector unlinks it once the process has exited and the ring is
+// empty.
+class ShmRing
+{
+ public:
+  // A Record points into the mapped segment.  It remains valid until
+  // it is consumed.
+  struct Record
+  {
+    uint32_t type;
+    const uint8_t *data;
+    size_t size;
+  };
+
+  ShmRing();
+  ~ShmRing();
+
+  // Creates (or replaces) the calling process's segment with room for
+  // capacity bytes of records, and maps it for writing.
+  bool create(size_t capacity);
+  // Maps an existing segment for reading.
+  bool open(const std::string &name);
+  void close();
+  bool isOpen() const { return header_ != NULL; }
+  const std::string& name() const { return name_; }
+
+  // Reserves room for a record of size bytes and returns a pointer
+  // to it, or NULL if the ring is full (the record is counted as
+  // dropped).  The record is written in place and then published by
+  // commit().  Only the producer may call these.
+  uint8_t* reserve(size_t size);
+  void commit(uint32_t type);
+
+  // Returns the oldest unread record, if any.  It is released by
+  // consume().  Only the consumer may call these.
+  bool peek(Record &record);
+  void consume();
+
+  // The id of the process that created the segment.
+  int pid() const;
+
+  // Returns the number of records that were dropped since the last
+  // call.  Only the consumer may call this.
+  uint64_t takeDropped();
+
+  // Returns the names of every profiler segment on this host.
+  static std::vector<std::string> listSegments();
+  static void unlink(const std::string &name);
+
+ private:
+  std::string name_;
+  ShmRingHeader *header_;
+  uint8_t *records_;
+  size_t mapped_size_;
+  // The producer's reserved record: its position in the ring and
+  // the size of its data.
+  uint64_t pending_pos_;
+  uint64_t pending_size_;
+
+  bool map(int fd, size_t size);
+
+  // Not copyable.
+  ShmRing(const ShmRing&);
+  ShmRing& operator=(const ShmRing&);
+};  // class ShmRing
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_SHM_RING_H_
@@ -0,0 +1,95 @@
+#ifndef SWRI_PROFILER_TRACE_BUFFER_H_
+#define SWRI_PROFILER_TRACE_BUFFER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include <swri_profiler/clock.h>
+
+namespace swri_profiler
+{
+// A TraceEvent records a single call to a profiled block: the call
+// tree node and the times it was opened and closed.
+struct TraceEvent
+{
+  Ticks t0;
+  Ticks tf;
+  int node;
+};
+
+// TraceBuffer is a fixed size single-producer/single-consumer ring
+// of trace events.  The profiled thread that owns the buffer is the
+// only producer and the publishing thread is the only consumer, so
+// neither side ever waits for the other.  When the buffer is full,
+// new events are dropped and counted instead of blocking the
+// profiled thread.
+class TraceBuffer
+{
+ public:
+  // The capacity is rounded up to a power of two.
+  explicit TraceBuffer(size_t capacity)
+    :
+    head_(0),
+    tail_(0),
+    dropped_(0)
+  {
+    size_t size = 1;
+    while (size < capacity) { size <<= 1; }
+    events_.resize(size);
+    mask_ = size - 1;
+  }
+
+  bool push(int node, Ticks t0, Ticks tf)
+  {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > mask_) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    TraceEvent &event = events_[head & mask_];
+    event.t0 = t0;
+    event.tf = tf;
+    event.node = node;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Passes every available event to the handler and releases them.
+  // This must only be called by the consumer.
+  template <typename Handler>
+  size_t drain(Handler handler)
+  {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i != head; i++) {
+      handler(events_[i & mask_]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  // Returns the number of events dropped since the last call.
+  uint64_t takeDropped()
+  {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+ private:
+  std::vector<TraceEvent> events_;
+  uint64_t mask_;
+
+  // The producer and consumer indices are padded onto separate cache
+  // lines so the two threads don't bounce a line between them on
+  // every event.  (We pad instead of using alignas because buffers
+  // are heap allocated and we can't rely on over-aligned new.)
+  char pad0_[64];
+  std::atomic<uint64_t> head_;
+  char pad1_[64 - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> tail_;
+  char pad2_[64 - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> dropped_;
+};  // class TraceBuffer
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_TRACE_BUFFER_H_
@@ -0,0 +1,57 @@
+#ifndef SWRI_PROFILER_TRACE_WRITER_H_
+#define SWRI_PROFILER_TRACE_WRITER_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+
+namespace swri_profiler
+{
+// TraceWriter streams trace events to a file in the Chrome Trace
+// Event format (JSON array form), which can be loaded in
+// chrome://tracing or the Perfetto UI.  The array's closing bracket
+// is optional in this format, so the file remains valid if the
+// process is killed before the writer is closed.  For the same
+// reason, the writer does not close itself when it is destroyed; the
+// publishing thread may still be using it during static destruction,
+// and stdio flushes the file when the process exits.
+class TraceWriter
+{
+ public:
+  TraceWriter();
+
+  // Opens the trace file, replacing any existing file.  Any "%p" in
+  // the filename is replaced by the process id so that several
+  // processes can share the same setting.
+  bool open(const std::string &filename);
+  // Closes the file.  The process name is shown as the label for the
+  // process's events in the trace viewer.
+  void close(const std::string &process_name);
+  bool isOpen() const { return file_ != NULL; }
+  const std::string& filename() const { return filename_; }
+
+  void writeThreadName(int tid, const std::string &name);
+
+  // Writes a complete event.  Times are in nanoseconds since the
+  // epoch.
+  void writeEvent(const std::string &name,
+                  const std::string &path,
+                  int tid,
+                  int64_t start_ns,
+                  int64_t duration_ns);
+
+  // Writes an instant event noting that events were lost because a
+  // thread's trace buffer was full.
+  void writeDropped(int tid, int64_t stamp_ns, uint64_t count);
+
+  void flush();
+
+ private:
+  FILE *file_;
+  std::string filename_;
+  int pid_;
+
+  void writeString(const std::string &value);
+};  // class TraceWriter
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_TRACE_WRITER_H_
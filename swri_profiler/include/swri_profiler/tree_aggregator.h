@@ -0,0 +1,83 @@
+#ifndef SWRI_PROFILER_TREE_AGGREGATOR_H_
+#define SWRI_PROFILER_TREE_AGGREGATOR_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_msgs/ProfileTree.h>
+#include <swri_profiler_msgs/ProfileTreeData.h>
+
+namespace swri_profiler
+{
+// TreeAggregator merges the reports of any number of profiled nodes
+// into a single call tree, and derives the exclusive time of each
+// node of the tree.  It is what the profiler_aggregator node
+// publishes, without the ROS plumbing.
+class TreeAggregator
+{
+ public:
+  TreeAggregator();
+
+  void addIndex(const swri_profiler_msgs::ProfileIndexArray &msg);
+
+  // Adds a data report to the totals of the current interval.
+  // Returns false if the report has blocks that are missing from the
+  // node's index, or the node's index has a gap, in which case the
+  // full index should be requested from the node.  The blocks that
+  // couldn't be merged are lost.
+  bool addData(const swri_profiler_msgs::ProfileDataArray &msg);
+
+  // Returns true and fills in tree with a new revision of the tree if
+  // it has grown since the last call.
+  bool takeTree(swri_profiler_msgs::ProfileTree &tree);
+
+  // Fills in the totals of the current interval (every tree node that
+  // ran, including the ones that aren't blocks) and starts a new
+  // interval.  Returns false if nothing ran.  The caller fills in the
+  // header, stamps and period.
+  bool takeData(swri_profiler_msgs::ProfileTreeData &msg);
+
+  const swri_profiler_msgs::ProfileTree& tree() const { return tree_; }
+
+ private:
+  // A node of the merged tree.  measured is set if the node is a
+  // profiled block of some node.  The rest are the totals of the
+  // current interval.
+  struct TreeNode
+  {
+    int parent;
+    bool measured;
+    uint64_t call_count;
+    uint64_t inclusive_ns;
+    uint64_t max_ns;
+  };
+
+  // The tree.  Parents always come before their children.
+  swri_profiler_msgs::ProfileTree tree_;
+  std::vector<TreeNode> nodes_;
+  std::unordered_map<std::string, int> node_ids_;
+  bool tree_changed_;
+
+  // What we know about each profiled node: the tree node of each of
+  // its blocks and each block's most recent call count, by key.
+  struct Source
+  {
+    uint32_t index_sequence;
+    bool incomplete_index;
+    std::map<uint32_t, int> tree_nodes;
+    std::map<uint32_t, uint64_t> call_counts;
+    Source() : index_sequence(0), incomplete_index(true) {}
+  };
+  std::map<std::string, Source> sources_;
+
+  // Returns the tree node with the given path, adding it and its
+  // ancestors if necessary.
+  int touchNode(const std::string &path);
+};  // class TreeAggregator
+}  // namespace swri_profiler
+#endif  // SWRI_PROFILER_TREE_AGGREGATOR_H_
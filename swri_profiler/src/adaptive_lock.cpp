@@ -0,0 +1,116 @@
+#include <swri_profiler/adaptive_lock.h>
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace swri_profiler
+{
+// The wait statistics of every lock.  These are constant initialized
+// because locks can be used during static initialization.
+static std::atomic<uint64_t> waits_(0);
+static std::atomic<uint64_t> sleeps_(0);
+static std::atomic<int64_t> wait_ns_(0);
+static std::atomic<int64_t> max_wait_ns_(0);
+static std::atomic<bool> ignore_thread_set_(false);
+static std::atomic<pthread_t> ignore_thread_;
+
+// The number of backoff rounds before we sleep.  Each round pauses
+// twice as long as the previous one, for 255 pauses in total (a few
+// microseconds on most CPUs).
+static const int SPIN_ROUNDS = 8;
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+static int64_t monotonicNSec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+static long futex(std::atomic<int> *address, int op, int value)
+{
+  return syscall(SYS_futex, reinterpret_cast<int*>(address), op, value, NULL, NULL, 0);
+}
+
+void AdaptiveLock::acquireContended()
+{
+  const int64_t t0 = monotonicNSec();
+  bool slept = false;
+
+  int spins = 1;
+  bool acquired = false;
+  for (int round = 0; round < SPIN_ROUNDS && !acquired; round++) {
+    for (int i = 0; i < spins; i++) {
+      cpuRelax();
+    }
+    spins *= 2;
+
+    int expected = 0;
+    acquired = state_.load(std::memory_order_relaxed) == 0 &&
+      state_.compare_exchange_strong(expected, 1,
+                                     std::memory_order_acquire,
+                                     std::memory_order_relaxed);
+  }
+
+  // Mark the lock as having a sleeper so that the holder wakes us
+  // when it releases it.  Since we can't tell if other threads are
+  // still sleeping, we keep the mark when we get the lock.
+  if (!acquired) {
+    while (state_.exchange(2, std::memory_order_acquire) != 0) {
+      slept = true;
+      futex(&state_, FUTEX_WAIT_PRIVATE, 2);
+    }
+  }
+
+  if (ignore_thread_set_.load(std::memory_order_relaxed) &&
+      pthread_equal(ignore_thread_.load(std::memory_order_relaxed), pthread_self())) {
+    return;
+  }
+
+  const int64_t wait = monotonicNSec() - t0;
+  waits_.fetch_add(1, std::memory_order_relaxed);
+  if (slept) {
+    sleeps_.fetch_add(1, std::memory_order_relaxed);
+  }
+  wait_ns_.fetch_add(wait, std::memory_order_relaxed);
+  int64_t max_wait = max_wait_ns_.load(std::memory_order_relaxed);
+  while (wait > max_wait &&
+         !max_wait_ns_.compare_exchange_weak(max_wait, wait, std::memory_order_relaxed)) { ; }
+}
+
+void AdaptiveLock::wake()
+{
+  futex(&state_, FUTEX_WAKE_PRIVATE, 1);
+}
+
+LockWaitStats AdaptiveLock::takeWaitStats()
+{
+  LockWaitStats stats;
+  stats.waits = waits_.exchange(0, std::memory_order_relaxed);
+  stats.sleeps = sleeps_.exchange(0, std::memory_order_relaxed);
+  stats.wait_ns = wait_ns_.exchange(0, std::memory_order_relaxed);
+  stats.max_wait_ns = max_wait_ns_.exchange(0, std::memory_order_relaxed);
+  return stats;
+}
+
+void AdaptiveLock::ignoreWaitsOfThisThread()
+{
+  ignore_thread_.store(pthread_self(), std::memory_order_relaxed);
+  ignore_thread_set_.store(true, std::memory_order_relaxed);
+}
+}  // namespace swri_profiler
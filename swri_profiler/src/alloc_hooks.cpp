@@ -0,0 +1,115 @@
+// The swri_profiler_alloc library counts heap allocations for the
+// profiler.  It replaces the C allocation functions with versions
+// that count the allocation and then call glibc's implementation.
+// operator new allocates with malloc, so C++ allocations are counted
+// too.  Either link the library into a node or load it with
+// LD_PRELOAD=libswri_profiler_alloc.so.
+//
+// The library is a thin interposer: it doesn't link against
+// swri_profiler (or ROS), and it only counts allocations if the
+// process has loaded swri_profiler, which defines the hooks (see
+// alloc_tracker.h).  Otherwise it just forwards to glibc.
+//
+// malloc, calloc, realloc, memalign, aligned_alloc, posix_memalign,
+// valloc and pvalloc are replaced.  free is not replaced because the
+// profiler only reports allocations.
+#include <errno.h>
+#include <stddef.h>
+
+#include <swri_profiler/alloc_tracker.h>
+
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void* __libc_valloc(size_t size);
+void* __libc_pvalloc(size_t size);
+
+void swri_profiler_enable_alloc_tracking() __attribute__((weak));
+void swri_profiler_record_alloc(size_t bytes) __attribute__((weak));
+}
+
+namespace
+{
+struct AllocTrackingEnabler
+{
+  AllocTrackingEnabler()
+  {
+    if (swri_profiler_enable_alloc_tracking) {
+      swri_profiler_enable_alloc_tracking();
+    }
+  }
+};
+const AllocTrackingEnabler alloc_tracking_enabler_;
+
+inline void recordAlloc(size_t bytes)
+{
+  if (swri_profiler_record_alloc) {
+    swri_profiler_record_alloc(bytes);
+  }
+}
+}  // namespace
+
+extern "C"
+{
+void* malloc(size_t size)
+{
+  recordAlloc(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+  recordAlloc(count * size);
+  return __libc_calloc(count, size);
+}
+
+// Growing a buffer with realloc is the allocation churn we're looking
+// for, so it counts as an allocation of the new size.
+void* realloc(void *ptr, size_t size)
+{
+  recordAlloc(size);
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+  recordAlloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+  recordAlloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+
+  recordAlloc(size);
+  void *result = __libc_memalign(alignment, size);
+  if (!result && size != 0) {
+    return ENOMEM;
+  }
+  *ptr = result;
+  return 0;
+}
+
+void* valloc(size_t size)
+{
+  recordAlloc(size);
+  return __libc_valloc(size);
+}
+
+void* pvalloc(size_t size)
+{
+  recordAlloc(size);
+  return __libc_pvalloc(size);
+}
+}  // extern "C"
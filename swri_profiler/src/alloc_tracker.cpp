@@ -0,0 +1,25 @@
+#include <swri_profiler/alloc_tracker.h>
+
+namespace swri_profiler
+{
+__thread AllocCounters thread_alloc_counters_ __attribute__((tls_model("initial-exec"))) = { 0, 0 };
+bool alloc_tracking_enabled_ = false;
+
+void enableAllocTracking()
+{
+  alloc_tracking_enabled_ = true;
+}
+}  // namespace swri_profiler
+
+extern "C"
+{
+void swri_profiler_enable_alloc_tracking()
+{
+  swri_profiler::enableAllocTracking();
+}
+
+void swri_profiler_record_alloc(size_t bytes)
+{
+  swri_profiler::recordAlloc(bytes);
+}
+}  // extern "C"
@@ -0,0 +1,278 @@
+// swri_profiler_bench measures the cost of profiling a block (one
+// open/close pair) in nanoseconds.  It runs without a ROS master by
+// putting the profiler in offline mode, and writes its results as CSV
+// so that the results from different builds can be compared.
+//
+// Each dimension (threads, stack depth, number of distinct blocks,
+// label length, and label kind) is swept from a baseline of one
+// thread, depth 1, one block, and a 16 character literal label.
+// Every configuration is run with and without the publishing thread
+// collecting concurrently.  The baseline is also run with profiling
+// disabled at runtime.  The depth sweep uses one block per level, so
+// that it measures nesting rather than recursion.
+//
+// Usage: swri_profiler_bench [--max-threads N] [--pairs N] [--output FILE]
+#include <swri_profiler/profiler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+const size_t MAX_LABEL_LENGTH = 256;
+
+// Labels for the literal case are stored in fixed size arrays so
+// that they bind to the same constructor that SWRI_PROFILE uses for
+// string literals.  Like literals, they never change once their site
+// has cached them.
+struct Label
+{
+  char text[MAX_LABEL_LENGTH+1];
+};
+
+enum LabelKind
+{
+  LABEL_LITERAL,
+  LABEL_STRING
+};
+
+struct Config
+{
+  int threads;
+  int depth;
+  int blocks;
+  LabelKind label_kind;
+  size_t label_length;
+  bool collector;
+  bool enabled;
+};
+
+struct Result
+{
+  double ns_per_pair;
+  double min_thread_ns;
+  double max_thread_ns;
+};
+
+// The blocks profiled by one configuration.  Every configuration
+// gets fresh sites so that the literal case pays for registering its
+// labels once, just like a real call site.  There are at least as
+// many blocks as levels, so that every level of a nested run has its
+// own site and label.
+struct Blocks
+{
+  std::unique_ptr<swri_profiler::Profiler::BlockSite[]> sites;
+  std::vector<Label> literal_labels;
+  std::vector<std::string> string_labels;
+  LabelKind kind;
+  int count;
+
+  Blocks(const Config &config)
+    :
+    sites(new swri_profiler::Profiler::BlockSite[std::max(config.blocks, config.depth)]()),
+    literal_labels(std::max(config.blocks, config.depth)),
+    string_labels(std::max(config.blocks, config.depth)),
+    kind(config.label_kind),
+    count(std::max(config.blocks, config.depth))
+  {
+    for (int i = 0; i < count; i++) {
+      std::string label = "block_" + std::to_string(i) + "_";
+      label.resize(std::max(config.label_length, label.size()), 'x');
+      label.resize(std::min(label.size(), MAX_LABEL_LENGTH));
+      string_labels[i] = label;
+      std::memset(literal_labels[i].text, 0, sizeof(literal_labels[i].text));
+      std::memcpy(literal_labels[i].text, label.data(), label.size());
+    }
+  }
+};
+
+// Opens nested blocks down to the requested depth.  A single level
+// cycles through the blocks.  Nested levels always use the same path,
+// with a different block at each level.
+void profileNested(Blocks &blocks, int index, int level, int depth)
+{
+  const int block = depth > 1 ? level : index % blocks.count;
+  if (blocks.kind == LABEL_LITERAL) {
+    swri_profiler::Profiler profiler(blocks.sites[block],
+                                     blocks.literal_labels[block].text,
+                                     1, std::true_type());
+    if (level + 1 < depth) {
+      profileNested(blocks, index, level + 1, depth);
+    }
+  } else {
+    swri_profiler::Profiler profiler(blocks.sites[block],
+                                     blocks.string_labels[block],
+                                     1, std::false_type());
+    if (level + 1 < depth) {
+      profileNested(blocks, index, level + 1, depth);
+    }
+  }
+}
+
+Result runConfig(const Config &config, size_t pairs)
+{
+  Blocks blocks(config);
+  const size_t iterations = std::max<size_t>(1, pairs / config.depth);
+
+  swri_profiler::Profiler::setEnabled(config.enabled);
+  if (config.collector) {
+    swri_profiler::Profiler::startCollector();
+  }
+
+  // The threads wait for each other before they start timing so
+  // that they contend with each other for the whole run.
+  std::atomic<int> ready(0);
+  std::vector<double> thread_ns(config.threads, 0.0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < config.threads; t++) {
+    threads.emplace_back([&, t]() {
+        // Warm up the thread's local storage and call tree cache.
+        for (size_t i = 0; i < iterations / 10 + 1; i++) {
+          profileNested(blocks, i, 0, config.depth);
+        }
+
+        ready++;
+        while (ready < config.threads) { ; }
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+          profileNested(blocks, i, 0, config.depth);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        const double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+        thread_ns[t] = ns / (iterations * config.depth);
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (config.collector) {
+    swri_profiler::Profiler::stopCollector();
+  }
+  swri_profiler::Profiler::setEnabled(true);
+
+  Result result;
+  result.ns_per_pair = 0.0;
+  for (double ns : thread_ns) {
+    result.ns_per_pair += ns / thread_ns.size();
+  }
+  result.min_thread_ns = *std::min_element(thread_ns.begin(), thread_ns.end());
+  result.max_thread_ns = *std::max_element(thread_ns.begin(), thread_ns.end());
+  return result;
+}
+
+void usage()
+{
+  std::fprintf(stderr,
+               "usage: swri_profiler_bench [--max-threads N] [--pairs N] [--output FILE]\n");
+}
+}  // namespace
+
+int main(int argc, char **argv)
+{
+  int max_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t pairs = 1000000;
+  std::string output;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg == "--max-threads" && i + 1 < argc) {
+      max_threads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--pairs" && i + 1 < argc) {
+      pairs = std::max(1L, std::atol(argv[++i]));
+    } else if (arg == "--output" && i + 1 < argc) {
+      output = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  FILE *out = stdout;
+  if (!output.empty()) {
+    out = std::fopen(output.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "Failed to open '%s'.\n", output.c_str());
+      return 1;
+    }
+  }
+
+  // roscpp writes info messages to stdout, which would get mixed in
+  // with the results.
+  if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME,
+                                     ros::console::levels::Warn)) {
+    ros::console::notifyLoggerLevelsChanged();
+  }
+
+  // Collect often so that the publishing thread has a chance to
+  // interfere, unless the caller asked for something else.
+  setenv("SWRI_PROFILER_PERIOD", "0.01", 0);
+  swri_profiler::Profiler::initializeOffline();
+
+  const Config baseline = { 1, 1, 1, LABEL_LITERAL, 16, false, true };
+  std::vector<Config> configs;
+  configs.push_back(baseline);
+  configs.back().enabled = false;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    configs.push_back(baseline);
+    configs.back().threads = threads;
+  }
+  configs.push_back(baseline);
+  configs.back().threads = max_threads;
+  for (int depth : { 10, 100 }) {
+    configs.push_back(baseline);
+    configs.back().depth = depth;
+    configs.back().blocks = depth;
+  }
+  for (int blocks : { 16, 256 }) {
+    configs.push_back(baseline);
+    configs.back().blocks = blocks;
+  }
+  for (LabelKind kind : { LABEL_LITERAL, LABEL_STRING }) {
+    for (size_t length : { 8, 64, 256 }) {
+      configs.push_back(baseline);
+      configs.back().label_kind = kind;
+      configs.back().label_length = length;
+    }
+  }
+
+  std::fprintf(out, "clock,threads,depth,blocks,label_kind,label_length,collector,"
+               "enabled,pairs,ns_per_pair,min_thread_ns,max_thread_ns\n");
+  for (const Config &base : configs) {
+    for (bool collector : { false, true }) {
+      Config config = base;
+      config.collector = collector;
+      const Result result = runConfig(config, pairs);
+      std::fprintf(out, "%s,%d,%d,%d,%s,%zu,%d,%d,%zu,%.2f,%.2f,%.2f\n",
+                   swri_profiler::Clock::sourceName(),
+                   config.threads,
+                   config.depth,
+                   config.blocks,
+                   config.label_kind == LABEL_LITERAL ? "literal" : "string",
+                   config.label_length,
+                   config.collector ? 1 : 0,
+                   config.enabled ? 1 : 0,
+                   pairs,
+                   result.ns_per_pair,
+                   result.min_thread_ns,
+                   result.max_thread_ns);
+      std::fflush(out);
+    }
+  }
+
+  if (out != stdout) {
+    std::fclose(out);
+  }
+  return 0;
+}
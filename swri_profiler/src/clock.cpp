@@ -0,0 +1,141 @@
+#include <swri_profiler/clock.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include <ros/console.h>
+
+namespace swri_profiler
+{
+Clock::Source Clock::source_ = Clock::SOURCE_MONOTONIC_RAW;
+double Clock::ns_per_tick_ = 1.0;
+
+// The reference point for calibrating the counter.  These are only
+// used by initialize() and calibrate().
+static Ticks reference_ticks_ = 0;
+static int64_t reference_ns_ = 0;
+
+static int64_t monotonicNSec()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+// Samples the counter and CLOCK_MONOTONIC at (nearly) the same
+// instant.  We take a few samples and keep the one where the two
+// counter reads are closest together to minimize the error from
+// being interrupted.
+template <typename ReadCounter>
+static void sampleCounter(ReadCounter read_counter, Ticks &ticks, int64_t &ns)
+{
+  Ticks best_gap = -1;
+  for (int i = 0; i < 5; i++) {
+    Ticks t0 = read_counter();
+    int64_t mono = monotonicNSec();
+    Ticks t1 = read_counter();
+
+    if (best_gap < 0 || t1 - t0 < best_gap) {
+      best_gap = t1 - t0;
+      ticks = t0 + (t1 - t0) / 2;
+      ns = mono;
+    }
+  }
+}
+
+bool Clock::counterIsReliable()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  // CPUID 0x80000007 EDX bit 8 indicates an invariant TSC that runs
+  // at a constant rate across P-, C-, and T-states.
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1 << 8))) {
+    return false;
+  }
+
+  // The kernel switches away from the TSC if it detects that it is
+  // unstable (e.g. it is not synchronized across sockets), so we
+  // follow its lead when that information is available.
+  std::ifstream clocksource(
+    "/sys/devices/system/clocksource/clocksource0/current_clocksource");
+  std::string name;
+  if (clocksource >> name) {
+    return name == "tsc";
+  }
+  return true;
+#elif defined(__aarch64__)
+  // The generic timer's virtual counter runs at a fixed frequency by
+  // design.
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Clock::initialize()
+{
+  const char *env = std::getenv("SWRI_PROFILER_CLOCK");
+  if (env && std::strcmp(env, "wall") == 0) {
+    source_ = SOURCE_WALL;
+  } else if (env && std::strcmp(env, "monotonic_raw") == 0) {
+    source_ = SOURCE_MONOTONIC_RAW;
+  } else if (env && std::strcmp(env, "tsc") == 0) {
+    if (!counterIsReliable()) {
+      ROS_WARN("swri_profiler: TSC clock requested even though it "
+               "does not appear to be reliable.");
+    }
+    source_ = SOURCE_TSC;
+  } else {
+    if (env && std::strlen(env) > 0) {
+      ROS_WARN("swri_profiler: Unknown clock '%s'. Using default.", env);
+    }
+    source_ = counterIsReliable() ? SOURCE_TSC : SOURCE_MONOTONIC_RAW;
+  }
+
+  ns_per_tick_ = 1.0;
+  if (source_ == SOURCE_TSC) {
+    sampleCounter(readCounter, reference_ticks_, reference_ns_);
+  }
+
+  ROS_INFO("swri_profiler using %s clock.", sourceName());
+}
+
+void Clock::calibrate()
+{
+  if (source_ != SOURCE_TSC) {
+    return;
+  }
+
+  Ticks ticks;
+  int64_t ns;
+  sampleCounter(readCounter, ticks, ns);
+
+  // Wait until we have a reasonable baseline so that the sampling
+  // error doesn't dominate the estimate.
+  if (ns - reference_ns_ < 1000000 || ticks <= reference_ticks_) {
+    return;
+  }
+
+  ns_per_tick_ = static_cast<double>(ns - reference_ns_) /
+    static_cast<double>(ticks - reference_ticks_);
+}
+
+const char* Clock::sourceName()
+{
+  switch (source_) {
+  case SOURCE_TSC:
+    return "tsc";
+  case SOURCE_WALL:
+    return "wall";
+  default:
+    return "monotonic_raw";
+  }
+}
+}  // namespace swri_profiler
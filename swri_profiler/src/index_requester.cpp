@@ -0,0 +1,131 @@
+#include <swri_profiler/index_requester.h>
+
+#include <boost/make_shared.hpp>
+
+#include <ros/callback_queue.h>
+#include <ros/ros.h>
+#include <swri_profiler_msgs/GetProfileIndex.h>
+
+namespace spm = swri_profiler_msgs;
+
+namespace swri_profiler
+{
+namespace
+{
+// Passes an index to the requester's callback from the callback
+// queue.
+class IndexCallback : public ros::CallbackInterface
+{
+ public:
+  IndexCallback(const IndexRequester::Callback &callback,
+                const spm::ProfileIndexArray &index)
+    :
+    callback_(callback),
+    index_(index)
+  {
+  }
+
+  virtual CallResult call()
+  {
+    callback_(index_);
+    return Success;
+  }
+
+ private:
+  IndexRequester::Callback callback_;
+  spm::ProfileIndexArray index_;
+};
+}  // namespace
+
+IndexRequester::IndexRequester(const Callback &callback,
+                               ros::CallbackQueueInterface *queue)
+  :
+  callback_(callback),
+  queue_(queue ? queue : ros::getGlobalCallbackQueue()),
+  stop_(false)
+{
+  thread_ = boost::thread(&IndexRequester::run, this);
+}
+
+IndexRequester::~IndexRequester()
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_one();
+  thread_.join();
+
+  // Answers that haven't been handled yet refer to our callback.
+  queue_->removeByID(reinterpret_cast<uint64_t>(this));
+}
+
+void IndexRequester::request(const std::string &node_name)
+{
+  const ros::WallTime now = ros::WallTime::now();
+  auto const it = last_request_.find(node_name);
+  if (it != last_request_.end() && now - it->second < ros::WallDuration(5.0)) {
+    return;
+  }
+  last_request_[node_name] = now;
+
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    pending_.push_back(node_name);
+  }
+  condition_.notify_one();
+}
+
+void IndexRequester::run()
+{
+  while (true) {
+    std::string node_name;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!stop_ && pending_.empty()) {
+        condition_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      node_name = pending_.front();
+      pending_.pop_front();
+    }
+
+    spm::ProfileIndexArray index;
+    if (!call(node_name, index)) {
+      ROS_WARN("Failed to get the index for node '%s'.", node_name.c_str());
+      continue;
+    }
+
+    queue_->addCallback(boost::make_shared<IndexCallback>(callback_, index),
+                        reinterpret_cast<uint64_t>(this));
+  }
+}
+
+bool IndexRequester::call(const std::string &node_name, spm::ProfileIndexArray &index)
+{
+  // Persistent connections become invalid when the node goes away,
+  // so they are reopened as needed.
+  ros::ServiceClient &client = clients_[node_name];
+  if (!client.isValid()) {
+    ros::NodeHandle nh;
+    client = nh.serviceClient<spm::GetProfileIndex>(
+      node_name + "/swri_profiler/get_index", true);
+  }
+
+  // Don't wait for a node that doesn't have the service.
+  if (!client.waitForExistence(ros::Duration(0))) {
+    clients_.erase(node_name);
+    return false;
+  }
+
+  spm::GetProfileIndex srv;
+  if (!client.call(srv)) {
+    clients_.erase(node_name);
+    return false;
+  }
+  index = srv.response.index;
+  return true;
+}
+}  // namespace swri_profiler
@@ -0,0 +1,101 @@
+// The profiler_aggregator node merges the reports of every profiled
+// node into a single system-wide call tree, so that viewers (and
+// remote links) don't each have to subscribe to every node's reports
+// and merge them.  It publishes the tree on /profiler/tree (latched,
+// and only when it grows) and the tree's data, including the derived
+// exclusive times, on /profiler/tree_data once per
+// ~publish_period.  A publish period longer than the nodes' report
+// period downsamples the data.  See TreeAggregator.
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <ros/ros.h>
+#include <swri_profiler/index_requester.h>
+#include <swri_profiler/tree_aggregator.h>
+
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_msgs/ProfileTree.h>
+#include <swri_profiler_msgs/ProfileTreeData.h>
+
+namespace spm = swri_profiler_msgs;
+
+class ProfilerAggregator
+{
+  ros::NodeHandle nh_;
+
+  ros::Subscriber index_sub_;
+  ros::Subscriber data_sub_;
+  ros::Publisher tree_pub_;
+  ros::Publisher data_pub_;
+  ros::WallTimer publish_timer_;
+  ros::WallDuration publish_period_;
+
+  swri_profiler::TreeAggregator aggregator_;
+  swri_profiler::IndexRequester index_requester_;
+
+ public:
+  ProfilerAggregator()
+    :
+    index_requester_(boost::bind(&ProfilerAggregator::handleIndex, this, _1))
+  {
+    ros::NodeHandle pnh("~");
+    double publish_period = 1.0;
+    pnh.param("publish_period", publish_period, publish_period);
+    publish_period_ = ros::WallDuration(std::max(0.01, publish_period));
+
+    tree_pub_ = nh_.advertise<spm::ProfileTree>("/profiler/tree", 1, true);
+    data_pub_ = nh_.advertise<spm::ProfileTreeData>("/profiler/tree_data", 100, false);
+    index_sub_ = nh_.subscribe("/profiler/index", 1000, &ProfilerAggregator::handleIndex, this);
+    data_sub_ = nh_.subscribe("/profiler/data", 1000, &ProfilerAggregator::handleData, this);
+    publish_timer_ = nh_.createWallTimer(publish_period_,
+                                         &ProfilerAggregator::handlePublishTimer,
+                                         this);
+  }
+
+  void handleIndex(const spm::ProfileIndexArray &msg)
+  {
+    aggregator_.addIndex(msg);
+  }
+
+  void handleData(const spm::ProfileDataArray &msg)
+  {
+    // Index messages only contain new blocks, so if we joined late
+    // or missed one, we need to ask the node for its full index.
+    if (!aggregator_.addData(msg)) {
+      index_requester_.request(msg.header.frame_id);
+    }
+  }
+
+  void handlePublishTimer(const ros::WallTimerEvent &)
+  {
+    const ros::WallTime now = ros::WallTime::now();
+
+    spm::ProfileTree tree;
+    if (aggregator_.takeTree(tree)) {
+      tree.header.stamp = ros::Time(now.sec, now.nsec);
+      tree_pub_.publish(tree);
+    }
+
+    spm::ProfileTreeData msg;
+    if (!aggregator_.takeData(msg)) {
+      return;
+    }
+
+    msg.header.stamp = ros::Time(now.sec, now.nsec);
+    msg.rostime_stamp = ros::Time::now();
+    msg.period = ros::Duration(publish_period_.sec, publish_period_.nsec);
+    data_pub_.publish(msg);
+  }
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "profiler_aggregator");
+
+  ProfilerAggregator aggregator;
+  ros::spin();
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+// The profiler_collector node publishes the reports of every process
+// on this host that writes them to shared memory
+// (SWRI_PROFILER_SINK=shm), so that those processes don't need their
+// own publishers on the profiler topics.  It also answers get_index
+// requests for the processes that can't answer them themselves.
+#include <errno.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <boost/bind.hpp>
+
+#include <ros/ros.h>
+#include <ros/serialization.h>
+#include <swri_profiler/profiler_sink.h>
+#include <swri_profiler/shm_ring.h>
+
+#include <swri_profiler_msgs/GetProfileIndex.h>
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_msgs/ProfileMetricArray.h>
+
+namespace spm = swri_profiler_msgs;
+
+class ProfilerCollector
+{
+  ros::NodeHandle nh_;
+
+  ros::Publisher index_pub_;
+  ros::Publisher data_pub_;
+  ros::Publisher metrics_pub_;
+
+  ros::WallTimer poll_timer_;
+  ros::WallTimer scan_timer_;
+
+  // The segments we are reading, by name.
+  std::map<std::string, std::unique_ptr<swri_profiler::ShmRing> > rings_;
+
+  // The full index of every process we have read an index from, by
+  // the name it reports under.  Index messages only have new blocks
+  // and the latched index topic only keeps the last one, so
+  // subscribers that missed some request the full index from the
+  // process's get_index service.  Processes that don't use ROS don't
+  // have one, so we advertise it for them and answer from here.
+  struct Source
+  {
+    int pid;
+    uint32_t sequence;
+    std::map<uint32_t, std::string> labels;
+    ros::ServiceServer get_index;
+  };
+  std::map<std::string, Source> sources_;
+
+ public:
+  ProfilerCollector()
+  {
+    index_pub_ = nh_.advertise<spm::ProfileIndexArray>("/profiler/index", 100, true);
+    data_pub_ = nh_.advertise<spm::ProfileDataArray>("/profiler/data", 100, false);
+    metrics_pub_ = nh_.advertise<spm::ProfileMetricArray>("/profiler/metrics", 100, false);
+
+    // Processes write a report once per report period, which is at
+    // least 10ms, and their rings hold many reports, so polling
+    // often enough to keep up is cheap.
+    poll_timer_ = nh_.createWallTimer(ros::WallDuration(0.05),
+                                      &ProfilerCollector::handlePollTimer,
+                                      this);
+    scan_timer_ = nh_.createWallTimer(ros::WallDuration(1.0),
+                                      &ProfilerCollector::handleScanTimer,
+                                      this);
+    scan();
+  }
+
+  void handlePollTimer(const ros::WallTimerEvent &)
+  {
+    for (auto &item : rings_) {
+      poll(*item.second);
+    }
+  }
+
+  void handleScanTimer(const ros::WallTimerEvent &)
+  {
+    scan();
+  }
+
+  // Picks up new segments, and releases the segments of processes
+  // that have exited once their last reports have been published.
+  void scan()
+  {
+    for (auto const &name : swri_profiler::ShmRing::listSegments()) {
+      if (rings_.count(name)) {
+        continue;
+      }
+
+      // A segment that was just created may not be initialized yet,
+      // so we try again on the next scan.  Segments left behind by
+      // processes that exited before we started are stale.
+      std::unique_ptr<swri_profiler::ShmRing> ring(new swri_profiler::ShmRing());
+      if (!ring->open(name)) {
+        continue;
+      }
+      if (!processExists(ring->pid())) {
+        swri_profiler::ShmRing::unlink(name);
+      } else {
+        ROS_INFO("Collecting profiler data from process %d.", ring->pid());
+        rings_[name] = std::move(ring);
+      }
+    }
+
+    for (auto it = rings_.begin(); it != rings_.end(); ) {
+      swri_profiler::ShmRing &ring = *it->second;
+      if (processExists(ring.pid())) {
+        ++it;
+        continue;
+      }
+
+      poll(ring);
+      ROS_INFO("Process %d has exited.", ring.pid());
+      for (auto source = sources_.begin(); source != sources_.end(); ) {
+        if (source->second.pid == ring.pid()) {
+          source = sources_.erase(source);
+        } else {
+          ++source;
+        }
+      }
+      swri_profiler::ShmRing::unlink(ring.name());
+      it = rings_.erase(it);
+    }
+  }
+
+  static bool processExists(int pid)
+  {
+    return kill(pid, 0) == 0 || errno != ESRCH;
+  }
+
+  void poll(swri_profiler::ShmRing &ring)
+  {
+    swri_profiler::ShmRing::Record record;
+    while (ring.peek(record)) {
+      // The message is deserialized from the shared memory and
+      // republished, and then the record is released.
+      ros::serialization::IStream stream(const_cast<uint8_t*>(record.data), record.size);
+      try {
+        switch (record.type) {
+        case swri_profiler::REPORT_INDEX:
+        {
+          spm::ProfileIndexArray msg;
+          ros::serialization::deserialize(stream, msg);
+          cacheIndex(ring.pid(), msg);
+          index_pub_.publish(msg);
+          break;
+        }
+        case swri_profiler::REPORT_DATA:
+          publish<spm::ProfileDataArray>(data_pub_, stream);
+          break;
+        case swri_profiler::REPORT_METRICS:
+          publish<spm::ProfileMetricArray>(metrics_pub_, stream);
+          break;
+        default:
+          ROS_WARN_ONCE("Ignoring unknown profiler record type %u.", record.type);
+          break;
+        }
+      } catch (const ros::Exception &e) {
+        ROS_ERROR("Failed to decode profiler record from process %d: %s",
+                  ring.pid(), e.what());
+      }
+      ring.consume();
+    }
+
+    const uint64_t dropped = ring.takeDropped();
+    if (dropped) {
+      ROS_WARN("Process %d dropped %llu profiler reports because its "
+               "shared memory segment was full.",
+               ring.pid(), static_cast<unsigned long long>(dropped));
+    }
+  }
+
+  template <class M>
+  void publish(const ros::Publisher &pub, ros::serialization::IStream &stream)
+  {
+    M msg;
+    ros::serialization::deserialize(stream, msg);
+    pub.publish(msg);
+  }
+
+  // Merges an index message into the process's full index.  See
+  // ProfilerMsgAdapter::processIndex.
+  void cacheIndex(int pid, const spm::ProfileIndexArray &msg)
+  {
+    const std::string &name = msg.header.frame_id;
+    auto it = sources_.find(name);
+    if (it == sources_.end()) {
+      it = sources_.insert(std::make_pair(name, Source())).first;
+      it->second.sequence = 0;
+
+      // A process that uses ROS answers for itself.
+      const std::string service = name + "/swri_profiler/get_index";
+      if (!ros::service::exists(service, false)) {
+        it->second.get_index =
+          nh_.advertiseService<spm::GetProfileIndex::Request, spm::GetProfileIndex::Response>(
+            service, boost::bind(&ProfilerCollector::handleGetIndex, this, name, _1, _2));
+      }
+    }
+
+    Source &source = it->second;
+    source.pid = pid;
+    const bool full = msg.full || msg.sequence == 0;
+    if (full && (msg.sequence <= 1 || msg.sequence >= source.sequence)) {
+      source.labels.clear();
+      source.sequence = msg.sequence;
+    }
+    source.sequence = std::max(source.sequence, msg.sequence);
+    for (auto const &item : msg.data) {
+      source.labels[item.key] = item.label;
+    }
+  }
+
+  bool handleGetIndex(const std::string &name,
+                      spm::GetProfileIndex::Request &,
+                      spm::GetProfileIndex::Response &res)
+  {
+    auto const it = sources_.find(name);
+    if (it == sources_.end()) {
+      return false;
+    }
+
+    const Source &source = it->second;
+    res.index.header.stamp = ros::Time::now();
+    res.index.header.frame_id = name;
+    res.index.sequence = source.sequence;
+    res.index.full = true;
+    for (auto const &item : source.labels) {
+      res.index.data.emplace_back();
+      res.index.data.back().key = item.first;
+      res.index.data.back().label = item.second;
+    }
+    return true;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "profiler_collector");
+
+  ProfilerCollector collector;
+  ros::spin();
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+// The profiler_recorder node records the reports of every profiled
+// node to a recording (see recording_format.h), which is much smaller
+// than a bag of the profiler topics and can be opened in the profiler
+// GUI.
+//
+// Usage: profiler_recorder [filename]
+//
+// The default filename is swri_profiler_<date>.sprec in the current
+// directory.  The recording is completed when the node shuts down.
+#include <ctime>
+#include <string>
+
+#include <boost/bind.hpp>
+
+#include <ros/ros.h>
+#include <swri_profiler/index_requester.h>
+#include <swri_profiler/recording_writer.h>
+
+#include <swri_profiler_msgs/ProfileIndexArray.h>
+#include <swri_profiler_msgs/ProfileDataArray.h>
+
+namespace spm = swri_profiler_msgs;
+
+class ProfilerRecorder
+{
+  ros::NodeHandle nh_;
+
+  ros::Subscriber index_sub_;
+  ros::Subscriber data_sub_;
+
+  swri_profiler::RecordingWriter writer_;
+  swri_profiler::IndexRequester index_requester_;
+
+ public:
+  ProfilerRecorder()
+    :
+    index_requester_(boost::bind(&ProfilerRecorder::handleIndex, this, _1))
+  {
+  }
+
+  bool open(const std::string &filename)
+  {
+    if (!writer_.open(filename)) {
+      ROS_ERROR("Failed to open recording '%s'.", filename.c_str());
+      return false;
+    }
+    ROS_INFO("Recording profiler data to '%s'.", writer_.filename().c_str());
+
+    index_sub_ = nh_.subscribe("/profiler/index", 1000, &ProfilerRecorder::handleIndex, this);
+    data_sub_ = nh_.subscribe("/profiler/data", 1000, &ProfilerRecorder::handleData, this);
+    return true;
+  }
+
+  void close()
+  {
+    index_sub_.shutdown();
+    data_sub_.shutdown();
+    writer_.close();
+  }
+
+  void handleIndex(const spm::ProfileIndexArray &msg)
+  {
+    writer_.addIndex(msg);
+  }
+
+  void handleData(const spm::ProfileDataArray &msg)
+  {
+    // Index messages only contain new blocks, so if we joined late
+    // or missed one, we need to ask the node for its full index.
+    // The blocks we couldn't decode are lost.
+    if (!writer_.addData(msg)) {
+      index_requester_.request(msg.header.frame_id);
+    }
+  }
+};
+
+static std::string defaultFilename()
+{
+  char stamp[64];
+  const std::time_t now = std::time(NULL);
+  std::strftime(stamp, sizeof(stamp), "%Y-%m-%d-%H-%M-%S", std::localtime(&now));
+  return std::string("swri_profiler_") + stamp + ".sprec";
+}
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "profiler_recorder", ros::init_options::AnonymousName);
+
+  ProfilerRecorder recorder;
+  if (!recorder.open(argc > 1 ? argv[1] : defaultFilename())) {
+    return 1;
+  }
+  ros::spin();
+  recorder.close();
+
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include <swri_profiler/perf_counters.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace swri_profiler
+{
+static std::atomic<uint32_t> available_mask_(0);
+
+struct CounterEvent
+{
+  uint32_t type;
+  uint64_t config;
+};
+
+// The events behind each counter, in PerfCounterValues order.
+static const CounterEvent counter_events_[PerfCounterValues::COUNT] = {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+  { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+const char* PerfCounterValues::name(int counter)
+{
+  switch (counter) {
+  case INSTRUCTIONS:
+    return "instructions";
+  case CACHE_MISSES:
+    return "cache_misses";
+  case CONTEXT_SWITCHES:
+    return "context_switches";
+  case PAGE_FAULTS:
+    return "page_faults";
+  default:
+    return "unknown";
+  }
+}
+
+// Opens a counter for the calling thread on any CPU, as part of
+// group_fd's group (or as a new group leader if group_fd is -1).
+// Unprivileged processes usually may not count kernel events, so we
+// fall back to counting only user space.
+static int openEvent(const CounterEvent &event, int group_fd)
+{
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.read_format = PERF_FORMAT_GROUP |
+    PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_hv = 1;
+
+  int fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+  if (fd < 0) {
+    attr.exclude_kernel = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+  }
+  return fd;
+}
+
+PerfCounters::PerfCounters()
+  :
+  leader_fd_(-1),
+  open_count_(0),
+  mask_(0)
+{
+  for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+    fds_[i] = -1;
+    order_[i] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  close();
+}
+
+bool PerfCounters::open()
+{
+  close();
+
+  // A software event can join a group led by a hardware event, but
+  // not the other way around, so the hardware events go first.
+  for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+    const int fd = openEvent(counter_events_[i], leader_fd_);
+    if (fd < 0) {
+      continue;
+    }
+
+    if (leader_fd_ < 0) {
+      leader_fd_ = fd;
+    }
+    fds_[i] = fd;
+    order_[open_count_++] = i;
+    mask_ |= 1u << i;
+  }
+
+  available_mask_.fetch_or(mask_, std::memory_order_relaxed);
+  return isOpen();
+}
+
+void PerfCounters::close()
+{
+  for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+    if (fds_[i] >= 0) {
+      ::close(fds_[i]);
+    }
+    fds_[i] = -1;
+    order_[i] = -1;
+  }
+  leader_fd_ = -1;
+  open_count_ = 0;
+  mask_ = 0;
+}
+
+void PerfCounters::read(PerfCounterValues &values) const
+{
+  if (leader_fd_ < 0) {
+    return;
+  }
+
+  // The group read format is the number of counters, the time the
+  // group was enabled, and the time it was actually counting,
+  // followed by the counters' values.
+  uint64_t buffer[3 + PerfCounterValues::COUNT];
+  const ssize_t size = ::read(leader_fd_, buffer, sizeof(buffer));
+  if (size < static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+    return;
+  }
+
+  // When there are more hardware counters in use (by other threads
+  // or other perf users) than the PMU has, the kernel multiplexes
+  // them and the group only counts part of the time.  We scale the
+  // values up to estimate what they would have been.
+  const uint64_t enabled = buffer[1];
+  const uint64_t running = buffer[2];
+  const double scale = running > 0 && running < enabled ?
+    static_cast<double>(enabled) / running : 1.0;
+
+  const uint64_t count = std::min<uint64_t>(
+    std::min<uint64_t>(buffer[0], open_count_),
+    size / sizeof(uint64_t) - 3);
+  for (uint64_t i = 0; i < count; i++) {
+    values[order_[i]] = scale == 1.0 ? buffer[3 + i] :
+      static_cast<uint64_t>(buffer[3 + i] * scale);
+  }
+}
+
+uint32_t PerfCounters::availableMask()
+{
+  return available_mask_.load(std::memory_order_relaxed);
+}
+}  // namespace swri_profiler
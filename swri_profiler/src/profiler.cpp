@@ -1,40 +1,217 @@
 #include <ros/this_node.h>
 #include <swri_profiler/profiler.h>
-#include <ros/publisher.h>
+#include <ros/init.h>
+#include <ros/node_handle.h>
+#include <ros/service_server.h>
+#include <ros/callback_queue.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <set>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <boost/thread/thread.hpp>
+
+#include <swri_profiler/profiler_sink.h>
+#include <swri_profiler/trace_writer.h>
 
 #include <swri_profiler_msgs/ProfileIndex.h>
 #include <swri_profiler_msgs/ProfileIndexArray.h>
 #include <swri_profiler_msgs/ProfileData.h>
 #include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_msgs/ProfileHistogram.h>
+#include <swri_profiler_msgs/ProfileMetric.h>
+#include <swri_profiler_msgs/ProfileMetricArray.h>
+#include <swri_profiler_msgs/ProfileThread.h>
+#include <swri_profiler_msgs/GetProfileIndex.h>
+#include <swri_profiler_msgs/SetProfilerEnabled.h>
 
 namespace spm = swri_profiler_msgs;
 
 namespace swri_profiler
 {
 // Define/initialize static member variables for the Profiler class.
-std::unordered_map<std::string, Profiler::ClosedInfo> Profiler::closed_blocks_;
-std::unordered_map<std::string, Profiler::OpenInfo> Profiler::open_blocks_;
-boost::thread_specific_ptr<Profiler::TLS> Profiler::tls_;
-SpinLock Profiler::lock_;
+boost::thread_specific_ptr<Profiler::TLS> Profiler::tls_(Profiler::releaseTLS);
+std::vector<Profiler::TLS*> Profiler::registered_tls_;
+AdaptiveLock Profiler::lock_;
+std::atomic<bool> Profiler::enabled_(true);
+bool Profiler::collapse_recursion_ = false;
+bool Profiler::cpu_time_ = false;
 
 // Declare some more variables.  These are essentially more private
 // static members for the Profiler, but by using static global
 // variables instead we are able to keep more of the implementation
 // isolated.
 static bool profiler_initialized_ = false;
-static ros::Publisher profiler_index_pub_;
-static ros::Publisher profiler_data_pub_;
+static bool profiler_offline_ = false;
+static std::atomic<bool> stop_collector_(false);
 static boost::thread profiler_thread_;
 
-// collectAndPublish resets the closed_blocks_ member after each
+// The sinks that receive the reports.  They are guarded by
+// sinks_lock_ and only called by the publishing thread.
+static AdaptiveLock sinks_lock_;
+static std::vector<std::shared_ptr<ProfilerSink> > sinks_;
+
+// The profiler only uses ROS (for parameters, services, and the ros
+// sink) once ros::init() has been called, so that it can profile
+// code that runs before ros::init() or in programs that don't use
+// ROS at all.  ros_attached_ is set once the ROS parts have been set
+// up, and ros_sink_pending_ (guarded by Profiler::lock_) is set if
+// the ros sink was selected before ROS was initialized.
+static std::atomic<bool> ros_attached_(false);
+static bool ros_sink_pending_ = false;
+
+// Returns the name the reports are published under.  This is the ROS
+// node name once ROS is attached.  Until then (or in programs that
+// don't use ROS), it is /<program>_<pid>, which is unique and a valid
+// ROS name, so that the reports of different processes can be told
+// apart.
+static std::string reportName()
+{
+  if (ros_attached_) {
+    return ros::this_node::getName();
+  }
+
+  static const std::string name = []() {
+    std::string program = program_invocation_short_name;
+    for (auto &c : program) {
+      if (!std::isalnum(static_cast<unsigned char>(c))) {
+        c = '_';
+      }
+    }
+    if (program.empty() || std::isdigit(static_cast<unsigned char>(program[0]))) {
+      program = "process" + program;
+    }
+    return "/" + program + "_" + std::to_string(getpid());
+  }();
+  return name;
+}
+
+// The index service is handled on the publishing thread through its
+// own callback queue, so that it can read the index without locking
+// and without depending on the node spinning.
+static ros::CallbackQueue profiler_queue_;
+static ros::ServiceServer profiler_index_srv_;
+static ros::ServiceServer profiler_enable_srv_;
+
+// The sequence number of the latest index message.  Each index
+// message only includes the nodes added since the previous one.
+static uint32_t index_sequence_ = 0;
+
+// Set by attachRos() when the reports are renamed to the node name.
+// Readers know nothing about the new name, so the next report starts
+// over with a full index (sequence one) and a keyframe.  Only used by
+// the publishing thread.
+static bool restart_index_ = false;
+
+// The period between reports.  This is loaded when the profiler is
+// initialized.
+static ros::WallDuration report_period_(1.0);
+
+// Every keyframe_interval_ reports, we send a keyframe with every
+// block.  The reports in between only include the blocks that ran.
+// This is loaded when the profiler is initialized.
+static int keyframe_interval_ = 10;
+
+// Trace mode settings.  trace_events_ is the capacity of each
+// thread's trace buffer, and is zero when trace mode is disabled.
+// The reference times are used to convert trace timestamps from
+// clock ticks to wall time.
+static TraceWriter trace_writer_;
+static size_t trace_events_ = 0;
+static Ticks trace_reference_ticks_ = 0;
+static int64_t trace_reference_ns_ = 0;
+
+// How often the publishing thread wakes up between reports to drain
+// the trace buffers and check whether it should stop.
+static const ros::WallDuration wait_step_(0.05);
+
+// Whether reports split each thread's time by block, in addition to
+// its busy time.  This is loaded when the profiler is initialized.
+static bool thread_breakdown_ = false;
+
+// Whether each thread opens perf counters.  This is loaded when the
+// profiler is initialized.
+static bool perf_counters_ = false;
+
+// The profiler's own overhead in clock ticks, as measured by
+// calibrateOverhead().  block_overhead_ is the time that an empty
+// block measures for itself.  child_overhead_ and
+// untimed_child_overhead_ are the time that a timed or untimed
+// nested block adds to each block that encloses it.  These are only
+// used by the publishing thread.
+static double block_overhead_ = 0.0;
+static double child_overhead_ = 0.0;
+static double untimed_child_overhead_ = 0.0;
+
+// Profiled blocks are identified by small integer ids that are
+// assigned the first time a label is seen.  block_labels_ maps an id
+// back to its label and blocks_ to its Block, which is stored in a
+// deque so that it never moves.  Id 0 is reserved as an invalid
+// block.  disabled_labels_ stores the labels that are disabled, so
+// that blocks that haven't been registered yet start disabled.
+// These are guarded by Profiler::lock_.
+static std::unordered_map<std::string, int> block_ids_;
+static std::vector<std::string> block_labels_(1);
+static std::deque<Profiler::Block> blocks_(1);
+static std::set<std::string> disabled_labels_;
+
+// Counters and gauges are identified by ids that are assigned the
+// first time a name is seen, like blocks.  Id 0 is reserved as an
+// invalid metric.  These are guarded by Profiler::lock_.
+static std::unordered_map<std::string, int> metric_ids_;
+static std::vector<std::string> metric_names_(1);
+static std::vector<Profiler::MetricType> metric_types_(1, Profiler::METRIC_COUNTER);
+
+// The compile-time filters reported by registerCompiledFilters().
+// These are registered during static initialization, so they must
+// be constant initialized.  compiled_level_ is negative until a
+// filter is registered.
+static std::atomic<int> compiled_level_(-1);
+static std::atomic<uint32_t> compiled_categories_(0);
+
+// The call tree is made of nodes that each correspond to a block
+// opened from a parent node.  Node 0 is the root of the tree.  A
+// node's parent always has a smaller id than the node.  These are
+// guarded by Profiler::lock_.
+struct CallTreeNode
+{
+  int parent;
+  int block;
+};
+static std::map<std::pair<int, int>, int> node_ids_;
+static std::vector<CallTreeNode> call_tree_(1, CallTreeNode{-1, 0});
+
+// node_paths_ stores the full label of each node in the call tree,
+// node_labels_ stores the label of the node's block, and
+// node_parents_ stores the node's parent.  They are only used by the
+// publishing thread, which builds them as new nodes appear.
+static std::vector<std::string> node_paths_(1);
+static std::vector<std::string> node_labels_(1);
+static std::vector<int> node_parents_(1, -1);
+
+// collectAndPublish resets each thread's closed blocks after each
 // update to reduce the amount of copying done (which might block the
 // threads doing actual work).  The incremental snapshots are
-// collected here in all_closed_blocks_;
-static std::unordered_map<std::string, spm::ProfileData> all_closed_blocks_;
+// collected here in all_closed_blocks_, indexed by node id.  A
+// node's key in the published index is its node id.
+static std::vector<spm::ProfileData> all_closed_blocks_(1);
 
-static ros::Duration durationFromWall(const ros::WallDuration &src)
+// The metrics are accumulated in all_metrics_, indexed by metric id,
+// in the same way.
+static std::vector<spm::ProfileMetric> all_metrics_(1);
+
+static ros::Duration durationFromTicks(const Ticks ticks)
 {
-  return ros::Duration(src.sec, src.nsec);
+  ros::Duration duration;
+  duration.fromNSec(Clock::toNSec(ticks));
+  return duration;
 }
 
 static ros::Time timeFromWall(const ros::WallTime &src)
@@ -42,21 +219,488 @@ static ros::Time timeFromWall(const ros::WallTime &src)
   return ros::Time(src.sec, src.nsec);
 }
 
+// Fills an index message with the labels of nodes [begin, end).
+static void fillIndex(spm::ProfileIndexArray &index,
+                      const ros::WallTime &stamp,
+                      size_t begin,
+                      size_t end)
+{
+  index.header.stamp = timeFromWall(stamp);
+  index.header.frame_id = reportName();
+  index.sequence = index_sequence_;
+  index.data.resize(end - begin);
+  for (size_t i = 0; i < index.data.size(); i++) {
+    index.data[i].key = begin + i;
+    index.data[i].label = node_paths_[begin + i];
+  }
+}
+
+// Returns every node that has been published in an index message.
+static bool getIndex(spm::GetProfileIndex::Request &,
+                     spm::GetProfileIndex::Response &res)
+{
+  fillIndex(res.index, ros::WallTime::now(), 1, all_closed_blocks_.size());
+  res.index.full = true;
+  return true;
+}
+
+// Switches profiling on or off for a single label or, if the label
+// is empty, globally.
+static bool enableProfiling(spm::SetProfilerEnabled::Request &req,
+                            spm::SetProfilerEnabled::Response &)
+{
+  if (req.label.empty()) {
+    Profiler::setEnabled(req.enabled);
+  } else {
+    Profiler::setLabelEnabled(req.label, req.enabled);
+  }
+  return true;
+}
+
+// Returns the CPU time used by another thread in nanoseconds, or -1
+// if it can't be read.
+static int64_t threadCpuNSec(pthread_t thread)
+{
+  clockid_t clock;
+  timespec ts;
+  if (pthread_getcpuclockid(thread, &clock) != 0 ||
+      clock_gettime(clock, &ts) != 0) {
+    return -1;
+  }
+  return static_cast<int64_t>(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+// Opens the perf counters for the calling thread.  Returns NULL if
+// none of them are available (e.g. if perf_event_open is blocked in
+// a container).
+static PerfCounters* openPerfCounters()
+{
+  std::unique_ptr<PerfCounters> perf(new PerfCounters());
+  if (!perf->open()) {
+    ROS_WARN_ONCE("swri_profiler: Perf counters are not available.");
+    return NULL;
+  }
+
+  const uint32_t hardware = (1u << PerfCounterValues::INSTRUCTIONS) |
+    (1u << PerfCounterValues::CACHE_MISSES);
+  if ((perf->openMask() & hardware) != hardware) {
+    ROS_WARN_ONCE("swri_profiler: Some hardware perf counters are not available.");
+  }
+  return perf.release();
+}
+
+// Returns true if parameters can be read from ROS.
+static bool rosAvailable()
+{
+  return !profiler_offline_ && ros::isInitialized();
+}
+
+// Loads the report period.  The SWRI_PROFILER_PERIOD environment
+// variable sets the default for every process that inherits it, and
+// the ~swri_profiler/report_period parameter overrides it for a
+// single node.  Both are in seconds.
+static ros::WallDuration loadReportPeriod()
+{
+  double period = 1.0;
+
+  const char *env = std::getenv("SWRI_PROFILER_PERIOD");
+  if (env) {
+    char *end = NULL;
+    double value = std::strtod(env, &end);
+    if (end != env && *end == '\0') {
+      period = value;
+    } else {
+      ROS_WARN("swri_profiler: Ignoring invalid SWRI_PROFILER_PERIOD '%s'.", env);
+    }
+  }
+
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam("swri_profiler/report_period", period);
+  }
+
+  // Very short periods make the profiler a significant load on the
+  // system and very long periods make it useless for monitoring.
+  const double min_period = 0.01;
+  const double max_period = 60.0;
+  if (period < min_period || period > max_period) {
+    ROS_WARN("swri_profiler: Report period %f is out of range [%f, %f].",
+             period, min_period, max_period);
+    period = std::max(min_period, std::min(max_period, period));
+  }
+
+  return ros::WallDuration(period);
+}
+
+// Loads the number of reports between keyframes from the
+// SWRI_PROFILER_KEYFRAME_INTERVAL environment variable or the
+// ~swri_profiler/keyframe_interval parameter (which takes
+// precedence).  An interval of 1 makes every report a keyframe.
+static int loadKeyframeInterval()
+{
+  int interval = 10;
+
+  const char *env = std::getenv("SWRI_PROFILER_KEYFRAME_INTERVAL");
+  if (env) {
+    char *end = NULL;
+    long value = std::strtol(env, &end, 10);
+    if (end != env && *end == '\0') {
+      interval = value;
+    } else {
+      ROS_WARN("swri_profiler: Ignoring invalid SWRI_PROFILER_KEYFRAME_INTERVAL '%s'.", env);
+    }
+  }
+
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam("swri_profiler/keyframe_interval", interval);
+  }
+
+  if (interval < 1) {
+    ROS_WARN("swri_profiler: Keyframe interval %d is invalid. Sending only keyframes.",
+             interval);
+    interval = 1;
+  }
+
+  return interval;
+}
+
+// Loads the initial state of the runtime switches.  Profiling is
+// enabled unless the SWRI_PROFILER_ENABLED environment variable is
+// "0" or "false", and the ~swri_profiler/enabled parameter takes
+// precedence.  The ~swri_profiler/disabled_labels parameter lists
+// labels to disable.  This must be called with Profiler::lock_
+// held.
+static void loadEnabledSettings(std::atomic<bool> &enabled)
+{
+  bool value = true;
+  const char *env = std::getenv("SWRI_PROFILER_ENABLED");
+  if (env) {
+    const std::string text(env);
+    if (text == "0" || text == "false") {
+      value = false;
+    } else if (text != "1" && text != "true") {
+      ROS_WARN("swri_profiler: Ignoring invalid SWRI_PROFILER_ENABLED '%s'.", env);
+    }
+  }
+
+  std::vector<std::string> labels;
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam("swri_profiler/enabled", value);
+    pnh.getParam("swri_profiler/disabled_labels", labels);
+  }
+
+  // Blocks may have been registered before the profiler was
+  // initialized.
+  for (auto const &label : labels) {
+    disabled_labels_.insert(label);
+    auto const it = block_ids_.find(label);
+    if (it != block_ids_.end()) {
+      blocks_[it->second].enabled = false;
+    }
+  }
+
+  if (!value) {
+    ROS_INFO("swri_profiler: Profiling is disabled.");
+  }
+  enabled = value;
+}
+
+// Loads a boolean setting from an environment variable ("0",
+// "false", "1", or "true") and a private parameter, which takes
+// precedence.  value is returned if neither is set.
+static bool loadFlag(const char *env_name, const std::string &param, bool value)
+{
+  const char *env = std::getenv(env_name);
+  if (env) {
+    const std::string text(env);
+    if (text == "0" || text == "false") {
+      value = false;
+    } else if (text == "1" || text == "true") {
+      value = true;
+    } else {
+      ROS_WARN("swri_profiler: Ignoring invalid %s '%s'.", env_name, env);
+    }
+  }
+
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam(param, value);
+  }
+
+  return value;
+}
+
+// Enables trace mode if a trace file is configured.  The
+// SWRI_PROFILER_TRACE environment variable and the
+// ~swri_profiler/trace_file parameter set the file name (the
+// parameter takes precedence).  SWRI_PROFILER_TRACE_EVENTS sets the
+// number of events each thread can buffer before events are
+// dropped.
+static void loadTraceSettings()
+{
+  std::string filename;
+  const char *env = std::getenv("SWRI_PROFILER_TRACE");
+  if (env) {
+    filename = env;
+  }
+
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam("swri_profiler/trace_file", filename);
+  }
+
+  if (filename.empty()) {
+    return;
+  }
+
+  size_t events = 65536;
+  const char *events_env = std::getenv("SWRI_PROFILER_TRACE_EVENTS");
+  if (events_env) {
+    long value = std::atol(events_env);
+    if (value > 0) {
+      events = value;
+    } else {
+      ROS_WARN("swri_profiler: Ignoring invalid SWRI_PROFILER_TRACE_EVENTS '%s'.",
+               events_env);
+    }
+  }
+
+  if (!trace_writer_.open(filename)) {
+    ROS_ERROR("swri_profiler: Failed to open trace file '%s'. Trace mode is disabled.",
+              trace_writer_.filename().c_str());
+    return;
+  }
+
+  trace_events_ = events;
+  trace_reference_ticks_ = Clock::now();
+  trace_reference_ns_ = ros::WallTime::now().toNSec();
+  ROS_INFO("swri_profiler: Writing trace to '%s'.", trace_writer_.filename().c_str());
+}
+
+// Creates the sinks listed (separated by commas) in the
+// SWRI_PROFILER_SINK environment variable or the ~swri_profiler/sink
+// parameter, which takes precedence.  ROS nodes use the ros sink by
+// default, and offline profilers don't use any sink by default.  See
+// createSink() for the descriptions.  This must be called with
+// Profiler::lock_ held.
+static void loadSinks()
+{
+  std::string description = profiler_offline_ ? "none" : "ros";
+  const char *env = std::getenv("SWRI_PROFILER_SINK");
+  if (env) {
+    description = env;
+  }
+
+  if (rosAvailable()) {
+    ros::NodeHandle pnh("~");
+    pnh.getParam("swri_profiler/sink", description);
+  }
+
+  size_t begin = 0;
+  while (begin <= description.size()) {
+    size_t end = description.find(',', begin);
+    if (end == std::string::npos) {
+      end = description.size();
+    }
+    const std::string item = description.substr(begin, end - begin);
+    begin = end + 1;
+
+    if (item.empty() || item == "none") {
+      continue;
+    }
+    if (item == "ros" && !rosAvailable()) {
+      ros_sink_pending_ = !profiler_offline_;
+      continue;
+    }
+
+    std::shared_ptr<ProfilerSink> sink = createSink(item);
+    if (sink) {
+      AdaptiveLockGuard guard(sinks_lock_);
+      sinks_.push_back(sink);
+    }
+  }
+}
+
+// Sets up the parts of the profiler that use ROS: the services and,
+// if it was selected, the ros sink.  This is called when the profiler
+// is initialized if ROS already is, and otherwise by the publishing
+// thread once ros::init() has been called.  This must be called with
+// Profiler::lock_ held.
+static void attachRos()
+{
+  if (ros_sink_pending_) {
+    ros_sink_pending_ = false;
+    std::shared_ptr<ProfilerSink> sink = createSink("ros");
+    if (sink) {
+      AdaptiveLockGuard guard(sinks_lock_);
+      sinks_.push_back(sink);
+    }
+  }
+
+  ros::NodeHandle pnh("~");
+  pnh.setCallbackQueue(&profiler_queue_);
+  profiler_index_srv_ = pnh.advertiseService("swri_profiler/get_index", getIndex);
+  profiler_enable_srv_ = pnh.advertiseService("swri_profiler/set_enabled", enableProfiling);
+  ros_attached_ = true;
+  restart_index_ = true;
+}
+
+// Passes a report to every sink.
+template <class M>
+static void publishReport(const M &msg)
+{
+  std::vector<std::shared_ptr<ProfilerSink> > sinks;
+  {
+    AdaptiveLockGuard guard(sinks_lock_);
+    sinks = sinks_;
+  }
+
+  for (auto const &sink : sinks) {
+    sink->publish(msg);
+  }
+}
+
 void Profiler::initializeProfiler()
 {
-  SpinLockGuard guard(lock_);
+  AdaptiveLockGuard guard(lock_);
   if (profiler_initialized_) {
     return;
   }
   
   ROS_INFO("Initializing swri_profiler...");
-  ros::NodeHandle nh;
-  profiler_index_pub_ = nh.advertise<spm::ProfileIndexArray>("/profiler/index", 1, true);
-  profiler_data_pub_ = nh.advertise<spm::ProfileDataArray>("/profiler/data", 100, false);
-  profiler_thread_ = boost::thread(Profiler::profilerMain);   
+  if (!ros::isInitialized()) {
+    // ros::Time::now() falls back to wall time until ros::init() is
+    // called.
+    ros::Time::init();
+  }
+  Clock::initialize();
+  report_period_ = loadReportPeriod();
+  keyframe_interval_ = loadKeyframeInterval();
+  loadTraceSettings();
+  loadEnabledSettings(enabled_);
+  // Without collapsing (the default), every level of recursion is a
+  // separate call tree node and recursion deeper than the stack limit
+  // is an error.
+  collapse_recursion_ = loadFlag("SWRI_PROFILER_COLLAPSE_RECURSION",
+                                 "swri_profiler/collapse_recursion", false);
+  cpu_time_ = loadFlag("SWRI_PROFILER_CPU_TIME", "swri_profiler/cpu_time", false);
+  perf_counters_ = loadFlag("SWRI_PROFILER_PERF_COUNTERS",
+                            "swri_profiler/perf_counters", false);
+  thread_breakdown_ = loadFlag("SWRI_PROFILER_THREAD_BREAKDOWN",
+                               "swri_profiler/thread_breakdown", false);
+  loadSinks();
+  if (!profiler_offline_) {
+    if (ros::isInitialized()) {
+      attachRos();
+    } else {
+      // Without ROS, nothing else stops the publishing thread, so we
+      // stop it when the program exits.  This also publishes the
+      // final report.
+      std::atexit(Profiler::stopCollector);
+    }
+    profiler_thread_ = boost::thread(Profiler::profilerMain);   
+  }
   profiler_initialized_ = true;
 }
 
+void Profiler::initializeOffline()
+{
+  {
+    AdaptiveLockGuard guard(lock_);
+    if (profiler_initialized_) {
+      ROS_ERROR("swri_profiler: Offline mode must be selected before the profiler is initialized.");
+      return;
+    }
+    profiler_offline_ = true;
+  }
+
+  // We still report ROS time, which falls back to wall time.
+  ros::Time::init();
+  initializeProfiler();
+}
+
+void Profiler::addSink(const std::shared_ptr<ProfilerSink> &sink)
+{
+  if (!sink) {
+    return;
+  }
+  AdaptiveLockGuard guard(sinks_lock_);
+  sinks_.push_back(sink);
+}
+
+void Profiler::removeSink(const std::shared_ptr<ProfilerSink> &sink)
+{
+  AdaptiveLockGuard guard(sinks_lock_);
+  sinks_.erase(std::remove(sinks_.begin(), sinks_.end(), sink), sinks_.end());
+}
+
+void Profiler::startCollector()
+{
+  initializeProfiler();
+  if (profiler_thread_.joinable()) {
+    return;
+  }
+  stop_collector_ = false;
+  profiler_thread_ = boost::thread(Profiler::profilerMain);
+}
+
+void Profiler::stopCollector()
+{
+  stop_collector_ = true;
+  if (profiler_thread_.joinable()) {
+    profiler_thread_.join();
+  }
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+  initializeProfiler();
+  if (enabled_.exchange(enabled, std::memory_order_relaxed) != enabled) {
+    ROS_INFO("swri_profiler: Profiling is %s.", enabled ? "enabled" : "disabled");
+  }
+}
+
+void Profiler::setLabelEnabled(const std::string &label, bool enabled)
+{
+  initializeProfiler();
+  AdaptiveLockGuard guard(lock_);
+  if (enabled) {
+    disabled_labels_.erase(label);
+  } else {
+    disabled_labels_.insert(label);
+  }
+
+  auto const it = block_ids_.find(label);
+  if (it != block_ids_.end()) {
+    blocks_[it->second].enabled.store(enabled, std::memory_order_relaxed);
+  }
+}
+
+int Profiler::compiledLevel()
+{
+  const int level = compiled_level_.load(std::memory_order_relaxed);
+  return level < 0 ? 255 : level;
+}
+
+uint32_t Profiler::compiledCategories()
+{
+  if (compiled_level_.load(std::memory_order_relaxed) < 0) {
+    return 0xFFFFFFFF;
+  }
+  return compiled_categories_.load(std::memory_order_relaxed);
+}
+
+void Profiler::registerCompiledFilters(int level, uint32_t categories)
+{
+  level = std::max(0, std::min(255, level));
+  compiled_categories_.fetch_or(categories, std::memory_order_relaxed);
+  int current = compiled_level_.load(std::memory_order_relaxed);
+  while (current < level &&
+         !compiled_level_.compare_exchange_weak(current, level, std::memory_order_relaxed)) { ; }
+}
+
 void Profiler::initializeTLS()
 {
   if (tls_.get()) {
@@ -64,160 +708,876 @@ void Profiler::initializeTLS()
     return;
   }
 
+  // The profiler must be initialized first because its settings
+  // determine how the TLS is set up.
+  initializeProfiler();
+
   tls_.reset(new TLS());
-  tls_->stack_depth = 0;
-  tls_->stack_str = "";
+  tls_->tid = syscall(SYS_gettid);
+  tls_->thread = pthread_self();
+  char name[64];
+  if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+    tls_->thread_name = name;
+  }
+  if (trace_events_) {
+    tls_->trace.reset(new TraceBuffer(trace_events_));
+  }
+  if (perf_counters_) {
+    tls_->perf.reset(openPerfCounters());
+  }
+
+  {
+    AdaptiveLockGuard guard(lock_);
+    registered_tls_.push_back(tls_.get());
+  }
+}
 
-  char buffer[256];
-  snprintf(buffer, sizeof(buffer), "%p/", tls_.get());
-  tls_->thread_prefix = std::string(buffer);
+void Profiler::releaseTLS(TLS *tls)
+{
+  // This is called when a thread exits.  We can't delete the TLS yet
+  // because it may still contain data that hasn't been published.
+  // Instead we flag it so that the publishing thread will delete it
+  // after the final harvest.
+  AdaptiveLockGuard guard(tls->lock);
+  tls->exited = true;
+}
 
-  initializeProfiler();
+Profiler::Block* Profiler::registerBlock(const std::string &label)
+{
+  if (label.empty()) {
+    ROS_ERROR("Profiler error: Profiled section has empty name.");
+    return NULL;
+  }
+
+  AdaptiveLockGuard guard(lock_);
+  auto const it = block_ids_.find(label);
+  if (it != block_ids_.end()) {
+    return &blocks_[it->second];
+  }
+
+  int id = block_labels_.size();
+  block_labels_.push_back(label);
+  block_ids_[label] = id;
+  blocks_.emplace_back();
+  blocks_.back().id = id;
+  blocks_.back().enabled = disabled_labels_.count(label) == 0;
+  return &blocks_.back();
+}
+
+Profiler::AsyncToken Profiler::beginAsync(const std::string &name)
+{
+  AsyncToken token;
+  if (!enabled_.load(std::memory_order_relaxed)) {
+    return token;
+  }
+
+  // Async spans hang off their own root node so that they don't
+  // depend on (or disturb) the calling thread's stack.
+  Block *root = findBlock("[async]");
+  Block *block = findBlock(name);
+  // findBlock loads the settings the first time, so check again.
+  if (!root || !block || !block->enabled.load(std::memory_order_relaxed) ||
+      !enabled_.load(std::memory_order_relaxed)) {
+    return token;
+  }
+
+  TLS &tls = *tls_;
+  token.node = findChild(tls, findChild(tls, 0, root->id), block->id);
+  token.t0 = Clock::now();
+  return token;
+}
+
+void Profiler::endAsync(const AsyncToken &token)
+{
+  if (token.node <= 0) {
+    return;
+  }
+
+  const Ticks tf = Clock::now();
+  if (!tls_.get()) { initializeTLS(); }
+  TLS &tls = *tls_;
+
+  // The span is recorded by the thread that ends it, which may not
+  // have seen the node yet.
+  AdaptiveLockGuard guard(tls.lock);
+  addClosedNode(tls, token.node);
+  ClosedInfo &info = tls.closed_blocks[tls.active][token.node];
+  info.count++;
+  info.sample_period = 1;
+  info.addTimedCall(tf - token.t0, tf - token.t0);
+
+  if (tls.trace) {
+    tls.trace->push(token.node, token.t0, tf);
+  }
+}
+
+int Profiler::registerMetric(const std::string &name, MetricType type)
+{
+  if (name.empty()) {
+    ROS_ERROR("Profiler error: Metric has empty name.");
+    return 0;
+  }
+
+  AdaptiveLockGuard guard(lock_);
+  auto const it = metric_ids_.find(name);
+  if (it != metric_ids_.end()) {
+    if (metric_types_[it->second] != type) {
+      ROS_ERROR("Profiler error: Metric '%s' is used as both a counter and a gauge.",
+                name.c_str());
+      return 0;
+    }
+    return it->second;
+  }
+
+  int id = metric_names_.size();
+  metric_names_.push_back(name);
+  metric_types_.push_back(type);
+  metric_ids_[name] = id;
+  return id;
+}
+
+int Profiler::registerNode(int parent, int block)
+{
+  AdaptiveLockGuard guard(lock_);
+  auto const key = std::make_pair(parent, block);
+  auto const it = node_ids_.find(key);
+  if (it != node_ids_.end()) {
+    return it->second;
+  }
+
+  int node = call_tree_.size();
+  call_tree_.push_back(CallTreeNode{parent, block});
+  node_ids_[key] = node;
+  return node;
+}
+
+std::string Profiler::nodePath(int node)
+{
+  AdaptiveLockGuard guard(lock_);
+  std::string path;
+  while (node > 0 && static_cast<size_t>(node) < call_tree_.size()) {
+    path = "/" + block_labels_[call_tree_[node].block] + path;
+    node = call_tree_[node].parent;
+  }
+  return path;
+}
+
+void Profiler::reportStackOverflow(size_t depth, int parent)
+{
+  ROS_ERROR("Profiler error: reached max stack size (%zu) while "
+            "opening a block. Current stack is '%s'.",
+            depth,
+            nodePath(parent).c_str());
+}
+
+void Profiler::reportEmptyStack()
+{
+  ROS_ERROR("Closing a block with an empty stack. Profiler is probably corrupted.");
+}
+
+void Profiler::updateNodePaths()
+{
+  std::vector<CallTreeNode> new_nodes;
+  {
+    AdaptiveLockGuard guard(lock_);
+    new_nodes.assign(call_tree_.begin() + node_paths_.size(), call_tree_.end());
+    for (auto const &node : new_nodes) {
+      node_labels_.push_back(block_labels_[node.block]);
+      node_parents_.push_back(node.parent);
+    }
+  }
+
+  // A node's parent always precedes it, so its path is already
+  // available.
+  for (auto const &node : new_nodes) {
+    node_paths_.push_back(node_paths_[node.parent] + "/" +
+                          node_labels_[node_paths_.size()]);
+  }
+}
+
+void Profiler::drainTraces()
+{
+  if (!trace_events_ || !trace_writer_.isOpen()) {
+    return;
+  }
+
+  std::vector<TLS*> threads;
+  {
+    AdaptiveLockGuard guard(lock_);
+    threads = registered_tls_;
+  }
+
+  const int64_t now_ns = ros::WallTime::now().toNSec();
+  for (TLS *tls : threads) {
+    if (!tls->trace) {
+      continue;
+    }
+
+    if (!tls->trace_named) {
+      trace_writer_.writeThreadName(
+        tls->tid, tls->thread_name.empty() ? std::to_string(tls->tid) : tls->thread_name);
+      tls->trace_named = true;
+    }
+
+    tls->trace->drain([tls](const TraceEvent &event) {
+        // Every node in the buffer was registered before its event
+        // was recorded, but we may not have seen it yet.
+        if (static_cast<size_t>(event.node) >= node_paths_.size()) {
+          updateNodePaths();
+        }
+
+        trace_writer_.writeEvent(
+          node_labels_[event.node],
+          node_paths_[event.node],
+          tls->tid,
+          trace_reference_ns_ + Clock::toNSec(event.t0 - trace_reference_ticks_),
+          Clock::toNSec(event.tf - event.t0));
+      });
+
+    uint64_t dropped = tls->trace->takeDropped();
+    if (dropped) {
+      trace_writer_.writeDropped(tls->tid, now_ns, dropped);
+      ROS_WARN_THROTTLE(5.0, "swri_profiler: Dropped %llu trace events from "
+                        "thread %d because its buffer was full.",
+                        static_cast<unsigned long long>(dropped), tls->tid);
+    }
+  }
+
+  trace_writer_.flush();
+}
+
+void Profiler::calibrateOverhead()
+{
+  // We time the profiler with a private TLS that is never
+  // registered, so the calibration blocks don't show up in the
+  // published data.  Its call tree cache is seeded with two fake
+  // nodes so that opening them doesn't register anything either.
+  // Since nothing is registered, the fake blocks can use any ids,
+  // but they are kept small because the TLS has per-block tables.
+  const int outer_block = 1;
+  const int inner_block = 2;
+  const uint32_t untimed_period = std::numeric_limits<uint32_t>::max();
+
+  TLS *previous = tls_.release();
+  TLS *tls = new TLS();
+  tls->children.resize(2);
+  tls->children[0].push_back(ChildLink(outer_block, 1));
+  tls->children[1].push_back(ChildLink(inner_block, 2));
+  if (perf_counters_) {
+    tls->perf.reset(openPerfCounters());
+  }
+  tls_.reset(tls);
+
+  // Returns the average duration of the outer block's calls.
+  auto outer_duration = [tls]() {
+    ClosedInfo &info = tls->closed_blocks[tls->active][1];
+    double duration = static_cast<double>(info.total_duration) / info.timed_count;
+    info.reset();
+    return duration;
+  };
+
+  // We take the best of several batches to avoid counting time
+  // lost to interrupts and preemption.
+  const int calls = 1000;
+  block_overhead_ = std::numeric_limits<double>::max();
+  child_overhead_ = std::numeric_limits<double>::max();
+  untimed_child_overhead_ = std::numeric_limits<double>::max();
+  for (int batch = 0; batch < 5; batch++) {
+    for (int i = 0; i < calls; i++) {
+      open(outer_block, 1);
+      close();
+    }
+    block_overhead_ = std::min(block_overhead_, outer_duration());
+
+    open(outer_block, 1);
+    for (int i = 0; i < calls; i++) {
+      open(inner_block, 1);
+      close();
+    }
+    close();
+    child_overhead_ = std::min(child_overhead_, outer_duration() / calls);
+
+    // Make every call to the inner block untimed.
+    tls->sample_countdown.assign(3, untimed_period);
+    open(outer_block, 1);
+    for (int i = 0; i < calls; i++) {
+      open(inner_block, untimed_period);
+      close();
+    }
+    close();
+    untimed_child_overhead_ = std::min(untimed_child_overhead_, outer_duration() / calls);
+  }
+
+  // The nested blocks' overhead was measured with the outer block's
+  // own overhead included.
+  child_overhead_ = std::max(0.0, child_overhead_ - block_overhead_ / calls);
+  untimed_child_overhead_ = std::max(0.0, untimed_child_overhead_ - block_overhead_ / calls);
+
+  tls_.release();
+  delete tls;
+  tls_.reset(previous);
+
+  ROS_INFO("swri_profiler: Measured overhead of %.1f ns per block, %.1f ns "
+           "per nested block, and %.1f ns per untimed nested block.",
+           block_overhead_ * Clock::nsPerTick(),
+           child_overhead_ * Clock::nsPerTick(),
+           untimed_child_overhead_ * Clock::nsPerTick());
 }
 
 void Profiler::profilerMain()
 {
   ROS_DEBUG("swri_profiler thread started.");
-  while (ros::ok()) {
-    // Align updates to approximately every second.
+  AdaptiveLock::ignoreWaitsOfThisThread();
+
+  // Give the clock a short baseline for its initial calibration.
+  // The calibration is refined every time we publish.
+  ros::WallDuration(0.01).sleep();
+  Clock::calibrate();
+  calibrateOverhead();
+
+  const uint64_t period_ns = report_period_.toNSec();
+  while (!stop_collector_ && (!ros_attached_ || ros::ok())) {
+    // Align updates to multiples of the report period so that the
+    // reports from different processes line up.
     ros::WallTime now = ros::WallTime::now();
-    ros::WallTime next(now.sec+1,0);
+    ros::WallTime next;
+    next.fromNSec((now.toNSec() / period_ns + 1) * period_ns);
+
+    // We wait in short steps so that we can drain the trace buffers
+    // before they overflow and stop promptly when asked to.  The
+    // housekeeping runs before the first step, so it still runs once
+    // per report when the period (as short as 10 ms) is less than a
+    // step and we don't wait in steps at all.
+    for (;;) {
+      if (!ros_attached_ && !profiler_offline_ && ros::isInitialized()) {
+        // The program has called ros::init() since we started.
+        AdaptiveLockGuard guard(lock_);
+        attachRos();
+      }
+      drainTraces();
+      profiler_queue_.callAvailable();
+      now = ros::WallTime::now();
+      if (next - now <= wait_step_ || stop_collector_) {
+        break;
+      }
+      wait_step_.sleep();
+    }
+    if (stop_collector_) {
+      break;
+    }
+
     (next-now).sleep();
     collectAndPublish();
+
+    // When profiling is disabled, the report above has everything
+    // that was collected before it was disabled, so we just wait
+    // until it is enabled again.
+    while (!enabled_.load(std::memory_order_relaxed) &&
+           !stop_collector_ && (!ros_attached_ || ros::ok())) {
+      wait_step_.sleep();
+      profiler_queue_.callAvailable();
+    }
   }
-  
+
+  if (stop_collector_) {
+    // Publish what was profiled since the last report, even if we
+    // were stopped before the first one.
+    collectAndPublish();
+  }
+  trace_writer_.close(reportName());
   ROS_DEBUG("swri_profiler thread stopped.");
 }
 
+void Profiler::publishMetrics(const MetricVector &new_metrics,
+                              const ros::WallTime &wall_now,
+                              const ros::Time &ros_now)
+{
+  // Every metric we harvested was registered before we took the
+  // snapshot.
+  {
+    AdaptiveLockGuard guard(lock_);
+    for (size_t id = all_metrics_.size(); id < metric_names_.size(); id++) {
+      all_metrics_.emplace_back();
+      all_metrics_.back().name = metric_names_[id];
+      all_metrics_.back().type = metric_types_[id];
+    }
+  }
+
+  if (all_metrics_.size() <= 1) {
+    return;
+  }
+
+  spm::ProfileMetricArray msg;
+  msg.header.stamp = timeFromWall(wall_now);
+  msg.header.frame_id = reportName();
+  msg.rostime_stamp = ros_now;
+  msg.report_period = ros::Duration(report_period_.sec, report_period_.nsec);
+  for (size_t id = 1; id < all_metrics_.size(); id++) {
+    spm::ProfileMetric &metric = all_metrics_[id];
+    metric.rel_count = 0;
+    metric.rel_sum = 0.0;
+    metric.rel_min = 0.0;
+    metric.rel_max = 0.0;
+    if (id < new_metrics.size() && new_metrics[id].count > 0) {
+      const MetricInfo &info = new_metrics[id];
+      metric.rel_count = info.count;
+      metric.rel_sum = info.sum;
+      metric.rel_min = info.min;
+      metric.rel_max = info.max;
+      metric.last = info.last;
+      metric.abs_count += info.count;
+      metric.abs_sum += info.sum;
+    }
+    msg.metrics.push_back(metric);
+  }
+
+  publishReport(msg);
+}
+
 void Profiler::collectAndPublish()
 {
   static bool first_run = true;
-  static ros::WallTime last_now = ros::WallTime::now();
+  static Ticks last_now = Clock::now();
+  static int64_t last_cpu_ns = Clock::threadCpuNSec();
+  static int reports_since_keyframe = 0;
+
+  Clock::calibrate();
   
-  // Grab a snapshot of the current state.  
-  std::unordered_map<std::string, ClosedInfo> new_closed_blocks;
-  std::unordered_map<std::string, OpenInfo> threaded_open_blocks;
-  ros::WallTime now = ros::WallTime::now();
-  ros::Time ros_now = ros::Time::now();  
+  // Grab a snapshot of the current state.  Each thread's closed
+  // blocks are double buffered, so we only hold a thread's lock long
+  // enough to flip its active buffer and copy its open stack.  The
+  // inactive buffer is then ours to read until the next flip.
+  std::vector<TLS*> threads;
   {
-    SpinLockGuard guard(lock_);
-    new_closed_blocks.swap(closed_blocks_);
-    for (auto &pair : open_blocks_) {
-      threaded_open_blocks[pair.first].t0 = pair.second.t0;
-      pair.second.last_report_time = now;
+    AdaptiveLockGuard guard(lock_);
+    threads = registered_tls_;
+  }
+
+  // Each thread's share of the blocks that finished, which becomes
+  // its busy time and breakdown once we know which nodes are at the
+  // root of the call tree.  rel_ticks are scaled up for sampled
+  // blocks.  open_ticks is the time the thread's outermost open block
+  // has run since the previous report.
+  struct ThreadBlock
+  {
+    int node;
+    size_t count;
+    double rel_ticks;
+  };
+  struct ThreadReport
+  {
+    spm::ProfileThread msg;
+    double open_ticks;
+    std::vector<ThreadBlock> blocks;
+  };
+  std::vector<ThreadReport> thread_reports;
+
+  ClosedVector new_closed_blocks;
+  MetricVector new_metrics;
+  std::vector<OpenInfo> threaded_open_blocks;
+  std::vector<TLS*> exited_threads;
+  Ticks now = Clock::now();
+  ros::WallTime wall_now = ros::WallTime::now();
+  ros::Time ros_now = ros::Time::now();  
+  for (TLS *tls : threads) {
+    thread_reports.emplace_back();
+    ThreadReport &report = thread_reports.back();
+    report.msg.tid = tls->tid;
+    report.msg.name = tls->thread_name;
+    report.open_ticks = 0.0;
+
+    size_t harvest;
+    bool exited;
+    {
+      AdaptiveLockGuard guard(tls->lock);
+      harvest = tls->active;
+      tls->active = 1 - tls->active;
+      exited = tls->exited;
+      // Add the nodes that the thread opened for the first time since
+      // the previous flip to its new active buffer.
+      if (tls->closed_nodes[tls->active] != tls->closed_nodes[harvest]) {
+        const ClosedVector &harvested = tls->closed_blocks[harvest];
+        for (size_t node = 0; node < harvested.size(); node++) {
+          if (harvested[node].histogram) {
+            addClosedNode(*tls, node);
+          }
+        }
+      }
+      if (tls->stack_depth > 0 && tls->open_blocks[0].timed) {
+        const OpenInfo &root = tls->open_blocks[0];
+        report.open_ticks = now - std::max(root.t0, root.last_report_time);
+      }
+      // The thread can't exit while we hold its lock.
+      int64_t cpu_now = -1;
+      if (cpu_time_ && tls->stack_depth > 0 && !exited) {
+        cpu_now = threadCpuNSec(tls->thread);
+      }
+      for (size_t i = 0; i < tls->stack_depth; i++) {
+        threaded_open_blocks.push_back(tls->open_blocks[i]);
+        tls->open_blocks[i].last_report_time = now;
+        // Replace the copy's counters with the number of
+        // descendants that the block has opened so far.
+        OpenInfo &info = threaded_open_blocks.back();
+        info.timed_opens = tls->timed_opens - info.timed_opens;
+        info.untimed_opens = tls->untimed_opens - info.untimed_opens;
+        // Likewise, replace the copy's CPU times with the CPU time
+        // the block has used so far and since the previous report.
+        if (cpu_now >= 0 && info.timed) {
+          info.cpu_last_report = cpu_now - std::max(info.cpu_t0, info.cpu_last_report);
+          info.cpu_t0 = cpu_now - info.cpu_t0;
+          tls->open_blocks[i].cpu_last_report = cpu_now;
+        } else {
+          info.cpu_t0 = 0;
+          info.cpu_last_report = 0;
+        }
+      }
+    }
+
+    ClosedVector &closed = tls->closed_blocks[harvest];
+    if (new_closed_blocks.size() < closed.size()) {
+      new_closed_blocks.resize(closed.size());
+    }
+    for (size_t node = 0; node < closed.size(); node++) {
+      ClosedInfo &src = closed[node];
+      if (src.count == 0) {
+        continue;
+      }
+
+      double rel_ticks = 0.0;
+      if (src.timed_count > 0) {
+        rel_ticks = static_cast<double>(src.rel_duration) * src.count / src.timed_count;
+      }
+      report.blocks.push_back(ThreadBlock{static_cast<int>(node), src.count, rel_ticks});
+
+      new_closed_blocks[node].merge(src);
+      src.reset();
+    }
+
+    MetricVector &metrics = tls->metrics[harvest];
+    if (new_metrics.size() < metrics.size()) {
+      new_metrics.resize(metrics.size());
+    }
+    for (size_t id = 0; id < metrics.size(); id++) {
+      new_metrics[id].merge(metrics[id]);
+      metrics[id].reset();
+    }
+
+    report.msg.exited = exited;
+    if (exited) {
+      exited_threads.push_back(tls);
     }
   }
 
-  // Reset all relative max durations.
-  for (auto &pair : all_closed_blocks_) {
-    pair.second.rel_total_duration = ros::Duration(0);
-    pair.second.rel_max_duration = ros::Duration(0);
+  // Write out any trace events before we release threads that have
+  // exited.
+  drainTraces();
+
+  // Threads that have exited have now been harvested for the last
+  // time, so we can release their storage.
+  if (!exited_threads.empty()) {
+    AdaptiveLockGuard guard(lock_);
+    for (TLS *tls : exited_threads) {
+      registered_tls_.erase(std::remove(registered_tls_.begin(),
+                                        registered_tls_.end(),
+                                        tls),
+                            registered_tls_.end());
+      delete tls;
+    }
   }
 
-  // Flag to indicate if a new item was added.
-  bool update_index = false;
+  // Grab any call tree nodes that were added since the last update.
+  // Every node we harvested data for was registered before we took
+  // the snapshot, so they are guaranteed to be included.  Note that
+  // drainTraces() may have already picked up some of the new paths.
+  const size_t known_nodes = all_closed_blocks_.size();
+  updateNodePaths();
+  bool update_index = node_paths_.size() > known_nodes;
+  const bool restart_index = restart_index_ && node_paths_.size() > 1;
+  restart_index_ = false;
+  for (size_t node = known_nodes; node < node_paths_.size(); node++) {
+    all_closed_blocks_.emplace_back();
+    all_closed_blocks_.back().key = node;
+    all_closed_blocks_.back().sample_period = 1;
+  }
+
+  // The perf counters that are published, which are the ones that
+  // any thread has been able to open.
+  std::vector<int> counters;
+  const uint32_t counter_mask = PerfCounters::availableMask();
+  for (int i = 0; i < PerfCounterValues::COUNT; i++) {
+    if (counter_mask & (1u << i)) {
+      counters.push_back(i);
+    }
+  }
+
+  // Reset all relative max durations.
+  for (auto &item : all_closed_blocks_) {
+    item.rel_counters.assign(counters.size(), 0);
+    item.rel_total_duration = ros::Duration(0);
+    item.rel_corrected_duration = ros::Duration(0);
+    item.rel_max_duration = ros::Duration(0);
+    item.rel_cpu_duration = ros::Duration(0);
+    item.rel_timed_count = 0;
+    item.rel_recursive_count = 0;
+    item.rel_alloc_count = 0;
+    item.rel_alloc_bytes = 0;
+  }
 
   // Merge the new stats into the absolute stats
-  for (auto const &pair : new_closed_blocks) {
-    const auto &label = pair.first;
-    const auto &new_info = pair.second;
+  for (size_t node = 1; node < new_closed_blocks.size(); node++) {
+    const auto &new_info = new_closed_blocks[node];
+    if (new_info.count == 0) {
+      continue;
+    }
 
-    auto &all_info = all_closed_blocks_[label];
+    auto &all_info = all_closed_blocks_[node];
+    ros::Duration total_duration = durationFromTicks(new_info.total_duration);
+    ros::Duration rel_duration = durationFromTicks(new_info.rel_duration);
 
-    if (all_info.key == 0) {
-      update_index = true;
-      all_info.key = all_closed_blocks_.size();
+    // Estimate how much of the timed calls was the profiler's own
+    // overhead: each call's open/close, and the open/close of every
+    // block nested inside it.
+    const double overhead =
+      new_info.timed_count * block_overhead_ +
+      new_info.timed_descendants * child_overhead_ +
+      new_info.untimed_descendants * untimed_child_overhead_;
+    double correction = 1.0;
+    if (new_info.total_duration > 0) {
+      correction = std::max(0.0, 1.0 - overhead / new_info.total_duration);
     }
-    
+    ros::Duration corrected_duration = total_duration * correction;
+    ros::Duration rel_corrected_duration = rel_duration * correction;
+    ros::Duration cpu_duration;
+    cpu_duration.fromNSec(new_info.cpu_duration);
+    ros::Duration rel_cpu_duration;
+    rel_cpu_duration.fromNSec(new_info.rel_cpu_duration);
+
+    if (new_info.timed_count == 0) {
+      // None of the calls to this sampled block were timed during
+      // this interval, so we estimate them from the block's average
+      // so far.
+      if (all_info.abs_call_count > 0) {
+        const double scale = static_cast<double>(new_info.count) / all_info.abs_call_count;
+        total_duration = all_info.abs_total_duration * scale;
+        rel_duration = total_duration;
+        corrected_duration = all_info.abs_corrected_duration * scale;
+        rel_corrected_duration = corrected_duration;
+        cpu_duration = all_info.abs_cpu_duration * scale;
+        rel_cpu_duration = cpu_duration;
+      }
+    } else if (new_info.timed_count < new_info.count) {
+      // Scale the timed calls up to all of the calls.
+      const double scale = static_cast<double>(new_info.count) / new_info.timed_count;
+      total_duration = total_duration * scale;
+      rel_duration = rel_duration * scale;
+      corrected_duration = corrected_duration * scale;
+      rel_corrected_duration = rel_corrected_duration * scale;
+      cpu_duration = cpu_duration * scale;
+      rel_cpu_duration = rel_cpu_duration * scale;
+    }
+
     all_info.abs_call_count += new_info.count;
-    all_info.abs_total_duration += durationFromWall(new_info.total_duration);
-    all_info.rel_total_duration += durationFromWall(new_info.rel_duration);
+    all_info.abs_total_duration += total_duration;
+    all_info.abs_corrected_duration += corrected_duration;
+    all_info.rel_total_duration += rel_duration;
+    all_info.rel_corrected_duration += rel_corrected_duration;
+    all_info.abs_cpu_duration += cpu_duration;
+    all_info.rel_cpu_duration += rel_cpu_duration;
     all_info.rel_max_duration = std::max(all_info.rel_max_duration,
-                                         durationFromWall(new_info.max_duration));
+                                         durationFromTicks(new_info.max_duration));
+    all_info.rel_timed_count = new_info.timed_count;
+    all_info.rel_recursive_count = new_info.recursive_count;
+    all_info.rel_alloc_count = new_info.alloc_count;
+    all_info.rel_alloc_bytes = new_info.alloc_bytes;
+
+    // Counters are only read for timed calls, so they are scaled up
+    // to all of the calls like the durations.
+    double counter_scale = 0.0;
+    if (new_info.timed_count > 0) {
+      counter_scale = static_cast<double>(new_info.count) / new_info.timed_count;
+    }
+    for (size_t i = 0; i < counters.size(); i++) {
+      all_info.rel_counters[i] = new_info.counters[counters[i]] * counter_scale;
+    }
+    all_info.sample_period = new_info.sample_period;
   }
   
   // Combine the open blocks from all threads into a single
   // map.
-  std::unordered_map<std::string, spm::ProfileData> combined_open_blocks;
-  for (auto const &pair : threaded_open_blocks) {
-    const auto &threaded_label = pair.first;
-    const auto &threaded_info = pair.second;
-
-    size_t slash_index = threaded_label.find('/');
-    if (slash_index == std::string::npos) {
-      ROS_ERROR("Missing expected slash in label: %s", threaded_label.c_str());
+  std::unordered_map<int, spm::ProfileData> combined_open_blocks;
+  for (auto const &info : threaded_open_blocks) {
+    // Untimed calls to sampled blocks are accounted for when they
+    // close.
+    if (!info.timed) {
       continue;
     }
 
-    ros::Duration duration = durationFromWall(now - threaded_info.t0);
-    
-    const auto label = threaded_label.substr(slash_index+1);
-    auto &new_info = combined_open_blocks[label];
-
-    if (new_info.key == 0) {
-      auto &all_info = all_closed_blocks_[label];
-      if (all_info.key == 0) {
-        update_index = true;
-        all_info.key = all_closed_blocks_.size();
-      }
-      new_info.key = all_info.key;
+    ros::Duration duration = durationFromTicks(now - info.t0);
+    ros::Duration rel_duration = duration;
+    if (!first_run) {
+      rel_duration = std::min(durationFromTicks(now - last_now), duration);
     }
 
+    const double overhead =
+      block_overhead_ +
+      info.timed_opens * child_overhead_ +
+      info.untimed_opens * untimed_child_overhead_;
+    double correction = 1.0;
+    if (now > info.t0) {
+      correction = std::max(0.0, 1.0 - overhead / (now - info.t0));
+    }
+    
+    auto &new_info = combined_open_blocks[info.node];
+    new_info.key = info.node;
     new_info.abs_call_count++;
     new_info.abs_total_duration += duration;
-    if (first_run) {
-      new_info.rel_total_duration += duration;
-    } else {
-      new_info.rel_total_duration += std::min(
-        durationFromWall(now - last_now), duration);
-    }
+    new_info.abs_corrected_duration += duration * correction;
+    new_info.rel_total_duration += rel_duration;
+    new_info.rel_corrected_duration += rel_duration * correction;
+    ros::Duration cpu_duration;
+    cpu_duration.fromNSec(info.cpu_t0);
+    new_info.abs_cpu_duration += cpu_duration;
+    cpu_duration.fromNSec(info.cpu_last_report);
+    new_info.rel_cpu_duration += cpu_duration;
     new_info.rel_max_duration = std::max(new_info.rel_max_duration, duration);
   }
 
-  if (update_index) {
+  // A thread is busy while it is inside one of the blocks at the root
+  // of the call tree.  Calls to sampled root blocks that weren't timed
+  // at all during this interval aren't counted.
+  for (ThreadReport &report : thread_reports) {
+    double busy_ticks = report.open_ticks;
+    for (auto const &block : report.blocks) {
+      if (node_parents_[block.node] == 0) {
+        busy_ticks += block.rel_ticks;
+      }
+      if (thread_breakdown_) {
+        report.msg.keys.push_back(block.node);
+        report.msg.rel_call_counts.push_back(block.count);
+        report.msg.rel_total_durations.push_back(
+          durationFromTicks(static_cast<Ticks>(block.rel_ticks)));
+      }
+    }
+    report.msg.rel_busy_duration = durationFromTicks(static_cast<Ticks>(busy_ticks));
+  }
+
+  // The index message only includes the new nodes.  Subscribers
+  // that missed earlier messages can request the full index from
+  // the get_index service.
+  if (update_index || restart_index) {
+    const size_t first_node = restart_index ? 1 : known_nodes;
+    if (restart_index) {
+      index_sequence_ = 0;
+    }
+    index_sequence_++;
     spm::ProfileIndexArray index;
-    index.header.stamp = timeFromWall(now);
-    index.header.frame_id = ros::this_node::getName();
-    index.data.resize(all_closed_blocks_.size());
-    
-    for (auto const &pair : all_closed_blocks_) {
-      size_t i = pair.second.key - 1;
-      index.data[i].key = pair.second.key;
-      index.data[i].label = pair.first;
-    }        
-    profiler_index_pub_.publish(index);
+    fillIndex(index, wall_now, first_node, node_paths_.size());
+    index.full = first_node == 1;
+    publishReport(index);
   }
 
   // Generate output message
   spm::ProfileDataArray msg;
-  msg.header.stamp = timeFromWall(now);
-  msg.header.frame_id = ros::this_node::getName();
+  msg.header.stamp = timeFromWall(wall_now);
+  msg.header.frame_id = reportName();
   msg.rostime_stamp = ros_now;
-  
-  msg.data.resize(all_closed_blocks_.size());
-  for (auto &pair : all_closed_blocks_) {
-    auto const &item = pair.second;
-    size_t i = item.key - 1;
-
-    msg.data[i].key = item.key;
-    msg.data[i].abs_call_count = item.abs_call_count;
-    msg.data[i].abs_total_duration = item.abs_total_duration;
-    msg.data[i].rel_total_duration = item.rel_total_duration;
-    msg.data[i].rel_max_duration = item.rel_max_duration;
-  }
-
-  for (auto &pair : combined_open_blocks) {
-    auto const &item = pair.second;
-    size_t i = item.key - 1;
-    msg.data[i].abs_call_count += item.abs_call_count;
-    msg.data[i].abs_total_duration += item.abs_total_duration;
-    msg.data[i].rel_total_duration += item.rel_total_duration;
-    msg.data[i].rel_max_duration = std::max(
-      msg.data[i].rel_max_duration,
-      item.rel_max_duration);
+  msg.report_period = ros::Duration(report_period_.sec, report_period_.nsec);
+  msg.compiled_level = compiledLevel();
+  msg.compiled_categories = compiledCategories();
+  for (int counter : counters) {
+    msg.counter_names.push_back(PerfCounterValues::name(counter));
+  }
+
+  // Between keyframes, we only send the blocks that finished a call
+  // or are still running.  Every other block is unchanged.
+  if (restart_index) {
+    reports_since_keyframe = 0;
+  }
+  msg.keyframe = reports_since_keyframe == 0;
+  reports_since_keyframe = (reports_since_keyframe + 1) % keyframe_interval_;
+
+  std::vector<bool> changed(all_closed_blocks_.size(), msg.keyframe);
+  for (size_t node = 1; node < new_closed_blocks.size(); node++) {
+    if (new_closed_blocks[node].count > 0) {
+      changed[node] = true;
+    }
+  }
+  for (auto const &pair : combined_open_blocks) {
+    changed[pair.first] = true;
+  }
+
+  for (size_t node = 1; node < all_closed_blocks_.size(); node++) {
+    if (!changed[node]) {
+      continue;
+    }
+
+    msg.data.push_back(all_closed_blocks_[node]);
+    spm::ProfileData &data = msg.data.back();
+
+    auto const open_it = combined_open_blocks.find(node);
+    if (open_it != combined_open_blocks.end()) {
+      auto const &item = open_it->second;
+      data.abs_call_count += item.abs_call_count;
+      data.abs_total_duration += item.abs_total_duration;
+      data.abs_corrected_duration += item.abs_corrected_duration;
+      data.rel_total_duration += item.rel_total_duration;
+      data.rel_corrected_duration += item.rel_corrected_duration;
+      data.abs_cpu_duration += item.abs_cpu_duration;
+      data.rel_cpu_duration += item.rel_cpu_duration;
+      data.rel_max_duration = std::max(data.rel_max_duration, item.rel_max_duration);
+    }
+
+    // Nodes that have never been called, such as the root of the
+    // async spans, have no data to report.
+    if (data.abs_call_count == 0) {
+      msg.data.pop_back();
+    }
   }
   
-  profiler_data_pub_.publish(msg);
+  for (ThreadReport &report : thread_reports) {
+    msg.threads.push_back(std::move(report.msg));
+  }
+
+  // Add the histograms of the blocks that finished during this
+  // interval.  Only the non-empty buckets are sent.
+  msg.histogram_sub_bucket_bits = LatencyHistogram::SUB_BUCKET_BITS;
+  msg.histogram_ns_per_unit = Clock::nsPerTick();
+  for (size_t node = 1; node < new_closed_blocks.size(); node++) {
+    const LatencyHistogram *histogram = new_closed_blocks[node].histogram.get();
+    if (!histogram) {
+      continue;
+    }
+
+    msg.histograms.emplace_back();
+    spm::ProfileHistogram &out = msg.histograms.back();
+    out.key = node;
+    for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+      if (histogram->count(i)) {
+        out.buckets.push_back(i);
+        out.counts.push_back(histogram->count(i));
+      }
+    }
+  }
+
+  msg.block_overhead_ns = block_overhead_ * Clock::nsPerTick();
+  msg.child_overhead_ns = child_overhead_ * Clock::nsPerTick();
+  msg.untimed_child_overhead_ns = untimed_child_overhead_ * Clock::nsPerTick();
+
+  // Report our own CPU time, including the time spent draining
+  // traces between reports.
+  const int64_t cpu_ns = Clock::threadCpuNSec();
+  msg.collector_cpu_time.fromNSec(cpu_ns - last_cpu_ns);
+  last_cpu_ns = cpu_ns;
+
+  const LockWaitStats lock_stats = AdaptiveLock::takeWaitStats();
+  msg.lock_waits = lock_stats.waits;
+  msg.lock_sleeps = lock_stats.sleeps;
+  msg.lock_wait_time.fromNSec(lock_stats.wait_ns);
+  msg.lock_max_wait.fromNSec(lock_stats.max_wait_ns);
+
+  publishReport(msg);
+
+  publishMetrics(new_metrics, wall_now, ros_now);
   first_run = false;
   last_now = now;
 }
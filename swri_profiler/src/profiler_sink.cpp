@@ -0,0 +1,483 @@
+#include <swri_profiler/profiler_sink.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+#include <ros/init.h>
+#include <ros/node_handle.h>
+#include <ros/publisher.h>
+#include <ros/serialization.h>
+
+#include <swri_profiler/recording_writer.h>
+#include <swri_profiler/shm_ring.h>
+
+namespace spm = swri_profiler_msgs;
+
+namespace swri_profiler
+{
+CallbackSink::CallbackSink(const IndexCallback &index_callback,
+                           const DataCallback &data_callback,
+                           const MetricsCallback &metrics_callback)
+  :
+  index_callback_(index_callback),
+  data_callback_(data_callback),
+  metrics_callback_(metrics_callback)
+{
+}
+
+void CallbackSink::publish(const spm::ProfileIndexArray &index)
+{
+  if (index_callback_) {
+    index_callback_(index);
+  }
+}
+
+void CallbackSink::publish(const spm::ProfileDataArray &data)
+{
+  if (data_callback_) {
+    data_callback_(data);
+  }
+}
+
+void CallbackSink::publish(const spm::ProfileMetricArray &metrics)
+{
+  if (metrics_callback_) {
+    metrics_callback_(metrics);
+  }
+}
+
+SerializedSink::SerializedSink()
+  :
+  full_index_pending_(false)
+{
+}
+
+template <class M>
+bool SerializedSink::write(ReportType type, const M &msg)
+{
+  const uint32_t size = ros::serialization::serializationLength(msg);
+  uint8_t *buffer = reserve(type, size);
+  if (!buffer) {
+    return false;
+  }
+
+  ros::serialization::OStream stream(buffer, size);
+  ros::serialization::serialize(stream, msg);
+  return commit();
+}
+
+void SerializedSink::resendIndex()
+{
+  // Until the first index is published, there is nothing to resend.
+  if (!full_index_.data.empty()) {
+    full_index_pending_ = true;
+  }
+}
+
+bool SerializedSink::writePendingIndex()
+{
+  if (full_index_pending_ && write(REPORT_INDEX, full_index_)) {
+    full_index_pending_ = false;
+  }
+  return !full_index_pending_;
+}
+
+void SerializedSink::publish(const spm::ProfileIndexArray &index)
+{
+  beginReport();
+
+  // Publishers that predate incremental indices always send the
+  // full index.
+  if (index.full || index.sequence == 0) {
+    full_index_.data.clear();
+  }
+  full_index_.header = index.header;
+  full_index_.sequence = index.sequence;
+  full_index_.full = true;
+  full_index_.data.insert(full_index_.data.end(), index.data.begin(), index.data.end());
+
+  if (full_index_pending_) {
+    writePendingIndex();
+  } else if (!write(REPORT_INDEX, index)) {
+    full_index_pending_ = true;
+  }
+}
+
+void SerializedSink::publish(const spm::ProfileDataArray &data)
+{
+  beginReport();
+  // Data can't be labelled before its index, so we drop it until the
+  // index is written.
+  if (writePendingIndex()) {
+    write(REPORT_DATA, data);
+  }
+}
+
+void SerializedSink::publish(const spm::ProfileMetricArray &metrics)
+{
+  beginReport();
+  writePendingIndex();
+  write(REPORT_METRICS, metrics);
+}
+
+// RosTopicSink publishes the reports on the profiler topics.
+class RosTopicSink : public ProfilerSink
+{
+ public:
+  RosTopicSink()
+  {
+    ros::NodeHandle nh;
+    index_pub_ = nh.advertise<spm::ProfileIndexArray>("/profiler/index", 1, true);
+    data_pub_ = nh.advertise<spm::ProfileDataArray>("/profiler/data", 100, false);
+    metrics_pub_ = nh.advertise<spm::ProfileMetricArray>("/profiler/metrics", 100, false);
+  }
+
+  virtual void publish(const spm::ProfileIndexArray &index) { index_pub_.publish(index); }
+  virtual void publish(const spm::ProfileDataArray &data) { data_pub_.publish(data); }
+  virtual void publish(const spm::ProfileMetricArray &metrics) { metrics_pub_.publish(metrics); }
+
+ private:
+  ros::Publisher index_pub_;
+  ros::Publisher data_pub_;
+  ros::Publisher metrics_pub_;
+};
+
+// ShmSink writes the reports to this process's shared memory segment
+// for the profiler_collector node.  They are serialized directly into
+// the ring.  If the ring is full (e.g. because the collector isn't
+// running), reports are dropped, and the full index is written once
+// there is room again so that the collector's cached index is
+// complete.  The full index is also written before every keyframe,
+// so that a collector that (re)started after the first index
+// catches up.
+class ShmSink : public SerializedSink
+{
+ public:
+  bool open()
+  {
+    if (!ring_.create(1 << 20)) {
+      return false;
+    }
+    ROS_INFO("swri_profiler: Writing reports to shared memory segment %s.",
+             ring_.name().c_str());
+    return true;
+  }
+
+  using SerializedSink::publish;
+
+  virtual void publish(const spm::ProfileDataArray &data)
+  {
+    if (data.keyframe) {
+      resendIndex();
+    }
+    SerializedSink::publish(data);
+  }
+
+ protected:
+  virtual uint8_t* reserve(ReportType type, size_t size)
+  {
+    type_ = type;
+    uint8_t *buffer = ring_.reserve(size);
+    if (!buffer) {
+      ROS_WARN_THROTTLE(10.0, "swri_profiler: Dropping reports because the shared memory "
+                        "segment is full. Is the profiler_collector node running?");
+    }
+    return buffer;
+  }
+
+  virtual bool commit()
+  {
+    ring_.commit(type_);
+    return true;
+  }
+
+ private:
+  ShmRing ring_;
+  ReportType type_;
+};
+
+// A FramedSink serializes each report into a buffer after its frame
+// header and passes the whole frame to writeFrame().
+class FramedSink : public SerializedSink
+{
+ protected:
+  virtual uint8_t* reserve(ReportType type, size_t size)
+  {
+    buffer_.resize(sizeof(FrameHeader) + size);
+    FrameHeader header;
+    header.type = type;
+    header.size = size;
+    std::memcpy(buffer_.data(), &header, sizeof(header));
+    return buffer_.data() + sizeof(FrameHeader);
+  }
+
+  virtual bool commit()
+  {
+    return writeFrame(buffer_.data(), buffer_.size());
+  }
+
+  // Returns false if the frame was dropped.
+  virtual bool writeFrame(const uint8_t *data, size_t size) = 0;
+
+ private:
+  std::vector<uint8_t> buffer_;
+};
+
+// FileSink writes the reports to a file, which starts with an 8 byte
+// magic number ("SWRIPRF1") followed by the frames.
+class FileSink : public FramedSink
+{
+ public:
+  FileSink() : file_(NULL) {}
+
+  ~FileSink()
+  {
+    if (file_) {
+      std::fclose(file_);
+    }
+  }
+
+  bool open(std::string path)
+  {
+    const std::string pid = std::to_string(getpid());
+    size_t pos = path.find("%p");
+    while (pos != std::string::npos) {
+      path.replace(pos, 2, pid);
+      pos = path.find("%p", pos + pid.size());
+    }
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+      ROS_ERROR("swri_profiler: Failed to open report file '%s': %s",
+                path.c_str(), std::strerror(errno));
+      return false;
+    }
+
+    std::fwrite("SWRIPRF1", 1, 8, file_);
+    ROS_INFO("swri_profiler: Writing reports to '%s'.", path.c_str());
+    return true;
+  }
+
+ protected:
+  // Each frame is flushed so that the file is complete if the
+  // process is killed.
+  virtual bool writeFrame(const uint8_t *data, size_t size)
+  {
+    std::fwrite(data, 1, size, file_);
+    std::fflush(file_);
+    return true;
+  }
+
+ private:
+  FILE *file_;
+};
+
+// UnixSocketSink sends the reports to a Unix domain stream socket.
+// If the listener isn't there (or goes away), reports are dropped
+// and we try to connect again with the next report.  The socket is
+// non-blocking so that a listener that doesn't keep up can't stall
+// the publishing thread: a report that doesn't fit in the socket's
+// buffer is dropped and counted.  If only part of a report fits, the
+// rest is sent before the next report, which is dropped if the rest
+// still doesn't fit, so the listener never sees a partial frame.
+// Every time we connect, and after an index is dropped, we send the
+// full index so that the listener can label everything it receives.
+class UnixSocketSink : public FramedSink
+{
+ public:
+  explicit UnixSocketSink(const std::string &path) : path_(path), fd_(-1), dropped_(0) {}
+
+  ~UnixSocketSink()
+  {
+    disconnect();
+  }
+
+  bool isValid() const
+  {
+    return !path_.empty() && path_.size() < sizeof(sockaddr_un().sun_path);
+  }
+
+ protected:
+  virtual void beginReport()
+  {
+    if (fd_ < 0 && connect()) {
+      resendIndex();
+    }
+  }
+
+  virtual bool writeFrame(const uint8_t *data, size_t size)
+  {
+    if (fd_ < 0) {
+      return false;
+    }
+
+    if (!pending_.empty()) {
+      size_t sent = 0;
+      if (!send(pending_.data(), pending_.size(), sent)) {
+        return false;
+      }
+      pending_.erase(pending_.begin(), pending_.begin() + sent);
+      if (!pending_.empty()) {
+        drop();
+        return false;
+      }
+    }
+
+    size_t sent = 0;
+    if (!send(data, size, sent)) {
+      return false;
+    }
+    if (sent == 0) {
+      drop();
+      return false;
+    } else if (sent < size) {
+      pending_.assign(data + sent, data + size);
+    }
+    return true;
+  }
+
+ private:
+  std::string path_;
+  int fd_;
+  // The unsent rest of a partially sent frame.
+  std::vector<uint8_t> pending_;
+  uint64_t dropped_;
+
+  bool connect()
+  {
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      return false;
+    }
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path_.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      ROS_WARN_THROTTLE(10.0, "swri_profiler: Failed to connect to report socket '%s': %s",
+                        path_.c_str(), std::strerror(errno));
+      disconnect();
+      return false;
+    }
+    return true;
+  }
+
+  void disconnect()
+  {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+    fd_ = -1;
+    pending_.clear();
+  }
+
+  // Sends as much of data as the socket will take without blocking.
+  // Returns false (and disconnects) if the connection was lost.
+  bool send(const uint8_t *data, size_t size, size_t &sent)
+  {
+    sent = 0;
+    while (sent < size) {
+      const ssize_t result = ::send(fd_, data + sent, size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (result <= 0) {
+        ROS_WARN("swri_profiler: Lost connection to report socket '%s': %s",
+                 path_.c_str(), std::strerror(errno));
+        disconnect();
+        return false;
+      }
+      sent += result;
+    }
+    return true;
+  }
+
+  void drop()
+  {
+    dropped_++;
+    ROS_WARN_THROTTLE(10.0, "swri_profiler: Dropped %llu reports because report socket "
+                      "'%s' is not keeping up.",
+                      static_cast<unsigned long long>(dropped_), path_.c_str());
+  }
+};
+
+// RecordingSink writes the reports to a recording (see
+// recording_format.h).  Recordings don't include metrics.
+class RecordingSink : public ProfilerSink
+{
+ public:
+  bool open(const std::string &path)
+  {
+    if (!writer_.open(path)) {
+      ROS_ERROR("swri_profiler: Failed to open recording '%s': %s",
+                path.c_str(), std::strerror(errno));
+      return false;
+    }
+    ROS_INFO("swri_profiler: Recording to '%s'.", writer_.filename().c_str());
+    return true;
+  }
+
+  virtual void publish(const spm::ProfileIndexArray &index) { writer_.addIndex(index); }
+  virtual void publish(const spm::ProfileDataArray &data) { writer_.addData(data); }
+  virtual void publish(const spm::ProfileMetricArray &)
+  {
+    ROS_WARN_ONCE("swri_profiler: Recordings don't include metrics.  Metrics "
+                  "recorded with SWRI_PROFILER_SINK=record are discarded.");
+  }
+
+ private:
+  RecordingWriter writer_;
+};
+
+std::shared_ptr<ProfilerSink> createSink(const std::string &description)
+{
+  const size_t colon = description.find(':');
+  const std::string kind = description.substr(0, colon);
+  const std::string path = colon == std::string::npos ? "" : description.substr(colon + 1);
+
+  if (kind == "ros" && colon == std::string::npos) {
+    if (!ros::isInitialized()) {
+      ROS_ERROR("swri_profiler: The ros sink requires ros::init().");
+      return std::shared_ptr<ProfilerSink>();
+    }
+    return std::make_shared<RosTopicSink>();
+  } else if (kind == "shm" && colon == std::string::npos) {
+    std::shared_ptr<ShmSink> sink = std::make_shared<ShmSink>();
+    if (!sink->open()) {
+      ROS_ERROR("swri_profiler: Failed to create a shared memory segment.");
+      return std::shared_ptr<ProfilerSink>();
+    }
+    return sink;
+  } else if (kind == "file" && !path.empty()) {
+    std::shared_ptr<FileSink> sink = std::make_shared<FileSink>();
+    if (!sink->open(path)) {
+      return std::shared_ptr<ProfilerSink>();
+    }
+    return sink;
+  } else if (kind == "record" && !path.empty()) {
+    std::shared_ptr<RecordingSink> sink = std::make_shared<RecordingSink>();
+    if (!sink->open(path)) {
+      return std::shared_ptr<ProfilerSink>();
+    }
+    return sink;
+  } else if (kind == "unix") {
+    std::shared_ptr<UnixSocketSink> sink = std::make_shared<UnixSocketSink>(path);
+    if (sink->isValid()) {
+      return sink;
+    }
+  }
+
+  ROS_ERROR("swri_profiler: Invalid sink '%s'.", description.c_str());
+  return std::shared_ptr<ProfilerSink>();
+}
+}  // namespace swri_profiler
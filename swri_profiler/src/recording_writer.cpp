@@ -0,0 +1,272 @@
+#include <swri_profiler/recording_writer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <swri_profiler/histogram.h>
+
+#include <unistd.h>
+
+namespace spm = swri_profiler_msgs;
+
+namespace swri_profiler
+{
+static const double recording_percentiles_[] = { 0.50, 0.90, 0.99, 0.999 };
+static const size_t recording_percentile_count_ = 4;
+
+RecordingWriter::RecordingWriter()
+  :
+  file_(NULL),
+  offset_(0)
+{
+}
+
+RecordingWriter::~RecordingWriter()
+{
+  close();
+}
+
+bool RecordingWriter::open(const std::string &filename)
+{
+  close();
+
+  filename_ = filename;
+  const std::string pid = std::to_string(getpid());
+  size_t pos = filename_.find("%p");
+  while (pos != std::string::npos) {
+    filename_.replace(pos, 2, pid);
+    pos = filename_.find("%p", pos + pid.size());
+  }
+
+  file_ = std::fopen(filename_.c_str(), "wb");
+  if (!file_) {
+    return false;
+  }
+
+  string_ids_.clear();
+  new_strings_.clear();
+  labels_.clear();
+  strings_offsets_.clear();
+  intervals_.clear();
+
+  RecordingFileHeader header;
+  std::memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+  header.version = RECORDING_VERSION;
+  header.reserved = 0;
+  std::fwrite(&header, sizeof(header), 1, file_);
+  std::fflush(file_);
+  offset_ = sizeof(header);
+  return true;
+}
+
+void RecordingWriter::close()
+{
+  if (!file_) {
+    return;
+  }
+
+  writeStrings();
+
+  std::vector<uint8_t> index(sizeof(RecordingIndex) +
+                             strings_offsets_.size() * sizeof(uint64_t) +
+                             intervals_.size() * sizeof(RecordingIndexEntry));
+  RecordingIndex header;
+  header.strings_count = strings_offsets_.size();
+  header.reserved = 0;
+  header.interval_count = intervals_.size();
+  uint8_t *dst = index.data();
+  std::memcpy(dst, &header, sizeof(header));
+  dst += sizeof(header);
+  if (!strings_offsets_.empty()) {
+    std::memcpy(dst, strings_offsets_.data(), strings_offsets_.size() * sizeof(uint64_t));
+    dst += strings_offsets_.size() * sizeof(uint64_t);
+  }
+  if (!intervals_.empty()) {
+    std::memcpy(dst, intervals_.data(), intervals_.size() * sizeof(RecordingIndexEntry));
+  }
+
+  RecordingTrailer trailer;
+  trailer.index_offset = offset_;
+  std::memcpy(trailer.magic, RECORDING_INDEX_MAGIC, sizeof(trailer.magic));
+  writeChunk(RECORDING_CHUNK_INDEX, index.data(), index.size());
+  std::fwrite(&trailer, sizeof(trailer), 1, file_);
+
+  std::fclose(file_);
+  file_ = NULL;
+}
+
+uint32_t RecordingWriter::stringId(const std::string &value)
+{
+  auto const it = string_ids_.find(value);
+  if (it != string_ids_.end()) {
+    return it->second;
+  }
+
+  const uint32_t id = string_ids_.size();
+  string_ids_[value] = id;
+  new_strings_.push_back(value);
+  return id;
+}
+
+void RecordingWriter::writeStrings()
+{
+  if (new_strings_.empty()) {
+    return;
+  }
+
+  std::vector<uint8_t> payload(sizeof(uint32_t));
+  const uint32_t count = new_strings_.size();
+  std::memcpy(payload.data(), &count, sizeof(count));
+  for (auto const &value : new_strings_) {
+    const uint32_t length = value.size();
+    const size_t pos = payload.size();
+    payload.resize(pos + sizeof(length) + length);
+    std::memcpy(&payload[pos], &length, sizeof(length));
+    std::memcpy(&payload[pos + sizeof(length)], value.data(), length);
+  }
+  new_strings_.clear();
+
+  strings_offsets_.push_back(offset_);
+  writeChunk(RECORDING_CHUNK_STRINGS, payload.data(), payload.size());
+}
+
+void RecordingWriter::writeChunk(uint32_t type, const void *data, size_t size)
+{
+  static const uint8_t padding[8] = {0};
+
+  RecordingChunkHeader header;
+  header.type = type;
+  header.size = size;
+  const size_t padded = (size + 7) / 8 * 8;
+
+  std::fwrite(&header, sizeof(header), 1, file_);
+  std::fwrite(data, 1, size, file_);
+  std::fwrite(padding, 1, padded - size, file_);
+  std::fflush(file_);
+  offset_ += sizeof(header) + padded;
+}
+
+void RecordingWriter::addIndex(const spm::ProfileIndexArray &msg)
+{
+  if (!file_) {
+    return;
+  }
+
+  // A full index replaces what we know about the node (e.g. because
+  // it restarted).  Otherwise it adds new blocks.
+  std::map<uint32_t, uint32_t> &labels = labels_[msg.header.frame_id];
+  if (msg.full || msg.sequence == 0) {
+    labels.clear();
+  }
+  for (auto const &item : msg.data) {
+    labels[item.key] = stringId(item.label);
+  }
+}
+
+bool RecordingWriter::addData(const spm::ProfileDataArray &msg)
+{
+  if (!file_) {
+    return false;
+  }
+
+  RecordingInterval interval;
+  std::memset(&interval, 0, sizeof(interval));
+  interval.wall_stamp_ns = msg.header.stamp.toNSec();
+  interval.ros_stamp_ns = msg.rostime_stamp.toNSec();
+  interval.period_ns = msg.report_period.toNSec();
+  // Publishers that predate the report_period field always reported
+  // once per second.
+  if (interval.period_ns == 0) {
+    interval.period_ns = 1000000000;
+  }
+  interval.node = stringId(msg.header.frame_id);
+  interval.compiled_categories = msg.compiled_categories;
+  interval.compiled_level = msg.compiled_level;
+  interval.keyframe = msg.keyframe;
+
+  std::map<int, size_t> histograms;
+  for (size_t i = 0; i < msg.histograms.size(); i++) {
+    histograms[msg.histograms[i].key] = i;
+  }
+
+  // The rows are gathered first since blocks that are missing from
+  // the index are skipped.
+  const std::map<uint32_t, uint32_t> &labels = labels_[msg.header.frame_id];
+  std::vector<size_t> rows;
+  std::vector<uint32_t> row_labels;
+  rows.reserve(msg.data.size());
+  row_labels.reserve(msg.data.size());
+  for (size_t i = 0; i < msg.data.size(); i++) {
+    auto const it = labels.find(msg.data[i].key);
+    if (it != labels.end()) {
+      rows.push_back(i);
+      row_labels.push_back(it->second);
+    }
+  }
+  interval.count = rows.size();
+
+  const size_t count = rows.size();
+  columns_.assign(RECORDING_COLUMN_COUNT * count, 0);
+  const HistogramDecoder decoder(msg.histogram_sub_bucket_bits, msg.histogram_ns_per_unit);
+  uint64_t *columns = columns_.data();
+  for (size_t r = 0; r < count; r++) {
+    const spm::ProfileData &item = msg.data[rows[r]];
+
+    uint64_t percentiles_ns[recording_percentile_count_] = {0, 0, 0, 0};
+    double variation = 0.0;
+    auto const hist_it = histograms.find(item.key);
+    if (hist_it != histograms.end()) {
+      const spm::ProfileHistogram &histogram = msg.histograms[hist_it->second];
+      decoder.percentiles(percentiles_ns, recording_percentiles_, recording_percentile_count_,
+                          histogram.buckets, histogram.counts);
+      variation = decoder.variation(histogram.buckets, histogram.counts);
+    }
+
+    // The relative standard error of a total estimated from n of the
+    // calls, including the finite population correction.  If no
+    // calls were timed, the estimate came from earlier data and we
+    // consider it completely uncertain.
+    const uint32_t sample_period = std::max<uint32_t>(1, item.sample_period);
+    double error = 0.0;
+    if (sample_period > 1) {
+      const double n = item.rel_timed_count;
+      const double f = 1.0 / sample_period;
+      error = n > 0 ? variation * std::sqrt((1.0 - f) / n) : 1.0;
+    }
+
+    columns[RECORDING_COLUMN_LABEL*count + r] = row_labels[r];
+    columns[RECORDING_COLUMN_CUMULATIVE_CALL_COUNT*count + r] = item.abs_call_count;
+    columns[RECORDING_COLUMN_CUMULATIVE_DURATION*count + r] = item.abs_total_duration.toNSec();
+    columns[RECORDING_COLUMN_DURATION*count + r] = item.rel_total_duration.toNSec();
+    columns[RECORDING_COLUMN_MAX_DURATION*count + r] = item.rel_max_duration.toNSec();
+    columns[RECORDING_COLUMN_P50_DURATION*count + r] = percentiles_ns[0];
+    columns[RECORDING_COLUMN_P90_DURATION*count + r] = percentiles_ns[1];
+    columns[RECORDING_COLUMN_P99_DURATION*count + r] = percentiles_ns[2];
+    columns[RECORDING_COLUMN_P999_DURATION*count + r] = percentiles_ns[3];
+    columns[RECORDING_COLUMN_CPU_DURATION*count + r] = item.rel_cpu_duration.toNSec();
+    columns[RECORDING_COLUMN_ALLOC_COUNT*count + r] = item.rel_alloc_count;
+    columns[RECORDING_COLUMN_ALLOC_BYTES*count + r] = item.rel_alloc_bytes;
+    columns[RECORDING_COLUMN_SAMPLE_PERIOD*count + r] = sample_period;
+    std::memcpy(&columns[RECORDING_COLUMN_DURATION_ERROR*count + r], &error, sizeof(error));
+  }
+
+  // New strings must be written before the interval that uses them.
+  writeStrings();
+
+  std::vector<uint8_t> payload(sizeof(interval) + columns_.size() * sizeof(uint64_t));
+  std::memcpy(payload.data(), &interval, sizeof(interval));
+  if (!columns_.empty()) {
+    std::memcpy(payload.data() + sizeof(interval), columns_.data(),
+                columns_.size() * sizeof(uint64_t));
+  }
+
+  RecordingIndexEntry entry;
+  entry.wall_stamp_ns = interval.wall_stamp_ns;
+  entry.offset = offset_;
+  intervals_.push_back(entry);
+  writeChunk(RECORDING_CHUNK_INTERVAL, payload.data(), payload.size());
+
+  return rows.size() == msg.data.size();
+}
+}  // namespace swri_profiler
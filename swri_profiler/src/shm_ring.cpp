@@ -0,0 +1,266 @@
+#include <swri_profiler/shm_ring.h>
+
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace swri_profiler
+{
+// The ring's positions are shared between processes, which only
+// works if the atomics don't need a lock.
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "ShmRing requires lock-free 64-bit atomics");
+
+static const uint32_t shm_magic_ = 0x53505231;  // "SPR1"
+static const uint32_t shm_version_ = 1;
+static const char shm_prefix_[] = "swri_profiler.";
+static const uint32_t shm_padding_ = 0;
+
+// The segment starts with a ShmRingHeader, followed by the records.
+// Positions count bytes written since the segment was created, so
+// the ring is empty when they are equal.  magic is written last
+// when the segment is created, so a reader never sees a partially
+// initialized header.
+struct ShmRingHeader
+{
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  int32_t pid;
+  uint32_t reserved;
+  uint64_t capacity;
+  std::atomic<uint64_t> write_pos;
+  std::atomic<uint64_t> read_pos;
+  std::atomic<uint64_t> dropped;
+};
+
+// Every record starts with a RecordHeader and is padded to a
+// multiple of 8 bytes.  A record never wraps around the end of the
+// ring.  If it doesn't fit, the rest of the ring is filled with a
+// padding record and the record starts at the beginning.
+struct RecordHeader
+{
+  uint32_t type;
+  uint32_t size;
+};
+
+static size_t headerSize()
+{
+  return (sizeof(ShmRingHeader) + 63) / 64 * 64;
+}
+
+static uint64_t recordSize(uint64_t size)
+{
+  return (sizeof(RecordHeader) + size + 7) / 8 * 8;
+}
+
+ShmRing::ShmRing()
+  :
+  header_(NULL),
+  records_(NULL),
+  mapped_size_(0),
+  pending_pos_(0),
+  pending_size_(0)
+{
+}
+
+ShmRing::~ShmRing()
+{
+  close();
+}
+
+bool ShmRing::map(int fd, size_t size)
+{
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  header_ = static_cast<ShmRingHeader*>(addr);
+  records_ = static_cast<uint8_t*>(addr) + headerSize();
+  mapped_size_ = size;
+  return true;
+}
+
+bool ShmRing::create(size_t capacity)
+{
+  close();
+
+  capacity = (capacity + 7) / 8 * 8;
+  const std::string name = "/" + std::string(shm_prefix_) + std::to_string(getpid());
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  const size_t size = headerSize() + capacity;
+  if (ftruncate(fd, size) != 0 || !map(fd, size)) {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  name_ = name;
+  header_->version = shm_version_;
+  header_->pid = getpid();
+  header_->capacity = capacity;
+  header_->write_pos.store(0, std::memory_order_relaxed);
+  header_->read_pos.store(0, std::memory_order_relaxed);
+  header_->dropped.store(0, std::memory_order_relaxed);
+  header_->magic.store(shm_magic_, std::memory_order_release);
+  return true;
+}
+
+bool ShmRing::open(const std::string &name)
+{
+  close();
+
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < headerSize()) {
+    ::close(fd);
+    return false;
+  }
+
+  if (!map(fd, st.st_size)) {
+    return false;
+  }
+
+  if (header_->magic.load(std::memory_order_acquire) != shm_magic_ ||
+      header_->version != shm_version_ ||
+      header_->capacity != mapped_size_ - headerSize()) {
+    close();
+    return false;
+  }
+
+  name_ = name;
+  return true;
+}
+
+void ShmRing::close()
+{
+  if (header_) {
+    munmap(header_, mapped_size_);
+  }
+  name_.clear();
+  header_ = NULL;
+  records_ = NULL;
+  mapped_size_ = 0;
+}
+
+uint8_t* ShmRing::reserve(size_t size)
+{
+  const uint64_t capacity = header_->capacity;
+  const uint64_t total = recordSize(size);
+  const uint64_t write_pos = header_->write_pos.load(std::memory_order_relaxed);
+  const uint64_t read_pos = header_->read_pos.load(std::memory_order_acquire);
+
+  const uint64_t offset = write_pos % capacity;
+  const uint64_t padding = capacity - offset < total ? capacity - offset : 0;
+  if (size > UINT32_MAX || write_pos - read_pos + padding + total > capacity) {
+    header_->dropped.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+
+  // The padding isn't visible to the reader until the record is
+  // committed.
+  if (padding) {
+    RecordHeader *pad = reinterpret_cast<RecordHeader*>(records_ + offset);
+    pad->type = shm_padding_;
+    pad->size = padding - sizeof(RecordHeader);
+  }
+
+  pending_pos_ = write_pos + padding;
+  pending_size_ = size;
+  return records_ + pending_pos_ % capacity + sizeof(RecordHeader);
+}
+
+void ShmRing::commit(uint32_t type)
+{
+  RecordHeader *record = reinterpret_cast<RecordHeader*>(
+    records_ + pending_pos_ % header_->capacity);
+  record->type = type;
+  record->size = pending_size_;
+  header_->write_pos.store(pending_pos_ + recordSize(pending_size_), std::memory_order_release);
+}
+
+bool ShmRing::peek(Record &record)
+{
+  const uint64_t capacity = header_->capacity;
+  uint64_t read_pos = header_->read_pos.load(std::memory_order_relaxed);
+  const uint64_t write_pos = header_->write_pos.load(std::memory_order_acquire);
+
+  while (read_pos != write_pos) {
+    const uint64_t offset = read_pos % capacity;
+    const RecordHeader *header = reinterpret_cast<const RecordHeader*>(records_ + offset);
+    // The writer is another process, so we don't trust it to stay
+    // inside the ring.  A bad record discards everything written so
+    // far.
+    if (recordSize(header->size) > capacity - offset ||
+        recordSize(header->size) > write_pos - read_pos) {
+      header_->read_pos.store(write_pos, std::memory_order_release);
+      return false;
+    }
+
+    if (header->type == shm_padding_) {
+      read_pos += recordSize(header->size);
+      header_->read_pos.store(read_pos, std::memory_order_release);
+      continue;
+    }
+
+    record.type = header->type;
+    record.data = records_ + offset + sizeof(RecordHeader);
+    record.size = header->size;
+    return true;
+  }
+
+  return false;
+}
+
+void ShmRing::consume()
+{
+  const uint64_t read_pos = header_->read_pos.load(std::memory_order_relaxed);
+  const RecordHeader *header = reinterpret_cast<const RecordHeader*>(
+    records_ + read_pos % header_->capacity);
+  header_->read_pos.store(read_pos + recordSize(header->size), std::memory_order_release);
+}
+
+int ShmRing::pid() const
+{
+  return header_->pid;
+}
+
+uint64_t ShmRing::takeDropped()
+{
+  return header_->dropped.exchange(0, std::memory_order_relaxed);
+}
+
+std::vector<std::string> ShmRing::listSegments()
+{
+  std::vector<std::string> names;
+  DIR *dir = opendir("/dev/shm");
+  if (!dir) {
+    return names;
+  }
+
+  while (dirent *entry = readdir(dir)) {
+    if (std::strncmp(entry->d_name, shm_prefix_, sizeof(shm_prefix_) - 1) == 0) {
+      names.push_back("/" + std::string(entry->d_name));
+    }
+  }
+  closedir(dir);
+  return names;
+}
+
+void ShmRing::unlink(const std::string &name)
+{
+  shm_unlink(name.c_str());
+}
+}  // namespace swri_profiler
@@ -0,0 +1,151 @@
+#include <swri_profiler/trace_writer.h>
+
+#include <unistd.h>
+
+namespace swri_profiler
+{
+// Trace timestamps are in microseconds.  Absolute timestamps have
+// too many digits to format through a double without losing
+// sub-microsecond precision, so we format the integer and fractional
+// parts separately.
+static void writeMicroseconds(FILE *file, int64_t ns)
+{
+  if (ns < 0) {
+    std::fputc('-', file);
+    ns = -ns;
+  }
+  std::fprintf(file, "%lld.%03lld",
+               static_cast<long long>(ns / 1000),
+               static_cast<long long>(ns % 1000));
+}
+
+TraceWriter::TraceWriter()
+  :
+  file_(NULL),
+  pid_(getpid())
+{
+}
+
+bool TraceWriter::open(const std::string &filename)
+{
+  if (file_) {
+    std::fclose(file_);
+    file_ = NULL;
+  }
+
+  filename_ = filename;
+  const std::string pid = std::to_string(pid_);
+  size_t pos = filename_.find("%p");
+  while (pos != std::string::npos) {
+    filename_.replace(pos, 2, pid);
+    pos = filename_.find("%p", pos + pid.size());
+  }
+
+  file_ = std::fopen(filename_.c_str(), "w");
+  if (!file_) {
+    return false;
+  }
+
+  std::fputs("[\n", file_);
+  return true;
+}
+
+void TraceWriter::close(const std::string &process_name)
+{
+  if (!file_) {
+    return;
+  }
+
+  // Terminate the array with an event so that we don't have to
+  // track whether a trailing comma was written.
+  std::fprintf(file_,
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+               "\"args\":{\"name\":",
+               pid_);
+  writeString(process_name);
+  std::fputs("}}\n]\n", file_);
+  std::fclose(file_);
+  file_ = NULL;
+}
+
+void TraceWriter::writeString(const std::string &value)
+{
+  std::fputc('"', file_);
+  for (const char c : value) {
+    switch (c) {
+    case '"':
+      std::fputs("\\\"", file_);
+      break;
+    case '\\':
+      std::fputs("\\\\", file_);
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        std::fprintf(file_, "\\u%04x", c);
+      } else {
+        std::fputc(c, file_);
+      }
+    }
+  }
+  std::fputc('"', file_);
+}
+
+void TraceWriter::writeThreadName(int tid, const std::string &name)
+{
+  if (!file_) {
+    return;
+  }
+
+  std::fprintf(file_,
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+               "\"args\":{\"name\":",
+               pid_, tid);
+  writeString(name);
+  std::fputs("}},\n", file_);
+}
+
+void TraceWriter::writeEvent(const std::string &name,
+                             const std::string &path,
+                             int tid,
+                             int64_t start_ns,
+                             int64_t duration_ns)
+{
+  if (!file_) {
+    return;
+  }
+
+  std::fputs("{\"name\":", file_);
+  writeString(name);
+  std::fprintf(file_,
+               ",\"cat\":\"swri_profiler\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":",
+               pid_, tid);
+  writeMicroseconds(file_, start_ns);
+  std::fputs(",\"dur\":", file_);
+  writeMicroseconds(file_, duration_ns);
+  std::fputs(",\"args\":{\"path\":", file_);
+  writeString(path);
+  std::fputs("}},\n", file_);
+}
+
+void TraceWriter::writeDropped(int tid, int64_t stamp_ns, uint64_t count)
+{
+  if (!file_) {
+    return;
+  }
+
+  std::fprintf(file_,
+               "{\"name\":\"swri_profiler: trace buffer full\",\"ph\":\"i\",\"s\":\"t\","
+               "\"pid\":%d,\"tid\":%d,\"ts\":",
+               pid_, tid);
+  writeMicroseconds(file_, stamp_ns);
+  std::fprintf(file_, ",\"args\":{\"dropped_events\":%llu}},\n",
+               static_cast<unsigned long long>(count));
+}
+
+void TraceWriter::flush()
+{
+  if (file_) {
+    std::fflush(file_);
+  }
+}
+}  // namespace swri_profiler
@@ -0,0 +1,195 @@
+#include <swri_profiler/tree_aggregator.h>
+
+#include <algorithm>
+
+namespace spm = swri_profiler_msgs;
+
+namespace swri_profiler
+{
+// Returns a path with a leading slash, no trailing slash, and no
+// empty components (e.g. "//a/b/" becomes "/a/b").
+static std::string normalizePath(const std::string &path)
+{
+  std::string result;
+  size_t begin = 0;
+  while (begin < path.size()) {
+    size_t end = path.find('/', begin);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    if (end > begin) {
+      result += "/" + path.substr(begin, end - begin);
+    }
+    begin = end + 1;
+  }
+  return result;
+}
+
+TreeAggregator::TreeAggregator()
+  :
+  tree_changed_(false)
+{
+}
+
+void TreeAggregator::addIndex(const spm::ProfileIndexArray &msg)
+{
+  // See ProfilerMsgAdapter::processIndex.  A full index replaces what
+  // we know about the node (e.g. because it restarted), and a gap in
+  // the sequence means we missed some blocks.
+  Source &source = sources_[msg.header.frame_id];
+  const bool full = msg.full || msg.sequence == 0;
+  if (full && (msg.sequence <= 1 || msg.sequence >= source.index_sequence)) {
+    source.tree_nodes.clear();
+    if (msg.sequence <= 1) {
+      source.call_counts.clear();
+    }
+    source.incomplete_index = false;
+    source.index_sequence = msg.sequence;
+  } else if (!full && msg.sequence > source.index_sequence + 1) {
+    source.incomplete_index = true;
+  }
+  source.index_sequence = std::max(source.index_sequence, msg.sequence);
+
+  const std::string node_name = normalizePath(msg.header.frame_id);
+  for (auto const &item : msg.data) {
+    // Labels are relative to the node unless they already start with
+    // its name, as in the viewers.
+    std::string path = normalizePath(item.label);
+    if (path.compare(0, node_name.size(), node_name) != 0) {
+      path = node_name + path;
+    }
+    const int id = touchNode(path);
+    nodes_[id].measured = true;
+    source.tree_nodes[item.key] = id;
+  }
+}
+
+bool TreeAggregator::addData(const spm::ProfileDataArray &msg)
+{
+  Source &source = sources_[msg.header.frame_id];
+  bool missing = false;
+  for (auto const &item : msg.data) {
+    auto const it = source.tree_nodes.find(item.key);
+    if (it == source.tree_nodes.end()) {
+      missing = true;
+      continue;
+    }
+
+    // The reports only have the total call count.  The first time we
+    // see a block, its calls are only new if they all fall in this
+    // report.  Otherwise we joined late, and we can't tell which of
+    // the calls the report's time belongs to, so the block is skipped
+    // until its next report.  If the count went down, the node
+    // restarted.
+    uint64_t calls = 0;
+    auto const count_it = source.call_counts.find(item.key);
+    if (count_it == source.call_counts.end()) {
+      source.call_counts[item.key] = item.abs_call_count;
+      if (item.abs_total_duration > item.rel_total_duration) {
+        continue;
+      }
+      calls = item.abs_call_count;
+    } else if (item.abs_call_count >= count_it->second) {
+      calls = item.abs_call_count - count_it->second;
+    } else {
+      calls = item.abs_call_count;
+    }
+    source.call_counts[item.key] = item.abs_call_count;
+
+    TreeNode &node = nodes_[it->second];
+    node.call_count += calls;
+    node.inclusive_ns += item.rel_total_duration.toNSec();
+    node.max_ns = std::max<uint64_t>(node.max_ns, item.rel_max_duration.toNSec());
+  }
+
+  return !missing && !source.incomplete_index;
+}
+
+bool TreeAggregator::takeTree(spm::ProfileTree &tree)
+{
+  if (!tree_changed_) {
+    return false;
+  }
+  tree_.revision++;
+  tree_changed_ = false;
+  tree = tree_;
+  return true;
+}
+
+bool TreeAggregator::takeData(spm::ProfileTreeData &msg)
+{
+  // Fill in the tree nodes that aren't blocks and derive the
+  // exclusive times.  Children come after their parents, so we visit
+  // them first by going backwards.
+  std::vector<uint64_t> children_calls(nodes_.size(), 0);
+  std::vector<uint64_t> children_ns(nodes_.size(), 0);
+  std::vector<uint64_t> children_max_ns(nodes_.size(), 0);
+  std::vector<uint64_t> exclusive_ns(nodes_.size(), 0);
+  for (size_t i = nodes_.size(); i-- > 0; ) {
+    TreeNode &node = nodes_[i];
+    if (!node.measured) {
+      node.call_count = children_calls[i];
+      node.inclusive_ns = children_ns[i];
+      node.max_ns = children_max_ns[i];
+    }
+    exclusive_ns[i] = node.inclusive_ns > children_ns[i] ? node.inclusive_ns - children_ns[i] : 0;
+
+    if (node.parent >= 0) {
+      children_calls[node.parent] += node.call_count;
+      children_ns[node.parent] += node.inclusive_ns;
+      children_max_ns[node.parent] = std::max(children_max_ns[node.parent], node.max_ns);
+    }
+  }
+
+  msg.tree_revision = tree_.revision;
+  msg.nodes.clear();
+  msg.rel_call_counts.clear();
+  msg.rel_inclusive_ns.clear();
+  msg.rel_exclusive_ns.clear();
+  msg.rel_max_ns.clear();
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    TreeNode &node = nodes_[i];
+    if (node.call_count || node.inclusive_ns) {
+      msg.nodes.push_back(i);
+      msg.rel_call_counts.push_back(node.call_count);
+      msg.rel_inclusive_ns.push_back(node.inclusive_ns);
+      msg.rel_exclusive_ns.push_back(exclusive_ns[i]);
+      msg.rel_max_ns.push_back(node.max_ns);
+    }
+    node.call_count = 0;
+    node.inclusive_ns = 0;
+    node.max_ns = 0;
+  }
+
+  return !msg.nodes.empty();
+}
+
+int TreeAggregator::touchNode(const std::string &path)
+{
+  auto const it = node_ids_.find(path);
+  if (it != node_ids_.end()) {
+    return it->second;
+  }
+
+  int parent = -1;
+  const size_t slash = path.rfind('/');
+  if (slash != std::string::npos && slash > 0) {
+    parent = touchNode(path.substr(0, slash));
+  }
+
+  TreeNode node;
+  node.parent = parent;
+  node.measured = false;
+  node.call_count = 0;
+  node.inclusive_ns = 0;
+  node.max_ns = 0;
+
+  const int id = nodes_.size();
+  nodes_.push_back(node);
+  node_ids_[path] = id;
+  tree_.paths.push_back(path);
+  tree_.parents.push_back(parent);
+  tree_changed_ = true;
+  return id;
+}
+}  // namespace swri_profiler
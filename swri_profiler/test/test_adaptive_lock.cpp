@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <swri_profiler/adaptive_lock.h>
+
+using swri_profiler::AdaptiveLock;
+using swri_profiler::AdaptiveLockGuard;
+using swri_profiler::LockWaitStats;
+
+TEST(AdaptiveLock, UncontendedLockDoesNotWait)
+{
+  AdaptiveLock::takeWaitStats();
+  AdaptiveLock lock;
+  for (int i = 0; i < 1000; i++) {
+    AdaptiveLockGuard guard(lock);
+  }
+
+  const LockWaitStats stats = AdaptiveLock::takeWaitStats();
+  EXPECT_EQ(0u, stats.waits);
+  EXPECT_EQ(0u, stats.sleeps);
+  EXPECT_EQ(0, stats.wait_ns);
+}
+
+// Every increment is made under the lock, so none are lost, whether
+// the waiting threads spin or sleep.
+TEST(AdaptiveLock, ContendedLockIsExclusive)
+{
+  const int thread_count = 8;
+  const int increments = 100000;
+
+  AdaptiveLock::takeWaitStats();
+  AdaptiveLock lock;
+  int64_t counter = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&lock, &counter, increments]() {
+        for (int i = 0; i < increments; i++) {
+          AdaptiveLockGuard guard(lock);
+          counter++;
+        }
+      });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(static_cast<int64_t>(thread_count) * increments, counter);
+
+  // The counts are consistent, and taking them resets them.
+  const LockWaitStats stats = AdaptiveLock::takeWaitStats();
+  EXPECT_LE(stats.sleeps, stats.waits);
+  EXPECT_LE(stats.max_wait_ns, stats.wait_ns);
+  const LockWaitStats reset = AdaptiveLock::takeWaitStats();
+  EXPECT_EQ(0u, reset.waits);
+  EXPECT_EQ(0u, reset.sleeps);
+  EXPECT_EQ(0, reset.wait_ns);
+  EXPECT_EQ(0, reset.max_wait_ns);
+}
+
+// The waits of the thread that called ignoreWaitsOfThisThread() are
+// not counted.  This runs last since it can't be undone.
+TEST(AdaptiveLock, IgnoredThreadIsNotCounted)
+{
+  AdaptiveLock lock;
+  lock.acquire();
+  std::thread waiter([&lock]() {
+      AdaptiveLock::ignoreWaitsOfThisThread();
+      AdaptiveLockGuard guard(lock);
+    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  AdaptiveLock::takeWaitStats();
+  lock.release();
+  waiter.join();
+
+  EXPECT_EQ(0u, AdaptiveLock::takeWaitStats().waits);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <swri_profiler/histogram.h>
+
+using swri_profiler::HistogramDecoder;
+using swri_profiler::LatencyHistogram;
+
+TEST(LatencyHistogram, SmallValuesHaveTheirOwnBucket)
+{
+  for (int value = 0; value < 2*LatencyHistogram::SUB_BUCKET_COUNT; value++) {
+    EXPECT_EQ(value, LatencyHistogram::bucketIndex(value));
+    EXPECT_EQ(static_cast<uint64_t>(value), LatencyHistogram::bucketLowerBound(value));
+  }
+}
+
+TEST(LatencyHistogram, BucketsContainTheirValues)
+{
+  for (uint64_t value = 1; value < (1ULL << LatencyHistogram::MAX_EXPONENT); value = value*3/2 + 1) {
+    const int index = LatencyHistogram::bucketIndex(value);
+    EXPECT_LE(LatencyHistogram::bucketLowerBound(index), value);
+    EXPECT_GT(LatencyHistogram::bucketLowerBound(index+1), value);
+  }
+}
+
+TEST(LatencyHistogram, BucketWidthIsBounded)
+{
+  for (int index = 2*LatencyHistogram::SUB_BUCKET_COUNT;
+       index < LatencyHistogram::BUCKET_COUNT - 1;
+       index++) {
+    const uint64_t lower = LatencyHistogram::bucketLowerBound(index);
+    const uint64_t upper = LatencyHistogram::bucketLowerBound(index+1);
+    EXPECT_GT(upper, lower);
+    EXPECT_LE((upper - lower) * LatencyHistogram::SUB_BUCKET_COUNT, lower);
+  }
+}
+
+TEST(LatencyHistogram, LargeValuesGoInTheLastBucket)
+{
+  EXPECT_EQ(LatencyHistogram::BUCKET_COUNT - 1,
+            LatencyHistogram::bucketIndex(1ULL << LatencyHistogram::MAX_EXPONENT));
+  EXPECT_EQ(LatencyHistogram::BUCKET_COUNT - 1,
+            LatencyHistogram::bucketIndex(~0ULL));
+}
+
+TEST(LatencyHistogram, AddMergeClear)
+{
+  LatencyHistogram a;
+  LatencyHistogram b;
+  a.add(3);
+  a.add(1000);
+  b.add(3);
+
+  a.merge(b);
+  EXPECT_EQ(2u, a.count(LatencyHistogram::bucketIndex(3)));
+  EXPECT_EQ(1u, a.count(LatencyHistogram::bucketIndex(1000)));
+  EXPECT_EQ(1u, b.count(LatencyHistogram::bucketIndex(3)));
+
+  a.clear();
+  for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; i++) {
+    EXPECT_EQ(0u, a.count(i));
+  }
+}
+
+TEST(HistogramDecoder, MatchesLatencyHistogramBuckets)
+{
+  const HistogramDecoder decoder(LatencyHistogram::SUB_BUCKET_BITS, 1.0);
+  for (int index = 0; index < LatencyHistogram::BUCKET_COUNT; index++) {
+    EXPECT_EQ(static_cast<double>(LatencyHistogram::bucketLowerBound(index)),
+              decoder.bucketLowerBound(index));
+  }
+}
+
+TEST(HistogramDecoder, Percentiles)
+{
+  // 100 values in bucket 10 and 100 in bucket 20, scaled to
+  // nanoseconds.
+  const HistogramDecoder decoder(LatencyHistogram::SUB_BUCKET_BITS, 2.0);
+  const std::vector<uint16_t> buckets = { 10, 20 };
+  const std::vector<uint32_t> counts = { 100, 100 };
+  const double percentiles[] = { 0.25, 0.50, 0.75, 1.0 };
+  uint64_t values[4];
+  decoder.percentiles(values, percentiles, 4, buckets, counts);
+  EXPECT_EQ(21u, values[0]);
+  EXPECT_EQ(22u, values[1]);
+  EXPECT_EQ(41u, values[2]);
+  EXPECT_EQ(42u, values[3]);
+
+  const double mean = (10.5 + 20.5) / 2.0;
+  const double deviation = std::sqrt(200 * 5.0 * 5.0 / 199.0);
+  EXPECT_NEAR(deviation / mean, decoder.variation(buckets, counts), 1e-9);
+}
+
+TEST(HistogramDecoder, EmptyHistogram)
+{
+  const HistogramDecoder decoder(LatencyHistogram::SUB_BUCKET_BITS, 1.0);
+  const std::vector<uint16_t> buckets;
+  const std::vector<uint32_t> counts;
+  const double percentiles[] = { 0.5 };
+  uint64_t values[1] = { 7 };
+  decoder.percentiles(values, percentiles, 1, buckets, counts);
+  EXPECT_EQ(0u, values[0]);
+  EXPECT_EQ(0.0, decoder.variation(buckets, counts));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
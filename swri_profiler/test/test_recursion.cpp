@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <map>
+#include <string>
+
+#include <swri_profiler/profiler.h>
+#include <swri_profiler/profiler_sink.h>
+
+namespace spm = swri_profiler_msgs;
+using swri_profiler::Profiler;
+
+// The labels and the totals of every block that was reported.
+static std::map<uint32_t, std::string> labels_;
+static std::map<std::string, spm::ProfileData> data_;
+
+static void handleIndex(const spm::ProfileIndexArray &msg)
+{
+  for (auto const &item : msg.data) {
+    labels_[item.key] = item.label;
+  }
+}
+
+static void handleData(const spm::ProfileDataArray &msg)
+{
+  for (auto const &item : msg.data) {
+    spm::ProfileData &data = data_[labels_[item.key]];
+    const uint64_t recursive_count = data.rel_recursive_count;
+    data = item;
+    data.rel_recursive_count += recursive_count;
+  }
+}
+
+static void recurse(int depth)
+{
+  SWRI_PROFILE("recurse");
+  if (depth > 0) {
+    recurse(depth - 1);
+  } else {
+    SWRI_PROFILE("leaf");
+  }
+}
+
+TEST(Recursion, NestedCallsAreCollapsed)
+{
+  Profiler::addSink(std::make_shared<swri_profiler::CallbackSink>(&handleIndex, &handleData));
+  Profiler::startCollector();
+  for (int i = 0; i < 3; i++) {
+    SWRI_PROFILE("outer");
+    recurse(4);
+  }
+  Profiler::stopCollector();
+
+  ASSERT_EQ(1u, data_.count("/outer/recurse"));
+  EXPECT_EQ(0u, data_.count("/outer/recurse/recurse"));
+  const spm::ProfileData &recursive = data_["/outer/recurse"];
+  EXPECT_EQ(3u, recursive.abs_call_count);
+  EXPECT_EQ(12u, recursive.rel_recursive_count);
+
+  // Other blocks opened inside the recursion are still its children.
+  ASSERT_EQ(1u, data_.count("/outer/recurse/leaf"));
+  EXPECT_EQ(3u, data_["/outer/recurse/leaf"].abs_call_count);
+  EXPECT_EQ(3u, data_["/outer"].abs_call_count);
+}
+
+int main(int argc, char **argv)
+{
+  // The settings are loaded when the profiler is initialized.
+  setenv("SWRI_PROFILER_COLLAPSE_RECURSION", "1", 1);
+  Profiler::initializeOffline();
+
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
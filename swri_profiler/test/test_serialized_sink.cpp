@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <ros/serialization.h>
+#include <swri_profiler/profiler_sink.h>
+
+namespace spm = swri_profiler_msgs;
+
+// Keeps the type and contents of every report it writes, and drops
+// reports while full_ is set, like a full shared memory segment.
+class TestSink : public swri_profiler::SerializedSink
+{
+ public:
+  struct Frame
+  {
+    swri_profiler::ReportType type;
+    std::vector<uint8_t> data;
+  };
+
+  TestSink() : full_(false) {}
+
+  bool full_;
+  std::vector<Frame> frames_;
+
+  // Like a listener connecting to a Unix socket sink.
+  void connect() { resendIndex(); }
+
+  spm::ProfileIndexArray index(size_t i)
+  {
+    spm::ProfileIndexArray msg;
+    ros::serialization::IStream stream(frames_[i].data.data(), frames_[i].data.size());
+    ros::serialization::deserialize(stream, msg);
+    return msg;
+  }
+
+ protected:
+  virtual uint8_t* reserve(swri_profiler::ReportType type, size_t size)
+  {
+    if (full_) {
+      return NULL;
+    }
+    frames_.push_back(Frame{type, std::vector<uint8_t>(size)});
+    return frames_.back().data.data();
+  }
+
+  virtual bool commit() { return true; }
+};
+
+static spm::ProfileIndexArray makeIndex(uint32_t sequence, uint32_t first_key, size_t count)
+{
+  spm::ProfileIndexArray msg;
+  msg.sequence = sequence;
+  msg.full = sequence == 1;
+  for (size_t i = 0; i < count; i++) {
+    msg.data.emplace_back();
+    msg.data.back().key = first_key + i;
+    msg.data.back().label = "/block" + std::to_string(first_key + i);
+  }
+  return msg;
+}
+
+TEST(SerializedSink, IncrementalIndexIsWrittenAsIs)
+{
+  TestSink sink;
+  sink.publish(makeIndex(1, 1, 2));
+  sink.publish(makeIndex(2, 3, 1));
+
+  ASSERT_EQ(2u, sink.frames_.size());
+  EXPECT_EQ(swri_profiler::REPORT_INDEX, sink.frames_[1].type);
+  const spm::ProfileIndexArray msg = sink.index(1);
+  EXPECT_FALSE(msg.full);
+  ASSERT_EQ(1u, msg.data.size());
+  EXPECT_EQ(3u, msg.data[0].key);
+}
+
+TEST(SerializedSink, DroppedIndexIsReplacedByFullIndex)
+{
+  TestSink sink;
+  sink.publish(makeIndex(1, 1, 2));
+  sink.full_ = true;
+  sink.publish(makeIndex(2, 3, 1));
+  sink.publish(spm::ProfileDataArray());
+  sink.full_ = false;
+
+  // The full index is written before the next data, which isn't
+  // dropped.
+  sink.publish(spm::ProfileDataArray());
+  ASSERT_EQ(3u, sink.frames_.size());
+  EXPECT_EQ(swri_profiler::REPORT_INDEX, sink.frames_[1].type);
+  EXPECT_EQ(swri_profiler::REPORT_DATA, sink.frames_[2].type);
+
+  const spm::ProfileIndexArray msg = sink.index(1);
+  EXPECT_TRUE(msg.full);
+  EXPECT_EQ(2u, msg.sequence);
+  ASSERT_EQ(3u, msg.data.size());
+  for (size_t i = 0; i < msg.data.size(); i++) {
+    EXPECT_EQ(i + 1, msg.data[i].key);
+  }
+
+  // Then indices are incremental again.
+  sink.publish(makeIndex(3, 4, 1));
+  ASSERT_EQ(4u, sink.frames_.size());
+  EXPECT_FALSE(sink.index(3).full);
+}
+
+TEST(SerializedSink, FullIndexIncludesIndicesPublishedWhileDropping)
+{
+  TestSink sink;
+  sink.full_ = true;
+  sink.publish(makeIndex(1, 1, 1));
+  sink.publish(makeIndex(2, 2, 1));
+  sink.full_ = false;
+  sink.publish(makeIndex(3, 3, 1));
+
+  ASSERT_EQ(1u, sink.frames_.size());
+  const spm::ProfileIndexArray msg = sink.index(0);
+  EXPECT_TRUE(msg.full);
+  EXPECT_EQ(3u, msg.sequence);
+  EXPECT_EQ(3u, msg.data.size());
+}
+
+TEST(SerializedSink, ResentIndexIsFull)
+{
+  TestSink sink;
+  // There is nothing to resend before the first index.
+  sink.connect();
+  sink.publish(spm::ProfileDataArray());
+  ASSERT_EQ(1u, sink.frames_.size());
+  EXPECT_EQ(swri_profiler::REPORT_DATA, sink.frames_[0].type);
+
+  sink.publish(makeIndex(1, 1, 1));
+  sink.publish(makeIndex(2, 2, 1));
+  sink.connect();
+  sink.publish(spm::ProfileMetricArray());
+
+  ASSERT_EQ(5u, sink.frames_.size());
+  EXPECT_EQ(swri_profiler::REPORT_INDEX, sink.frames_[3].type);
+  EXPECT_EQ(swri_profiler::REPORT_METRICS, sink.frames_[4].type);
+  const spm::ProfileIndexArray msg = sink.index(3);
+  EXPECT_TRUE(msg.full);
+  EXPECT_EQ(2u, msg.sequence);
+  EXPECT_EQ(2u, msg.data.size());
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstring>
+#include <string>
+
+#include <swri_profiler/shm_ring.h>
+
+using swri_profiler::ShmRing;
+
+// Each test writes to this process's segment and reads it back
+// through a second mapping, like the collector does.
+class ShmRingTest : public ::testing::Test
+{
+ protected:
+  ShmRing writer_;
+  ShmRing reader_;
+
+  void open(size_t capacity)
+  {
+    ASSERT_TRUE(writer_.create(capacity));
+    ASSERT_TRUE(reader_.open(writer_.name()));
+  }
+
+  void TearDown()
+  {
+    if (writer_.isOpen()) {
+      ShmRing::unlink(writer_.name());
+    }
+  }
+
+  bool write(uint32_t type, const std::string &data)
+  {
+    uint8_t *dst = writer_.reserve(data.size());
+    if (!dst) {
+      return false;
+    }
+    std::memcpy(dst, data.data(), data.size());
+    writer_.commit(type);
+    return true;
+  }
+
+  // Reads and releases the next record, or returns type 0 if there
+  // is none.
+  uint32_t read(std::string &data)
+  {
+    ShmRing::Record record;
+    if (!reader_.peek(record)) {
+      return 0;
+    }
+    data.assign(reinterpret_cast<const char*>(record.data), record.size);
+    reader_.consume();
+    return record.type;
+  }
+};
+
+TEST_F(ShmRingTest, RecordsAreReadInOrder)
+{
+  open(1024);
+  EXPECT_EQ(getpid(), reader_.pid());
+
+  ASSERT_TRUE(write(1, "first"));
+  ASSERT_TRUE(write(2, ""));
+  ASSERT_TRUE(write(3, "third record"));
+
+  std::string data;
+  EXPECT_EQ(1u, read(data));
+  EXPECT_EQ("first", data);
+  EXPECT_EQ(2u, read(data));
+  EXPECT_EQ("", data);
+  EXPECT_EQ(3u, read(data));
+  EXPECT_EQ("third record", data);
+  EXPECT_EQ(0u, read(data));
+}
+
+TEST_F(ShmRingTest, UncommittedRecordsAreNotVisible)
+{
+  open(1024);
+  ASSERT_TRUE(writer_.reserve(16) != NULL);
+
+  ShmRing::Record record;
+  EXPECT_FALSE(reader_.peek(record));
+  writer_.commit(7);
+  ASSERT_TRUE(reader_.peek(record));
+  EXPECT_EQ(7u, record.type);
+  EXPECT_EQ(16u, record.size);
+}
+
+TEST_F(ShmRingTest, RecordsWrapWithPadding)
+{
+  // Records take 8 bytes of header plus their data, padded to 8.
+  open(64);
+  const std::string a(12, 'a');
+  const std::string b(12, 'b');
+  const std::string c(20, 'c');
+
+  std::string data;
+  for (int round = 0; round < 4; round++) {
+    // a and b take 48 bytes, so c (32 bytes) doesn't fit in the rest
+    // of the ring and has to start over at the beginning.
+    ASSERT_TRUE(write(1, a));
+    ASSERT_TRUE(write(2, b));
+    EXPECT_EQ(1u, read(data));
+    EXPECT_EQ(a, data);
+    EXPECT_EQ(2u, read(data));
+    EXPECT_EQ(b, data);
+
+    ASSERT_TRUE(write(3, c));
+    EXPECT_EQ(3u, read(data));
+    EXPECT_EQ(c, data);
+    EXPECT_EQ(0u, read(data));
+
+    // Fill the ring back up to where a starts again.
+    ASSERT_TRUE(write(4, std::string(24, 'd')));
+    EXPECT_EQ(4u, read(data));
+  }
+  EXPECT_EQ(0u, reader_.takeDropped());
+}
+
+TEST_F(ShmRingTest, FullRingDropsRecords)
+{
+  open(64);
+  const std::string record(16, 'x');
+  ASSERT_TRUE(write(1, record));
+  ASSERT_TRUE(write(1, record));
+  EXPECT_FALSE(write(1, record));
+  EXPECT_EQ(1u, reader_.takeDropped());
+  EXPECT_EQ(0u, reader_.takeDropped());
+
+  // After the first record is read there are 40 free bytes, but they
+  // are split between the end and the start of the ring, so a 32
+  // byte record (which would need padding) doesn't fit.
+  std::string data;
+  EXPECT_EQ(1u, read(data));
+  EXPECT_FALSE(write(2, std::string(20, 'y')));
+  EXPECT_EQ(1u, reader_.takeDropped());
+
+  // A record that fits at the end does.
+  EXPECT_TRUE(write(3, std::string(8, 'z')));
+  EXPECT_EQ(1u, read(data));
+  EXPECT_EQ(3u, read(data));
+  EXPECT_EQ(std::string(8, 'z'), data);
+}
+
+TEST_F(ShmRingTest, SegmentIsListed)
+{
+  open(64);
+  bool found = false;
+  for (auto const &name : ShmRing::listSegments()) {
+    found = found || name == writer_.name();
+  }
+  EXPECT_TRUE(found);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
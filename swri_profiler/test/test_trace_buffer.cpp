@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include <swri_profiler/trace_buffer.h>
+
+using swri_profiler::TraceBuffer;
+using swri_profiler::TraceEvent;
+
+TEST(TraceBuffer, CapacityIsRoundedUpToAPowerOfTwo)
+{
+  TraceBuffer buffer(5);
+  int pushed = 0;
+  while (buffer.push(pushed, 0, 0)) {
+    pushed++;
+  }
+  EXPECT_EQ(8, pushed);
+  EXPECT_EQ(1u, buffer.takeDropped());
+  EXPECT_EQ(0u, buffer.takeDropped());
+}
+
+TEST(TraceBuffer, DrainsInOrderAcrossTheWrap)
+{
+  TraceBuffer buffer(4);
+  std::vector<int> nodes;
+  auto handler = [&nodes](const TraceEvent &event) { nodes.push_back(event.node); };
+
+  int next = 0;
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 3; i++) {
+      ASSERT_TRUE(buffer.push(next, next, next + 1));
+      next++;
+    }
+    EXPECT_EQ(3u, buffer.drain(handler));
+  }
+  EXPECT_EQ(0u, buffer.drain(handler));
+
+  ASSERT_EQ(15u, nodes.size());
+  for (int i = 0; i < 15; i++) {
+    EXPECT_EQ(i, nodes[i]);
+  }
+  EXPECT_EQ(0u, buffer.takeDropped());
+}
+
+TEST(TraceBuffer, DropsWhenFullInsteadOfOverwriting)
+{
+  TraceBuffer buffer(4);
+  for (int i = 0; i < 6; i++) {
+    buffer.push(i, 0, 0);
+  }
+  EXPECT_EQ(2u, buffer.takeDropped());
+
+  std::vector<int> nodes;
+  buffer.drain([&nodes](const TraceEvent &event) { nodes.push_back(event.node); });
+  ASSERT_EQ(4u, nodes.size());
+  EXPECT_EQ(0, nodes.front());
+  EXPECT_EQ(3, nodes.back());
+
+  // Draining frees the space.
+  EXPECT_TRUE(buffer.push(6, 0, 0));
+}
+
+TEST(TraceBuffer, ConcurrentProducerAndConsumer)
+{
+  const int count = 20000;
+  TraceBuffer buffer(256);
+
+  std::thread producer([&buffer, count]() {
+      for (int i = 0; i < count; i++) {
+        while (!buffer.push(i, i, i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+
+  int expected = 0;
+  bool in_order = true;
+  while (expected < count) {
+    buffer.drain([&](const TraceEvent &event) {
+        in_order = in_order && event.node == expected && event.t0 == expected;
+        expected++;
+      });
+  }
+  producer.join();
+
+  EXPECT_TRUE(in_order);
+  EXPECT_EQ(count, expected);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
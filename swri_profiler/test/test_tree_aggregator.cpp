@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+#include <swri_profiler/tree_aggregator.h>
+
+namespace spm = swri_profiler_msgs;
+using swri_profiler::TreeAggregator;
+
+static spm::ProfileIndexArray makeIndex(const std::string &node)
+{
+  spm::ProfileIndexArray msg;
+  msg.header.frame_id = node;
+  msg.sequence = 1;
+  msg.full = true;
+  return msg;
+}
+
+static void addLabel(spm::ProfileIndexArray &msg, uint32_t key, const std::string &label)
+{
+  msg.data.emplace_back();
+  msg.data.back().key = key;
+  msg.data.back().label = label;
+}
+
+// Adds a block to a report.  abs_ns is the block's total time so far,
+// which is the same as its time in this report if the report has all
+// of its calls.
+static void addBlock(spm::ProfileDataArray &msg, uint32_t key, uint64_t abs_calls,
+                     uint64_t abs_ns, uint64_t rel_ns, uint64_t max_ns)
+{
+  msg.data.emplace_back();
+  spm::ProfileData &item = msg.data.back();
+  item.key = key;
+  item.abs_call_count = abs_calls;
+  item.abs_total_duration = ros::Duration().fromNSec(abs_ns);
+  item.rel_total_duration = ros::Duration().fromNSec(rel_ns);
+  item.rel_max_duration = ros::Duration().fromNSec(max_ns);
+}
+
+struct TreeValues
+{
+  uint64_t calls;
+  uint64_t inclusive_ns;
+  uint64_t exclusive_ns;
+  uint64_t max_ns;
+};
+
+// Returns the values of the tree nodes that ran, by path.
+static std::map<std::string, TreeValues> byPath(const spm::ProfileTree &tree,
+                                                const spm::ProfileTreeData &msg)
+{
+  std::map<std::string, TreeValues> out;
+  for (size_t i = 0; i < msg.nodes.size(); i++) {
+    TreeValues &values = out[tree.paths[msg.nodes[i]]];
+    values.calls = msg.rel_call_counts[i];
+    values.inclusive_ns = msg.rel_inclusive_ns[i];
+    values.exclusive_ns = msg.rel_exclusive_ns[i];
+    values.max_ns = msg.rel_max_ns[i];
+  }
+  return out;
+}
+
+TEST(TreeAggregator, ExclusiveTime)
+{
+  TreeAggregator aggregator;
+  spm::ProfileIndexArray index = makeIndex("/node");
+  addLabel(index, 1, "/a");
+  addLabel(index, 2, "/a/b");
+  addLabel(index, 3, "/a/c");
+  aggregator.addIndex(index);
+
+  spm::ProfileDataArray data;
+  data.header.frame_id = "/node";
+  addBlock(data, 1, 2, 1000, 1000, 600);
+  addBlock(data, 2, 4, 300, 300, 100);
+  addBlock(data, 3, 1, 200, 200, 200);
+  EXPECT_TRUE(aggregator.addData(data));
+
+  spm::ProfileTree tree;
+  ASSERT_TRUE(aggregator.takeTree(tree));
+  EXPECT_EQ(1u, tree.revision);
+  spm::ProfileTreeData msg;
+  ASSERT_TRUE(aggregator.takeData(msg));
+  EXPECT_EQ(tree.revision, msg.tree_revision);
+
+  std::map<std::string, TreeValues> values = byPath(tree, msg);
+  EXPECT_EQ(500u, values["/node/a"].exclusive_ns);
+  EXPECT_EQ(1000u, values["/node/a"].inclusive_ns);
+  EXPECT_EQ(600u, values["/node/a"].max_ns);
+  EXPECT_EQ(300u, values["/node/a/b"].exclusive_ns);
+  EXPECT_EQ(200u, values["/node/a/c"].exclusive_ns);
+
+  // The node itself isn't a block, so it's the sum of its children
+  // and has no time of its own.
+  EXPECT_EQ(2u, values["/node"].calls);
+  EXPECT_EQ(1000u, values["/node"].inclusive_ns);
+  EXPECT_EQ(0u, values["/node"].exclusive_ns);
+  EXPECT_EQ(600u, values["/node"].max_ns);
+
+  // The totals start over, and the tree doesn't change.
+  EXPECT_FALSE(aggregator.takeData(msg));
+  EXPECT_FALSE(aggregator.takeTree(tree));
+}
+
+TEST(TreeAggregator, MergesNodes)
+{
+  TreeAggregator aggregator;
+  spm::ProfileIndexArray index1 = makeIndex("/ns/one");
+  addLabel(index1, 1, "/work");
+  aggregator.addIndex(index1);
+  spm::ProfileIndexArray index2 = makeIndex("/ns/two");
+  addLabel(index2, 1, "/work");
+  aggregator.addIndex(index2);
+
+  spm::ProfileDataArray data1;
+  data1.header.frame_id = "/ns/one";
+  addBlock(data1, 1, 1, 100, 100, 100);
+  aggregator.addData(data1);
+  spm::ProfileDataArray data2;
+  data2.header.frame_id = "/ns/two";
+  addBlock(data2, 1, 3, 300, 300, 200);
+  aggregator.addData(data2);
+
+  spm::ProfileTree tree;
+  ASSERT_TRUE(aggregator.takeTree(tree));
+  spm::ProfileTreeData msg;
+  ASSERT_TRUE(aggregator.takeData(msg));
+  std::map<std::string, TreeValues> values = byPath(tree, msg);
+  EXPECT_EQ(4u, values["/ns"].calls);
+  EXPECT_EQ(400u, values["/ns"].inclusive_ns);
+  EXPECT_EQ(200u, values["/ns"].max_ns);
+}
+
+TEST(TreeAggregator, SkipsFirstReportOfRunningNode)
+{
+  TreeAggregator aggregator;
+  spm::ProfileIndexArray index = makeIndex("/node");
+  addLabel(index, 1, "/a");
+  aggregator.addIndex(index);
+
+  // The node has been running, so we can't tell which calls this
+  // report's time belongs to.
+  spm::ProfileDataArray data;
+  data.header.frame_id = "/node";
+  addBlock(data, 1, 100, 10000, 100, 50);
+  EXPECT_TRUE(aggregator.addData(data));
+
+  spm::ProfileTree tree;
+  aggregator.takeTree(tree);
+  spm::ProfileTreeData msg;
+  EXPECT_FALSE(aggregator.takeData(msg));
+
+  // The next report is merged normally.
+  data.data.clear();
+  addBlock(data, 1, 102, 10200, 200, 150);
+  aggregator.addData(data);
+  ASSERT_TRUE(aggregator.takeData(msg));
+  std::map<std::string, TreeValues> values = byPath(tree, msg);
+  EXPECT_EQ(2u, values["/node/a"].calls);
+  EXPECT_EQ(200u, values["/node/a"].inclusive_ns);
+  EXPECT_EQ(150u, values["/node/a"].max_ns);
+}
+
+TEST(TreeAggregator, NeedsFullIndex)
+{
+  TreeAggregator aggregator;
+  spm::ProfileDataArray data;
+  data.header.frame_id = "/node";
+  addBlock(data, 1, 1, 100, 100, 100);
+  EXPECT_FALSE(aggregator.addData(data));
+
+  spm::ProfileIndexArray index = makeIndex("/node");
+  addLabel(index, 1, "/a");
+  aggregator.addIndex(index);
+  EXPECT_TRUE(aggregator.addData(data));
+
+  // A gap in the index sequence means we missed some blocks.
+  index.data.clear();
+  index.full = false;
+  index.sequence = 3;
+  aggregator.addIndex(index);
+  EXPECT_FALSE(aggregator.addData(data));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -43,12 +43,49 @@ namespace swri_profiler_tools
 struct NewProfileData
 {
   QString label;
-  uint64_t wall_stamp_sec;
+  // The wall time at the end of the interval covered by this data
+  // and the interval's length (the profiler's report period).
+  uint64_t wall_stamp_ns;
+  uint64_t period_ns;
   uint64_t ros_stamp_ns;
   uint64_t cumulative_call_count;
   uint64_t cumulative_inclusive_duration_ns;
   uint64_t incremental_inclusive_duration_ns;
   uint64_t incremental_max_duration_ns;
+
+  // Percentiles of the durations of calls that finished during this
+  // update, decoded from the profiler's histograms.  These are zero
+  // if no calls finished.
+  uint64_t incremental_p50_duration_ns;
+  uint64_t incremental_p90_duration_ns;
+  uint64_t incremental_p99_duration_ns;
+  uint64_t incremental_p999_duration_ns;
+
+  // Sampled blocks only time one of every sample_period calls, and
+  // their incremental durations are estimates.
+  // incremental_duration_error is the estimated relative standard
+  // error of the incremental inclusive duration (0 when every call
+  // is timed).
+  uint32_t sample_period;
+  double incremental_duration_error;
+
+  // The CPU time used during the incremental inclusive duration.  The
+  // rest of the time was spent waiting.  This is zero if the
+  // profiler isn't measuring CPU time.
+  uint64_t incremental_cpu_duration_ns;
+
+  // The heap allocations made directly in the block (not in nested
+  // blocks).  These are zero if the profiler isn't tracking
+  // allocations.
+  uint64_t incremental_alloc_count;
+  uint64_t incremental_alloc_bytes;
+
+  // The compile-time filters (SWRI_PROFILER_LEVEL and
+  // SWRI_PROFILER_CATEGORIES) the block's node was built with.  These
+  // are 255 and 0xFFFFFFFF if the node wasn't filtered, and zero for
+  // publishers that don't report them.
+  uint8_t compiled_level;
+  uint32_t compiled_categories;
 };  // struct NewProfileData
 
 typedef std::vector<NewProfileData> NewProfileDataVector;
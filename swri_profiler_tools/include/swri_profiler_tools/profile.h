@@ -62,6 +62,20 @@ class ProfileEntry
   uint64_t cumulative_exclusive_duration_ns;
   uint64_t incremental_exclusive_duration_ns;
   uint64_t incremental_max_duration_ns;
+  // Duration percentiles are only available for measured nodes.
+  uint64_t incremental_p50_duration_ns;
+  uint64_t incremental_p90_duration_ns;
+  uint64_t incremental_p99_duration_ns;
+  uint64_t incremental_p999_duration_ns;
+  // Sampling information for measured nodes.  See NewProfileData.
+  uint32_t sample_period;
+  double incremental_duration_error;
+  // The CPU time used during the incremental inclusive duration.
+  // Inferred nodes add up their children's CPU time.
+  uint64_t incremental_cpu_duration_ns;
+  // Heap allocations made directly in measured nodes.
+  uint64_t incremental_alloc_count;
+  uint64_t incremental_alloc_bytes;
 
   ProfileEntry()
     :
@@ -71,7 +85,16 @@ class ProfileEntry
     incremental_inclusive_duration_ns(0),
     cumulative_exclusive_duration_ns(0),
     incremental_exclusive_duration_ns(0),
-    incremental_max_duration_ns(0)
+    incremental_max_duration_ns(0),
+    incremental_p50_duration_ns(0),
+    incremental_p90_duration_ns(0),
+    incremental_p99_duration_ns(0),
+    incremental_p999_duration_ns(0),
+    sample_period(1),
+    incremental_duration_error(0.0),
+    incremental_cpu_duration_ns(0),
+    incremental_alloc_count(0),
+    incremental_alloc_bytes(0)
   {}
 };  // class ProfileEntry
 
@@ -112,6 +135,11 @@ class ProfileNode
   // paths.
   std::vector<int> children_;
 
+  // The compile-time filters of the ROS node that measured this
+  // node, from the latest data (see NewProfileData).
+  int compiled_level_;
+  uint32_t compiled_categories_;
+
   // The ProfileNode is a "dumb" data storage object with read-only
   // access to the rest of the world.  The node is managed and
   // manipulated directly by the profile.
@@ -123,7 +151,9 @@ class ProfileNode
     node_key_(-1),
     measured_(false),
     depth_(-1),
-    parent_(-1)
+    parent_(-1),
+    compiled_level_(0),
+    compiled_categories_(0)
   {}
   
   bool isValid() const { return node_key_ >= 0; }
@@ -136,6 +166,13 @@ class ProfileNode
   int parentKey() const { return parent_; }
   const std::vector<int>& childKeys() const { return children_; }
   bool hasChildren() const { return !children_.empty(); }
+  int compiledLevel() const { return compiled_level_; }
+  uint32_t compiledCategories() const { return compiled_categories_; }
+
+  // Computes the heap allocations and bytes per call made by the node
+  // itself during its latest data.  Returns false if the profiler
+  // didn't track allocations or the node wasn't called.
+  bool allocationsPerCall(double &count, double &bytes) const;
 };  // class ProfileNode
 
 class Profile : public QObject
@@ -151,12 +188,16 @@ class Profile : public QObject
   // be modified by the user.
   QString name_;
 
-  // All node data is stored in dense arrays of the same size.  The
-  // min_time_s_ and max_time_s_ correspond to the timespan currently
-  // covered by the array.  They are inclusive and exclusive,
-  // respectively (index 0 => min_time_s, index size() => max_time_s.
-  uint64_t min_time_s_;
-  uint64_t max_time_s_;
+  // All node data is stored in dense arrays of the same size.  Each
+  // element covers a fixed length of time (the resolution) and is
+  // identified by its slot, the wall time at the end of the element
+  // divided by the resolution.  The min_slot_ and max_slot_
+  // correspond to the timespan currently covered by the array.  They
+  // are inclusive and exclusive, respectively (index 0 => min_slot_,
+  // index size() => max_slot_).
+  uint64_t resolution_ns_;
+  uint64_t min_slot_;
+  uint64_t max_slot_;
 
   // Nodes are stored in an unordered_map so that we can provide
   // persistent keys with fast look ups.  We could use the node's path
@@ -181,17 +222,19 @@ class Profile : public QObject
   friend class ProfileDatabase;
   void initialize(int profile_key, const QString &name);
 
-  void expandTimeline(const uint64_t sec);
+  void expandTimeline(const uint64_t slot);
   void addDataToAllNodes(const bool back, const size_t count);
 
   bool touchNode(const QString &path);
 
-  void storeItemData(std::set<uint64_t> &modified_times,
+  void storeItemData(std::set<uint64_t> &modified_slots,
                      const int node_key,
+                     const uint64_t last_slot,
+                     const size_t slot_count,
                      const NewProfileData &item);
   
-  size_t indexFromSec(const uint64_t secs) const { return secs - min_time_s_; }
-  uint64_t secFromIndex(const uint64_t index) const { return index + min_time_s_; }
+  size_t indexFromSlot(const uint64_t slot) const { return slot - min_slot_; }
+  uint64_t slotFromIndex(const uint64_t index) const { return index + min_slot_; }
 
   void rebuildIndices();
   void rebuildFlatIndex();
@@ -211,6 +254,16 @@ class Profile : public QObject
   const QString& name() const { return name_; }
   void setName(const QString &name);
 
+  // The length of time covered by each data element.  This is set
+  // from the report period of the first data added to the profile.
+  uint64_t resolutionNs() const { return resolution_ns_; }
+  // The wall time at the end of the interval covered by a data
+  // element.
+  uint64_t wallTimeNsFromIndex(const size_t index) const
+  {
+    return slotFromIndex(index) * resolution_ns_;
+  }
+
   const ProfileNode& node(int node_key) const;
   const ProfileNode& rootNode() const;
   const int rootKey() const { return 0; }
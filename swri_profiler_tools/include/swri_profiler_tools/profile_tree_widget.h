@@ -55,6 +55,11 @@ class ProfileTreeWidget : public QWidget
 
   DatabaseKey active_key_;
   std::unordered_map<DatabaseKey, QTreeWidgetItem*> items_;
+
+  // The column the tree is sorted by, or -1 to keep the profile's
+  // order.  The tree is unsorted until the user clicks a header.
+  int sort_column_;
+  Qt::SortOrder sort_order_;
   
  public:
   ProfileTreeWidget(QWidget *parent=0);
@@ -71,6 +76,8 @@ class ProfileTreeWidget : public QWidget
  private Q_SLOTS:
   void handleProfileAdded(int profile_key);
   void handleNodesAdded(int profile_key);
+  void handleDataAdded(int profile_key);
+  void handleHeaderClicked(int column);
 
   void handleItemActivated(QTreeWidgetItem *item, int column);
   void handleTreeContextMenuRequest(const QPoint &pos);
@@ -79,6 +86,8 @@ class ProfileTreeWidget : public QWidget
   void synchronizeWidget();
   void addProfile(int profile_key);
   void addNode(QTreeWidgetItem *parent, const Profile &profile, const int node_key);
+  void updateAllocations(QTreeWidgetItem *item, const Profile &profile, const int node_key);
+  void sortItems();
 
   QString nameForKey(const DatabaseKey &key) const;
   void markItemActive(const DatabaseKey &key);
@@ -52,6 +52,12 @@ class ProfilerMaster : public QObject
  public Q_SLOTS:
   void createNewWindow();
   void rosConnected(bool connected, QString master_uri);
+  // Loads a recording (see RecordingSource) as a new profile.  The
+  // recording is loaded in the background.
+  void openRecording(QString filename);
+
+ private Q_SLOTS:
+  void recordingFailed(QString filename, QString error);
 
  private:
   // Stores all of our precious profile data
@@ -32,6 +32,7 @@
 #define SWRI_PROFILER_TOOLS_PROFILER_MSG_ADAPTER_H_
 
 #include <map>
+#include <set>
 #include <QString>
 #include <swri_profiler_tools/new_profile_data.h>
 #include <swri_profiler_msgs/ProfileIndexArray.h>
@@ -45,12 +46,26 @@ class ProfilerMsgAdapter
   // full label.
   std::map<QString, std::map<int, QString> > index_;
 
+  // The sequence number of the latest index message merged for each
+  // node, and the nodes whose index is missing some messages.
+  std::map<QString, uint32_t> index_sequence_;
+  std::set<QString> incomplete_index_;
+
+  // The most recent data for each block of each node.  Reports
+  // between keyframes omit blocks that didn't change, so we fill
+  // them in from here.
+  std::map<QString, std::map<int, NewProfileData> > last_data_;
+
  public:
   ProfilerMsgAdapter();
   ~ProfilerMsgAdapter();
 
   void processIndex(const swri_profiler_msgs::ProfileIndexArray &msg);
   bool processData(NewProfileDataVector &out_data, const swri_profiler_msgs::ProfileDataArray &msg);
+
+  // Returns true if the index for a node is missing or incomplete,
+  // in which case the full index should be requested from the node.
+  bool needsFullIndex(const QString &node_name) const;
   void reset();
 };  // class ProfilerMsgAdapter
 }  // namespace swri_profiler_tools
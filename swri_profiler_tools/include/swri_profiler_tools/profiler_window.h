@@ -54,8 +54,12 @@ class ProfilerWindow : public QMainWindow
  public Q_SLOTS:
   void rosConnected(bool connected, QString master_uri);
 
+ private Q_SLOTS:
+  void handleOpenRecording();
+
  Q_SIGNALS:
   void createNewWindow();
+  void openRecording(QString filename);
   
  private:
   Ui::ProfilerWindow ui;
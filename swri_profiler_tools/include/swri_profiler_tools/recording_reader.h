@@ -0,0 +1,96 @@
+// *****************************************************************************
+//
+// Copyright (c) 2015, Southwest Research Institute® (SwRI®)
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Southwest Research Institute® (SwRI®) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL Southwest Research Institute® BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT 
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY 
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// *****************************************************************************
+
+#ifndef SWRI_PROFILER_TOOLS_RECORDING_READER_H_
+#define SWRI_PROFILER_TOOLS_RECORDING_READER_H_
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+#include <swri_profiler/recording_format.h>
+#include <swri_profiler_tools/new_profile_data.h>
+
+namespace swri_profiler_tools
+{
+// RecordingReader reads a recording written by the profiler_recorder
+// node or the profiler's record sink (see
+// swri_profiler/recording_format.h).  The file is memory mapped, and
+// opening it only reads the string table and the index at the end of
+// the file.  The intervals are decoded as they are read, so a caller
+// can read a long recording a batch at a time (see RecordingSource).
+class RecordingReader
+{
+  QFile file_;
+  const uchar *data_;
+  qint64 size_;
+  QString error_string_;
+
+  std::vector<QString> strings_;
+  // The offset of each interval chunk, in the order they were recorded.
+  std::vector<qint64> intervals_;
+
+  // The full labels of the blocks, by node and label string ids.
+  std::map<std::pair<uint32_t, uint32_t>, QString> labels_;
+
+  // The most recent data for each block of each node, by node string
+  // id.  Intervals between keyframes omit blocks that didn't run, so
+  // we fill them in from here.
+  std::map<uint32_t, std::map<QString, NewProfileData> > last_data_;
+
+ public:
+  RecordingReader();
+  ~RecordingReader();
+
+  bool open(const QString &filename);
+  void close();
+  const QString& errorString() const { return error_string_; }
+
+  size_t intervalCount() const { return intervals_.size(); }
+
+  // Appends the data of an interval to out_data.  Intervals should be
+  // read in order, since blocks that are omitted from an interval are
+  // filled in from the node's previous interval.  Returns false if
+  // the interval is corrupt.
+  bool readInterval(NewProfileDataVector &out_data, size_t index);
+
+ private:
+  bool readIndex();
+  bool scanChunks();
+  bool readStrings(qint64 offset);
+  // Returns the payload of the chunk at offset, or NULL if it is
+  // truncated or not of the expected type.
+  const uchar* chunk(qint64 offset, uint32_t type, uint32_t &size) const;
+  const QString& label(uint32_t node, uint32_t label);
+};  // class RecordingReader
+}  // namespace swri_profiler_tools
+#endif  // SWRI_PROFILER_TOOLS_RECORDING_READER_H_
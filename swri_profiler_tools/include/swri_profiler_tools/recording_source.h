@@ -0,0 +1,89 @@
+// *****************************************************************************
+//
+// Copyright (c) 2015, Southwest Research Institute® (SwRI®)
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Southwest Research Institute® (SwRI®) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL Southwest Research Institute® BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT 
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY 
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// *****************************************************************************
+
+#ifndef SWRI_PROFILER_TOOLS_RECORDING_SOURCE_H_
+#define SWRI_PROFILER_TOOLS_RECORDING_SOURCE_H_
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+#include <swri_profiler_tools/new_profile_data.h>
+
+namespace swri_profiler_tools
+{
+// RecordingSource loads a recording (see RecordingReader) into a new
+// profile.  Like RosSource, it does the reading in a separate thread
+// so that the GUI stays responsive while a long recording loads.  The
+// backend reads one batch of intervals at a time and only reads the
+// next batch once the previous one has been added to the profile, so
+// the views fill in progressively and the decoded data never piles
+// up in the event queue.
+class ProfileDatabase;
+class RecordingSourceBackend;
+class RecordingSource : public QObject
+{
+  Q_OBJECT;
+
+ public:
+  RecordingSource(ProfileDatabase *db, const QString &filename, QObject *parent = NULL);
+  ~RecordingSource();
+
+  const QString& filename() const { return filename_; }
+
+  void start();
+
+ Q_SIGNALS:
+  // Emitted if the recording can't be opened.
+  void failed(QString filename, QString error);
+  // Emitted once the whole recording has been loaded, or has failed
+  // to open.
+  void finished();
+
+  void openRequested(QString filename);
+  void batchRequested();
+
+ private Q_SLOTS:
+  void handleOpened();
+  void handleFailed(QString error);
+  void handleData(swri_profiler_tools::NewProfileDataVector data);
+  void handleFinished(int corrupt);
+
+ private:
+  ProfileDatabase *db_;
+  QString filename_;
+
+  QThread thread_;
+  RecordingSourceBackend *backend_;
+
+  int profile_key_;
+};  // class RecordingSource
+}  // namespace swri_profiler_tools
+#endif  // SWRI_PROFILER_TOOLS_RECORDING_SOURCE_H_
@@ -63,6 +63,7 @@ class RosSource : public QObject
   
  Q_SIGNALS:
   void connected(bool connected, QString uri);
+  void indexRequested(QString node_name);
 
  private Q_SLOTS:
   void handleConnected(bool connected, QString uri);
@@ -31,8 +31,12 @@
 #ifndef SWRI_PROFILER_TOOLS_ROS_SOURCE_BACKEND_H_
 #define SWRI_PROFILER_TOOLS_ROS_SOURCE_BACKEND_H_
 
+#include <map>
+#include <string>
+
 #include <QObject>
 #include <ros/subscriber.h>
+#include <ros/time.h>
 #include <swri_profiler_msgs/ProfileIndexArray.h>
 #include <swri_profiler_msgs/ProfileDataArray.h>
 
@@ -46,6 +50,10 @@ class RosSourceBackend : public QObject
   ros::Subscriber data_sub_;  
 
   bool is_connected_;  
+
+  // When we last requested the full index from each node, so that we
+  // don't flood a node that can't answer.
+  std::map<std::string, ros::WallTime> last_index_request_;
   
  Q_SIGNALS:
   void connected(bool connected, QString uri);
@@ -56,6 +64,9 @@ class RosSourceBackend : public QObject
   RosSourceBackend();
   ~RosSourceBackend();
 
+ public Q_SLOTS:
+  void requestIndex(QString node_name);
+
  private:
   void startRos();
   void stopRos();
@@ -90,6 +90,15 @@ int main(int argc, char **argv)
 
   swri_profiler_tools::ProfilerMaster master;
   master.createNewWindow();
+
+  // Recordings can be opened from the command line.
+  const QStringList args = app.arguments();
+  for (int i = 1; i < args.size(); i++) {
+    if (args[i].endsWith(".sprec")) {
+      master.openRecording(args[i]);
+    }
+  }
+
   app.connect(&app, SIGNAL(lastWindowClosed()), &app, SLOT(quit()));
   int result = app.exec();
   return result;
@@ -336,10 +336,70 @@ void PartitionWidget::toolTipEvent(QHelpEvent *event)
   if (item.node_key == profile.rootKey()) {
     tool_tip = profile.name();
   } else {  
-    tool_tip = profile.node(item.node_key).path();
+    const ProfileNode &node = profile.node(item.node_key);
+    tool_tip = node.path();
     if (item.exclusive) {
       tool_tip += " [exclusive]";
     }
+
+    // Flag sampled blocks since their times are only estimates.
+    if (node.isMeasured() && !node.data().empty() &&
+        node.data().back().sample_period > 1) {
+      const ProfileEntry &entry = node.data().back();
+      tool_tip += QString(" [sampled 1/%1, +/-%2%]")
+        .arg(entry.sample_period)
+        .arg(100.0*entry.incremental_duration_error, 0, 'f', 1);
+    }
+
+    // Split the node's time into CPU and waiting if the profiler
+    // measured CPU time.
+    if (!node.data().empty() &&
+        node.data().back().incremental_cpu_duration_ns > 0 &&
+        node.data().back().incremental_inclusive_duration_ns > 0) {
+      const ProfileEntry &entry = node.data().back();
+      const double cpu = std::min(1.0,
+        static_cast<double>(entry.incremental_cpu_duration_ns) /
+        entry.incremental_inclusive_duration_ns);
+      tool_tip += QString(" [CPU %1%, waiting %2%]")
+        .arg(100.0*cpu, 0, 'f', 1)
+        .arg(100.0*(1.0 - cpu), 0, 'f', 1);
+    }
+
+    // Show the call duration percentiles if the node reported a
+    // histogram for its latest calls.
+    if (node.isMeasured() && !node.data().empty() &&
+        node.data().back().incremental_p50_duration_ns > 0) {
+      const ProfileEntry &entry = node.data().back();
+      tool_tip += QString(" [p50 %1 ms, p99 %2 ms, p99.9 %3 ms]")
+        .arg(entry.incremental_p50_duration_ns / 1.0e6, 0, 'f', 3)
+        .arg(entry.incremental_p99_duration_ns / 1.0e6, 0, 'f', 3)
+        .arg(entry.incremental_p999_duration_ns / 1.0e6, 0, 'f', 3);
+    }
+
+    // Show the allocations per call made by the block itself if the
+    // profiler tracked them.
+    double alloc_count;
+    double alloc_bytes;
+    if (node.allocationsPerCall(alloc_count, alloc_bytes)) {
+      tool_tip += QString(" [%1 allocations, %2 bytes per call]")
+        .arg(alloc_count, 0, 'f', 1)
+        .arg(alloc_bytes, 0, 'f', 0);
+    }
+
+    // Show the compile-time filters if the node was built with any,
+    // since some of its blocks may have been compiled out.
+    if (node.isMeasured() && node.compiledCategories() != 0 &&
+        (node.compiledLevel() < 255 || node.compiledCategories() != 0xFFFFFFFF)) {
+      QStringList categories;
+      for (int i = 0; i < 32; i++) {
+        if (node.compiledCategories() & (1u << i)) {
+          categories.append(QString::number(i));
+        }
+      }
+      tool_tip += QString(" [built with level <= %1, categories %2]")
+        .arg(node.compiledLevel())
+        .arg(categories.join(","));
+    }
   }
   
   QRectF win_rect = win_from_data_.mapRect(item.rect);
@@ -42,8 +42,9 @@ static const ProfileNode invalid_node_;
 Profile::Profile()
   :
   profile_key_(-1),
-  min_time_s_(0),
-  max_time_s_(0)
+  resolution_ns_(1000000000),
+  min_slot_(0),
+  max_slot_(0)
 {
   // Add the root node.
   node_key_from_path_[""] = 0;
@@ -83,19 +84,41 @@ void Profile::addData(const NewProfileDataVector &data)
     return;
   }
 
-  std::set<uint64_t> modified_times;
+  // The profile's resolution is fixed by the first data we receive.
+  // We use the shortest report period so that no data is combined
+  // unnecessarily.
+  if (min_slot_ == max_slot_) {
+    uint64_t resolution_ns = 0;
+    for (auto const &item : data) {
+      if (item.period_ns > 0 && (resolution_ns == 0 || item.period_ns < resolution_ns)) {
+        resolution_ns = item.period_ns;
+      }
+    }
+    if (resolution_ns > 0) {
+      resolution_ns_ = resolution_ns;
+    }
+  }
+
+  std::set<uint64_t> modified_slots;
   
   bool nodes_added = false;
   for (auto const &item : data) {
     QString path = normalizeNodePath(item.label);  
 
-    // Since we're setting the data at this item's timestamp, we
-    // always add the timestamp to the modified list.
-    modified_times.insert(item.wall_stamp_sec);
+    // The item covers the interval of length period_ns ending at its
+    // timestamp.  The profiler aligns its reports to multiples of
+    // the period, so we round the timestamp to the nearest slot.
+    // Items with longer periods than our resolution cover several
+    // slots.
+    const uint64_t last_slot = (item.wall_stamp_ns + resolution_ns_/2) / resolution_ns_;
+    uint64_t slot_count = (item.period_ns + resolution_ns_/2) / resolution_ns_;
+    slot_count = std::max<uint64_t>(1, std::min(slot_count, last_slot+1));
+    const uint64_t first_slot = last_slot + 1 - slot_count;
     
     // If this item is outside our current timeline, we need to expand
     // the timeline (and fill in the gaps).  This could influence a larger 
-    expandTimeline(item.wall_stamp_sec);
+    expandTimeline(first_slot);
+    expandTimeline(last_slot);
 
     // Touching the node guarantees that it and all of its ancestor
     // nodes exist.
@@ -111,7 +134,7 @@ void Profile::addData(const NewProfileDataVector &data)
     // At this point, we know that the corresponding node and timeslot
     // exist, so we can store the data.  Storing data may influence
     // subsequent times.
-    storeItemData(modified_times, node_key, item);    
+    storeItemData(modified_slots, node_key, last_slot, slot_count, item);    
   }  
 
   // If nodes were created, we need to update our indices.
@@ -122,33 +145,33 @@ void Profile::addData(const NewProfileDataVector &data)
 
   // Finally, we need to update derived data that may have changed
   // from the update.
-  for (auto const &t : modified_times) {
-    updateDerivedData(indexFromSec(t));
+  for (auto const &slot : modified_slots) {
+    updateDerivedData(indexFromSlot(slot));
   }
 
   // Notify observers that the profile has new data.
   Q_EMIT dataAdded(profile_key_);
 }
 
-void Profile::expandTimeline(const uint64_t sec)
+void Profile::expandTimeline(const uint64_t slot)
 {
-  if (sec >= min_time_s_ && sec < max_time_s_) {
+  if (slot >= min_slot_ && slot < max_slot_) {
     // This time is already in our timeline, so ignore it.
-  } else if (min_time_s_ == max_time_s_) {
+  } else if (min_slot_ == max_slot_) {
     // The timeline is empty
-    min_time_s_ = sec;
-    max_time_s_ = sec+1;
+    min_slot_ = slot;
+    max_slot_ = slot+1;
     addDataToAllNodes(true, 1);
-  } else if (sec >= max_time_s_) {
+  } else if (slot >= max_slot_) {
     // New data extends the back of the timeline.
-    size_t new_elements = sec - max_time_s_ + 1;
-    max_time_s_ = sec+1;
+    size_t new_elements = slot - max_slot_ + 1;
+    max_slot_ = slot+1;
     addDataToAllNodes(true, new_elements);
   } else {
     // New data must be at the front of the timeline.  This case
     // should be rare.
-    size_t new_elements = min_time_s_ - sec;
-    min_time_s_ = sec;
+    size_t new_elements = min_slot_ - slot;
+    min_slot_ = slot;
     addDataToAllNodes(false, new_elements);
   }    
 }
@@ -228,7 +251,7 @@ bool Profile::touchNode(const QString &path)
 
     ProfileEntry initial_value;
     initial_value.projected = true;
-    this_node.data_.resize(max_time_s_ - min_time_s_, initial_value);
+    this_node.data_.resize(max_slot_ - min_slot_, initial_value);
 
     this_node.depth_ = this_depth;
     this_node.parent_ = parent_key;
@@ -247,30 +270,82 @@ bool Profile::touchNode(const QString &path)
   return true;
 }
 
-void Profile::storeItemData(std::set<uint64_t> &modified_times,
+void Profile::storeItemData(std::set<uint64_t> &modified_slots,
                             const int node_key,
+                            const uint64_t last_slot,
+                            const size_t slot_count,
                             const NewProfileData &item)
 {
-  size_t index = indexFromSec(item.wall_stamp_sec);
+  const size_t last_index = indexFromSlot(last_slot);
+  const size_t first_index = last_index + 1 - slot_count;
   ProfileNode &node = nodes_.at(node_key);
-
   node.measured_ = true;
-  node.data_[index].projected = false;
-  node.data_[index].cumulative_call_count = item.cumulative_call_count;
-  node.data_[index].cumulative_inclusive_duration_ns = item.cumulative_inclusive_duration_ns;
-  node.data_[index].incremental_inclusive_duration_ns = item.incremental_inclusive_duration_ns;
-  node.data_[index].incremental_max_duration_ns = item.incremental_max_duration_ns;
+  node.compiled_level_ = item.compiled_level;
+  node.compiled_categories_ = item.compiled_categories;
+
+  // If the item's period is shorter than our resolution, several
+  // items land in the same slot and we combine them.
+  const bool combine = item.period_ns < resolution_ns_;
+
+  for (size_t index = first_index; index <= last_index; index++) {
+    ProfileEntry &entry = node.data_[index];
+    modified_slots.insert(slotFromIndex(index));
+
+    if (combine && !entry.projected) {
+      entry.cumulative_call_count = item.cumulative_call_count;
+      entry.cumulative_inclusive_duration_ns = item.cumulative_inclusive_duration_ns;
+      entry.incremental_inclusive_duration_ns += item.incremental_inclusive_duration_ns;
+      entry.incremental_cpu_duration_ns += item.incremental_cpu_duration_ns;
+      entry.incremental_alloc_count += item.incremental_alloc_count;
+      entry.incremental_alloc_bytes += item.incremental_alloc_bytes;
+      entry.incremental_max_duration_ns = std::max(
+        entry.incremental_max_duration_ns, item.incremental_max_duration_ns);
+      // Percentiles can't be combined without the original
+      // histograms, so we keep the worst case.
+      entry.incremental_p50_duration_ns = std::max(
+        entry.incremental_p50_duration_ns, item.incremental_p50_duration_ns);
+      entry.incremental_p90_duration_ns = std::max(
+        entry.incremental_p90_duration_ns, item.incremental_p90_duration_ns);
+      entry.incremental_p99_duration_ns = std::max(
+        entry.incremental_p99_duration_ns, item.incremental_p99_duration_ns);
+      entry.incremental_p999_duration_ns = std::max(
+        entry.incremental_p999_duration_ns, item.incremental_p999_duration_ns);
+      entry.sample_period = std::max(entry.sample_period, item.sample_period);
+      entry.incremental_duration_error = std::max(
+        entry.incremental_duration_error, item.incremental_duration_error);
+      continue;
+    }
+
+    // When an item covers several slots, its incremental time is
+    // spread evenly across them.  We don't know how the cumulative
+    // values progressed within the item's period, so every slot gets
+    // the final values.
+    entry.projected = false;
+    entry.cumulative_call_count = item.cumulative_call_count;
+    entry.cumulative_inclusive_duration_ns = item.cumulative_inclusive_duration_ns;
+    entry.incremental_inclusive_duration_ns = item.incremental_inclusive_duration_ns / slot_count;
+    entry.incremental_cpu_duration_ns = item.incremental_cpu_duration_ns / slot_count;
+    entry.incremental_alloc_count = item.incremental_alloc_count / slot_count;
+    entry.incremental_alloc_bytes = item.incremental_alloc_bytes / slot_count;
+    entry.incremental_max_duration_ns = item.incremental_max_duration_ns;
+    entry.incremental_p50_duration_ns = item.incremental_p50_duration_ns;
+    entry.incremental_p90_duration_ns = item.incremental_p90_duration_ns;
+    entry.incremental_p99_duration_ns = item.incremental_p99_duration_ns;
+    entry.incremental_p999_duration_ns = item.incremental_p999_duration_ns;
+    entry.sample_period = item.sample_period;
+    entry.incremental_duration_error = item.incremental_duration_error;
+  }
   // Exclusive timing fields are derived data and are set in updateDerivedData().
 
   // If the subsequent elements are projected data, we should
   // propogate this new data forward until the next firm data point.
-  for (size_t i = index+1; i < node.data_.size(); i++) {
+  for (size_t i = last_index+1; i < node.data_.size(); i++) {
     if (node.data_[i].projected == false) {
       break;
     }
-    node.data_[i] = node.data_[index];
+    node.data_[i] = node.data_[last_index];
     node.data_[i].projected = true;
-    modified_times.insert(secFromIndex(i));
+    modified_slots.insert(slotFromIndex(i));
   }
 }
 
@@ -383,6 +458,7 @@ void Profile::updateDerivedDataInternal(ProfileNode &node, size_t index)
   uint64_t children_cum_incl_duration = 0;
   uint64_t children_inc_incl_duration = 0;
   uint64_t children_inc_max_duration = 0;
+  uint64_t children_inc_cpu_duration = 0;
 
   for (auto &child_key : node.childKeys()) {
     if (nodes_.count(child_key) == 0) {
@@ -397,6 +473,7 @@ void Profile::updateDerivedDataInternal(ProfileNode &node, size_t index)
     children_cum_incl_duration += data.cumulative_inclusive_duration_ns;
     children_inc_incl_duration += data.incremental_inclusive_duration_ns;
     children_inc_max_duration = std::max(children_inc_max_duration, data.incremental_max_duration_ns);
+    children_inc_cpu_duration += data.incremental_cpu_duration_ns;
   }
 
   ProfileEntry &data = node.data_[index];
@@ -405,6 +482,7 @@ void Profile::updateDerivedDataInternal(ProfileNode &node, size_t index)
     data.cumulative_inclusive_duration_ns = children_cum_incl_duration;
     data.incremental_inclusive_duration_ns = children_inc_incl_duration;
     data.incremental_max_duration_ns = children_inc_max_duration;
+    data.incremental_cpu_duration_ns = children_inc_cpu_duration;
   }
 
   if (children_cum_incl_duration > data.cumulative_inclusive_duration_ns) {
@@ -448,6 +526,24 @@ void Profile::updateDerivedDataInternal(ProfileNode &node, size_t index)
   }
 }
 
+bool ProfileNode::allocationsPerCall(double &count, double &bytes) const
+{
+  if (!measured_ || data_.size() < 2 || data_.back().incremental_alloc_count == 0) {
+    return false;
+  }
+
+  const ProfileEntry &entry = data_.back();
+  const ProfileEntry &previous = data_[data_.size()-2];
+  if (entry.cumulative_call_count <= previous.cumulative_call_count) {
+    return false;
+  }
+
+  const double calls = entry.cumulative_call_count - previous.cumulative_call_count;
+  count = entry.incremental_alloc_count / calls;
+  bytes = entry.incremental_alloc_bytes / calls;
+  return true;
+}
+
 void Profile::setName(const QString &name)
 {
   name_ = name;
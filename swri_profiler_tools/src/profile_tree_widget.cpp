@@ -31,6 +31,7 @@
 
 #include <QVBoxLayout>
 #include <QTreeWidget>
+#include <QHeaderView>
 #include <QMenu>
 
 #include <swri_profiler_tools/profile_database.h>
@@ -47,15 +48,31 @@ enum ProfileTreeRoles {
   NodeKeyRole,
 };
 
+enum ProfileTreeColumns {
+  NameColumn = 0,
+  AllocationsColumn,
+};
+
 ProfileTreeWidget::ProfileTreeWidget(QWidget *parent)
   :
   QWidget(parent),
-  db_(NULL)
+  db_(NULL),
+  sort_column_(-1),
+  sort_order_(Qt::AscendingOrder)
 {
   tree_widget_ = new QTreeWidget(this);
   tree_widget_->setFont(QFont("Ubuntu Mono", 9));
   tree_widget_->setContextMenuPolicy(Qt::CustomContextMenu);
   tree_widget_->setExpandsOnDoubleClick(false);
+
+  // The allocations column ranks blocks by the heap allocations per
+  // call they made themselves in their latest data, if the profiler
+  // tracked them.
+  tree_widget_->setColumnCount(2);
+  tree_widget_->setHeaderLabels(QStringList() << "Block" << "Allocs/call");
+  tree_widget_->header()->setClickable(true);
+  QObject::connect(tree_widget_->header(), SIGNAL(sectionClicked(int)),
+                   this, SLOT(handleHeaderClicked(int)));
   
   QObject::connect(tree_widget_, SIGNAL(customContextMenuRequested(const QPoint&)),
                    this, SLOT(handleTreeContextMenuRequest(const QPoint&)));
@@ -92,6 +109,8 @@ void ProfileTreeWidget::setDatabase(ProfileDatabase *db)
                    this, SLOT(handleProfileAdded(int)));
   QObject::connect(db_, SIGNAL(nodesAdded(int)),
                    this, SLOT(handleNodesAdded(int)));
+  QObject::connect(db_, SIGNAL(dataAdded(int)),
+                   this, SLOT(handleDataAdded(int)));
 }
 
 void ProfileTreeWidget::handleProfileAdded(int profile_key)
@@ -106,6 +125,43 @@ void ProfileTreeWidget::handleNodesAdded(int profile_key)
   synchronizeWidget();
 }
 
+void ProfileTreeWidget::handleDataAdded(int profile_key)
+{
+  const Profile &profile = db_->profile(profile_key);
+  if (!profile.isValid()) {
+    return;
+  }
+
+  for (auto const &item : items_) {
+    if (item.first.profileKey() == profile_key) {
+      updateAllocations(item.second, profile, item.first.nodeKey());
+    }
+  }
+  sortItems();
+}
+
+void ProfileTreeWidget::handleHeaderClicked(int column)
+{
+  // Clicking the sorted column again reverses the order.  Blocks
+  // that allocate the most are listed first by default.
+  if (column == sort_column_) {
+    sort_order_ = sort_order_ == Qt::AscendingOrder ? Qt::DescendingOrder : Qt::AscendingOrder;
+  } else {
+    sort_column_ = column;
+    sort_order_ = column == AllocationsColumn ? Qt::DescendingOrder : Qt::AscendingOrder;
+  }
+  tree_widget_->header()->setSortIndicatorShown(true);
+  tree_widget_->header()->setSortIndicator(sort_column_, sort_order_);
+  sortItems();
+}
+
+void ProfileTreeWidget::sortItems()
+{
+  if (sort_column_ >= 0) {
+    tree_widget_->sortItems(sort_column_, sort_order_);
+  }
+}
+
 void ProfileTreeWidget::synchronizeWidget()
 {
   tree_widget_->clear();
@@ -119,6 +175,7 @@ void ProfileTreeWidget::synchronizeWidget()
   for (auto key : keys) {
     addProfile(key);
   }
+  sortItems();
 }
 
 void ProfileTreeWidget::addProfile(int profile_key)
@@ -167,6 +224,7 @@ void ProfileTreeWidget::addNode(QTreeWidgetItem *parent,
   item->setText(0, node.name());
   item->setData(0, ProfileKeyRole, profile.profileKey());
   item->setData(0, NodeKeyRole, node.nodeKey());
+  updateAllocations(item, profile, node_key);
   parent->addChild(item);
   items_[DatabaseKey(profile.profileKey(), node.nodeKey())] = item;
 
@@ -175,6 +233,21 @@ void ProfileTreeWidget::addNode(QTreeWidgetItem *parent,
   }
 }
 
+void ProfileTreeWidget::updateAllocations(QTreeWidgetItem *item,
+                                          const Profile &profile,
+                                          const int node_key)
+{
+  // The value is stored as a number, rounded for display, so that
+  // the column sorts numerically.
+  double count;
+  double bytes;
+  if (profile.node(node_key).allocationsPerCall(count, bytes)) {
+    item->setData(AllocationsColumn, Qt::DisplayRole, qRound(count * 10.0) / 10.0);
+  } else {
+    item->setData(AllocationsColumn, Qt::DisplayRole, QVariant());
+  }
+}
+
 void ProfileTreeWidget::handleTreeContextMenuRequest(const QPoint &pos)
 {
   QTreeWidgetItem *item = tree_widget_->itemAt(pos);
@@ -30,8 +30,10 @@
 
 #include <swri_profiler_tools/profiler_master.h>
 #include <swri_profiler_tools/profiler_window.h>
+#include <swri_profiler_tools/recording_source.h>
 
 #include <QFontDialog>
+#include <QMessageBox>
 
 namespace swri_profiler_tools
 {
@@ -54,6 +56,8 @@ void ProfilerMaster::createNewWindow()
 
   QObject::connect(win, SIGNAL(createNewWindow()),
                    this, SLOT(createNewWindow()));
+  QObject::connect(win, SIGNAL(openRecording(QString)),
+                   this, SLOT(openRecording(QString)));
   QObject::connect(&ros_source_, SIGNAL(connected(bool, QString)),
                    win, SLOT(rosConnected(bool, QString)));
 
@@ -69,4 +73,21 @@ void ProfilerMaster::createNewWindow()
 void ProfilerMaster::rosConnected(bool connected, QString master_uri)
 {
 }
+
+void ProfilerMaster::openRecording(QString filename)
+{
+  // The source deletes itself once the recording has been loaded.
+  RecordingSource *source = new RecordingSource(&db_, filename, this);
+  QObject::connect(source, SIGNAL(failed(QString, QString)),
+                   this, SLOT(recordingFailed(QString, QString)));
+  QObject::connect(source, SIGNAL(finished()),
+                   source, SLOT(deleteLater()));
+  source->start();
+}
+
+void ProfilerMaster::recordingFailed(QString filename, QString error)
+{
+  QMessageBox::warning(NULL, "Open Recording",
+                       QString("Failed to open %1: %2").arg(filename, error));
+}
 }  // namespace swri_profiler_tools
@@ -1,6 +1,12 @@
 #include <swri_profiler_tools/profiler_msg_adapter.h>
 #include <swri_profiler_tools/util.h>
 
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include <swri_profiler/histogram.h>
+
 namespace swri_profiler_tools
 {
 ProfilerMsgAdapter::ProfilerMsgAdapter()
@@ -16,11 +22,25 @@ void ProfilerMsgAdapter::processIndex(const swri_profiler_msgs::ProfileIndexArra
   const QString ros_node_name =
     normalizeNodePath(QString::fromStdString(msg.header.frame_id));
 
-  // An index message contains the entire index table for the message,
+  // Full index messages (and those from publishers that predate
+  // incremental indices) contain the entire index table for the node,
   // so we wipe out any existing index to make sure we are completely
-  // in sync.
-  index_[ros_node_name].clear();
-  
+  // in sync.  A node that restarts sends a full index with sequence
+  // 1.  A requested full index can arrive after newer incremental
+  // messages, in which case we just merge it.  Otherwise the message
+  // only has the new blocks, and if we missed a message there are
+  // blocks we don't know about.
+  uint32_t &sequence = index_sequence_[ros_node_name];
+  const bool full = msg.full || msg.sequence == 0;
+  if (full && (msg.sequence <= 1 || msg.sequence >= sequence)) {
+    index_[ros_node_name].clear();
+    incomplete_index_.erase(ros_node_name);
+    sequence = msg.sequence;
+  } else if (!full && msg.sequence > sequence + 1) {
+    incomplete_index_.insert(ros_node_name);
+  }
+  sequence = std::max(sequence, msg.sequence);
+
   for (auto const &item : msg.data) {
     QString label = normalizeNodePath(QString::fromStdString(item.label));
 
@@ -53,34 +73,144 @@ bool ProfilerMsgAdapter::processData(
     return false;
   }
 
-  int timestamp_sec = std::round(msg.header.stamp.toSec());
+  // Publishers that predate the report_period field always reported
+  // once per second.
+  uint64_t period_ns = msg.report_period.toNSec();
+  if (period_ns == 0) {
+    period_ns = 1000000000;
+  }
+
+  // Decode the duration percentiles from the histograms.
+  static const std::vector<double> percentiles = { 0.50, 0.90, 0.99, 0.999 };
+  const swri_profiler::HistogramDecoder decoder(msg.histogram_sub_bucket_bits,
+                                                msg.histogram_ns_per_unit);
+  std::map<int, std::vector<uint64_t> > percentiles_ns;
+  std::map<int, double> variation;
+  for (auto const &histogram : msg.histograms) {
+    std::vector<uint64_t> &values = percentiles_ns[histogram.key];
+    values.assign(percentiles.size(), 0);
+    if (histogram.buckets.size() != histogram.counts.size()) {
+      qWarning("Histogram for block %d has mismatched buckets and counts.",
+               histogram.key);
+      continue;
+    }
+    decoder.percentiles(values.data(), percentiles.data(), percentiles.size(),
+                        histogram.buckets, histogram.counts);
+    variation[histogram.key] = decoder.variation(histogram.buckets, histogram.counts);
+  }
+
+  std::map<int, NewProfileData> &last_data = last_data_[node_name];
+  if (msg.keyframe) {
+    last_data.clear();
+  }
 
   NewProfileDataVector out;
-  out.reserve(msg.data.size());
+  out.reserve(std::max(msg.data.size(), last_data.size()));
   for (auto const &item : msg.data) {
     if (index_[node_name].count(item.key) == 0) {
       qWarning("No index for block %d of %s. Dropping all data "
                 "because index is probably invalid.",
                 item.key, qPrintable(node_name));
+      incomplete_index_.insert(node_name);
       return false;
     }
 
     out.emplace_back();
     out.back().label = index_[node_name][item.key];
-    out.back().wall_stamp_sec = timestamp_sec;
+    out.back().wall_stamp_ns = msg.header.stamp.toNSec();
+    out.back().period_ns = period_ns;
     out.back().ros_stamp_ns = msg.rostime_stamp.toNSec();
     out.back().cumulative_call_count = item.abs_call_count;
     out.back().cumulative_inclusive_duration_ns = item.abs_total_duration.toNSec();
     out.back().incremental_inclusive_duration_ns = item.rel_total_duration.toNSec();
     out.back().incremental_max_duration_ns = item.rel_max_duration.toNSec();
+    out.back().incremental_cpu_duration_ns = item.rel_cpu_duration.toNSec();
+    out.back().incremental_alloc_count = item.rel_alloc_count;
+    out.back().incremental_alloc_bytes = item.rel_alloc_bytes;
+
+    auto const pct_it = percentiles_ns.find(item.key);
+    if (pct_it != percentiles_ns.end()) {
+      out.back().incremental_p50_duration_ns = pct_it->second[0];
+      out.back().incremental_p90_duration_ns = pct_it->second[1];
+      out.back().incremental_p99_duration_ns = pct_it->second[2];
+      out.back().incremental_p999_duration_ns = pct_it->second[3];
+    } else {
+      out.back().incremental_p50_duration_ns = 0;
+      out.back().incremental_p90_duration_ns = 0;
+      out.back().incremental_p99_duration_ns = 0;
+      out.back().incremental_p999_duration_ns = 0;
+    }
+
+    out.back().compiled_level = msg.compiled_level;
+    out.back().compiled_categories = msg.compiled_categories;
+
+    // Publishers that predate sampling report a period of zero.
+    out.back().sample_period = std::max<uint32_t>(1, item.sample_period);
+    out.back().incremental_duration_error = 0.0;
+    if (out.back().sample_period > 1) {
+      // The relative standard error of a total estimated from n of
+      // the calls, including the finite population correction.  If
+      // no calls were timed, the estimate came from earlier data and
+      // we consider it completely uncertain.
+      const double n = item.rel_timed_count;
+      const double f = 1.0 / out.back().sample_period;
+      if (n > 0) {
+        out.back().incremental_duration_error =
+          variation[item.key] * std::sqrt((1.0 - f) / n);
+      } else {
+        out.back().incremental_duration_error = 1.0;
+      }
+    }
+
+    last_data[item.key] = out.back();
+  }
+
+  // Blocks that were omitted from the report didn't run, so their
+  // cumulative values are unchanged and their incremental values are
+  // zero.
+  if (!msg.keyframe) {
+    std::set<int> reported;
+    for (auto const &item : msg.data) {
+      reported.insert(item.key);
+    }
+
+    for (auto &pair : last_data) {
+      if (reported.count(pair.first)) {
+        continue;
+      }
+
+      NewProfileData &data = pair.second;
+      data.wall_stamp_ns = msg.header.stamp.toNSec();
+      data.period_ns = period_ns;
+      data.ros_stamp_ns = msg.rostime_stamp.toNSec();
+      data.incremental_inclusive_duration_ns = 0;
+      data.incremental_max_duration_ns = 0;
+      data.incremental_cpu_duration_ns = 0;
+      data.incremental_alloc_count = 0;
+      data.incremental_alloc_bytes = 0;
+      data.incremental_p50_duration_ns = 0;
+      data.incremental_p90_duration_ns = 0;
+      data.incremental_p99_duration_ns = 0;
+      data.incremental_p999_duration_ns = 0;
+      data.incremental_duration_error = 0.0;
+      out.push_back(data);
+    }
   }
 
   out_data.insert(out_data.end(), out.begin(), out.end());
   return true;
 }
 
+bool ProfilerMsgAdapter::needsFullIndex(const QString &node_name) const
+{
+  return index_.count(node_name) == 0 || incomplete_index_.count(node_name) > 0;
+}
+
 void ProfilerMsgAdapter::reset()
 {
   index_.clear();
+  index_sequence_.clear();
+  incomplete_index_.clear();
+  last_data_.clear();
 }
 };  // namespace swri_profiler_tools
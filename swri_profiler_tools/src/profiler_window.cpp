@@ -30,6 +30,8 @@
 #include <swri_profiler_tools/profiler_window.h>
 #include <swri_profiler_tools/profile_database.h>
 
+#include <QFileDialog>
+
 namespace swri_profiler_tools
 {
 ProfilerWindow::ProfilerWindow(ProfileDatabase *db)
@@ -41,6 +43,8 @@ ProfilerWindow::ProfilerWindow(ProfileDatabase *db)
   
   QObject::connect(ui.action_NewWindow, SIGNAL(triggered(bool)),
                    this, SIGNAL(createNewWindow()));
+  QObject::connect(ui.action_OpenRecording, SIGNAL(triggered(bool)),
+                   this, SLOT(handleOpenRecording()));
 
   connection_status_ = new QLabel("Not connected");
   statusBar()->addPermanentWidget(connection_status_);
@@ -64,6 +68,15 @@ void ProfilerWindow::closeEvent(QCloseEvent *event)
   QMainWindow::closeEvent(event);
 }
 
+void ProfilerWindow::handleOpenRecording()
+{
+  const QString filename = QFileDialog::getOpenFileName(
+    this, "Open Recording", QString(), "Profiler recordings (*.sprec);;All files (*)");
+  if (!filename.isEmpty()) {
+    Q_EMIT openRecording(filename);
+  }
+}
+
 void ProfilerWindow::rosConnected(bool connected, QString master_uri)
 {
   if (connected) {    
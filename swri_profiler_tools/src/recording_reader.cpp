@@ -0,0 +1,349 @@
+// *****************************************************************************
+//
+// Copyright (c) 2015, Southwest Research Institute® (SwRI®)
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Southwest Research Institute® (SwRI®) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL Southwest Research Institute® BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT 
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY 
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// *****************************************************************************
+#include <swri_profiler_tools/recording_reader.h>
+#include <swri_profiler_tools/util.h>
+
+#include <cstring>
+#include <set>
+
+namespace swri_profiler_tools
+{
+using namespace swri_profiler;
+
+static qint64 paddedSize(uint32_t size)
+{
+  return (static_cast<qint64>(size) + 7) / 8 * 8;
+}
+
+RecordingReader::RecordingReader()
+  :
+  data_(NULL),
+  size_(0)
+{
+}
+
+RecordingReader::~RecordingReader()
+{
+  close();
+}
+
+bool RecordingReader::open(const QString &filename)
+{
+  close();
+
+  file_.setFileName(filename);
+  if (!file_.open(QIODevice::ReadOnly)) {
+    error_string_ = file_.errorString();
+    return false;
+  }
+
+  size_ = file_.size();
+  if (size_ < static_cast<qint64>(sizeof(RecordingFileHeader))) {
+    error_string_ = "The file is not a profiler recording.";
+    close();
+    return false;
+  }
+
+  data_ = file_.map(0, size_);
+  if (!data_) {
+    error_string_ = file_.errorString();
+    close();
+    return false;
+  }
+
+  const RecordingFileHeader *header = reinterpret_cast<const RecordingFileHeader*>(data_);
+  if (std::memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0) {
+    error_string_ = "The file is not a profiler recording.";
+    close();
+    return false;
+  }
+  if (header->version != RECORDING_VERSION) {
+    error_string_ = QString("Unsupported recording version %1.").arg(header->version);
+    close();
+    return false;
+  }
+
+  // Recordings that weren't closed properly don't have an index.
+  if (!readIndex()) {
+    strings_.clear();
+    intervals_.clear();
+    if (!scanChunks()) {
+      close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void RecordingReader::close()
+{
+  if (data_) {
+    file_.unmap(const_cast<uchar*>(data_));
+  }
+  file_.close();
+  data_ = NULL;
+  size_ = 0;
+  strings_.clear();
+  intervals_.clear();
+  labels_.clear();
+  last_data_.clear();
+}
+
+const uchar* RecordingReader::chunk(qint64 offset, uint32_t type, uint32_t &size) const
+{
+  if (offset < static_cast<qint64>(sizeof(RecordingFileHeader)) ||
+      offset % 8 != 0 ||
+      offset > size_ - static_cast<qint64>(sizeof(RecordingChunkHeader))) {
+    return NULL;
+  }
+
+  const RecordingChunkHeader *header =
+    reinterpret_cast<const RecordingChunkHeader*>(data_ + offset);
+  const qint64 payload = offset + sizeof(RecordingChunkHeader);
+  if (header->type != type || paddedSize(header->size) > size_ - payload) {
+    return NULL;
+  }
+
+  size = header->size;
+  return data_ + payload;
+}
+
+bool RecordingReader::readIndex()
+{
+  const qint64 trailer_offset = size_ - sizeof(RecordingTrailer);
+  if (trailer_offset < static_cast<qint64>(sizeof(RecordingFileHeader))) {
+    return false;
+  }
+
+  // The trailer isn't necessarily aligned if the file is truncated.
+  RecordingTrailer trailer;
+  std::memcpy(&trailer, data_ + trailer_offset, sizeof(trailer));
+  if (std::memcmp(trailer.magic, RECORDING_INDEX_MAGIC, sizeof(trailer.magic)) != 0 ||
+      trailer.index_offset > static_cast<uint64_t>(trailer_offset)) {
+    return false;
+  }
+
+  uint32_t size;
+  const uchar *payload = chunk(trailer.index_offset, RECORDING_CHUNK_INDEX, size);
+  if (!payload || size < sizeof(RecordingIndex)) {
+    return false;
+  }
+
+  const RecordingIndex *index = reinterpret_cast<const RecordingIndex*>(payload);
+  const uint64_t entries_size =
+    index->strings_count * sizeof(uint64_t) +
+    index->interval_count * sizeof(RecordingIndexEntry);
+  if (index->interval_count > size || entries_size != size - sizeof(RecordingIndex)) {
+    return false;
+  }
+
+  const uint64_t *strings_offsets =
+    reinterpret_cast<const uint64_t*>(payload + sizeof(RecordingIndex));
+  for (uint32_t i = 0; i < index->strings_count; i++) {
+    if (!readStrings(strings_offsets[i])) {
+      return false;
+    }
+  }
+
+  const RecordingIndexEntry *entries = reinterpret_cast<const RecordingIndexEntry*>(
+    strings_offsets + index->strings_count);
+  intervals_.reserve(index->interval_count);
+  for (uint64_t i = 0; i < index->interval_count; i++) {
+    intervals_.push_back(entries[i].offset);
+  }
+  return true;
+}
+
+bool RecordingReader::scanChunks()
+{
+  qint64 offset = sizeof(RecordingFileHeader);
+  while (offset <= size_ - static_cast<qint64>(sizeof(RecordingChunkHeader))) {
+    const RecordingChunkHeader *header =
+      reinterpret_cast<const RecordingChunkHeader*>(data_ + offset);
+    const qint64 next = offset + sizeof(RecordingChunkHeader) + paddedSize(header->size);
+    if (next > size_) {
+      // The recorder was stopped in the middle of a chunk.
+      break;
+    }
+
+    if (header->type == RECORDING_CHUNK_STRINGS) {
+      if (!readStrings(offset)) {
+        error_string_ = "The recording's string table is corrupt.";
+        return false;
+      }
+    } else if (header->type == RECORDING_CHUNK_INTERVAL) {
+      intervals_.push_back(offset);
+    }
+    offset = next;
+  }
+
+  return true;
+}
+
+bool RecordingReader::readStrings(qint64 offset)
+{
+  uint32_t size;
+  const uchar *payload = chunk(offset, RECORDING_CHUNK_STRINGS, size);
+  if (!payload || size < sizeof(uint32_t)) {
+    return false;
+  }
+
+  const uchar *end = payload + size;
+  uint32_t count;
+  std::memcpy(&count, payload, sizeof(count));
+  payload += sizeof(count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t length;
+    if (end - payload < static_cast<qint64>(sizeof(length))) {
+      return false;
+    }
+    std::memcpy(&length, payload, sizeof(length));
+    payload += sizeof(length);
+    if (end - payload < static_cast<qint64>(length)) {
+      return false;
+    }
+    strings_.push_back(QString::fromUtf8(reinterpret_cast<const char*>(payload), length));
+    payload += length;
+  }
+
+  return true;
+}
+
+const QString& RecordingReader::label(uint32_t node, uint32_t label)
+{
+  const std::pair<uint32_t, uint32_t> key(node, label);
+  auto const it = labels_.find(key);
+  if (it != labels_.end()) {
+    return it->second;
+  }
+
+  // Labels are relative to the node unless they already start with
+  // its name, just as for live data (see ProfilerMsgAdapter).
+  const QString node_name = normalizeNodePath(strings_[node]);
+  QString full_label = normalizeNodePath(strings_[label]);
+  if (!full_label.startsWith(node_name)) {
+    full_label = node_name + full_label;
+  }
+  return labels_[key] = full_label;
+}
+
+bool RecordingReader::readInterval(NewProfileDataVector &out_data, size_t index)
+{
+  if (index >= intervals_.size()) {
+    return false;
+  }
+
+  uint32_t size;
+  const uchar *payload = chunk(intervals_[index], RECORDING_CHUNK_INTERVAL, size);
+  if (!payload || size < sizeof(RecordingInterval)) {
+    return false;
+  }
+
+  const RecordingInterval *interval = reinterpret_cast<const RecordingInterval*>(payload);
+  const size_t count = interval->count;
+  const size_t row_size = RECORDING_COLUMN_COUNT * sizeof(uint64_t);
+  if ((size - sizeof(RecordingInterval)) / row_size < count ||
+      interval->node >= strings_.size()) {
+    return false;
+  }
+
+  const uint64_t *columns = reinterpret_cast<const uint64_t*>(payload + sizeof(RecordingInterval));
+  for (size_t r = 0; r < count; r++) {
+    if (columns[RECORDING_COLUMN_LABEL*count + r] >= strings_.size()) {
+      return false;
+    }
+  }
+
+  std::map<QString, NewProfileData> &last_data = last_data_[interval->node];
+  if (interval->keyframe) {
+    last_data.clear();
+  }
+
+  std::set<QString> reported;
+  for (size_t r = 0; r < count; r++) {
+    NewProfileData data;
+    data.label = label(interval->node, columns[RECORDING_COLUMN_LABEL*count + r]);
+    data.wall_stamp_ns = interval->wall_stamp_ns;
+    data.period_ns = interval->period_ns;
+    data.ros_stamp_ns = interval->ros_stamp_ns;
+    data.cumulative_call_count = columns[RECORDING_COLUMN_CUMULATIVE_CALL_COUNT*count + r];
+    data.cumulative_inclusive_duration_ns = columns[RECORDING_COLUMN_CUMULATIVE_DURATION*count + r];
+    data.incremental_inclusive_duration_ns = columns[RECORDING_COLUMN_DURATION*count + r];
+    data.incremental_max_duration_ns = columns[RECORDING_COLUMN_MAX_DURATION*count + r];
+    data.incremental_p50_duration_ns = columns[RECORDING_COLUMN_P50_DURATION*count + r];
+    data.incremental_p90_duration_ns = columns[RECORDING_COLUMN_P90_DURATION*count + r];
+    data.incremental_p99_duration_ns = columns[RECORDING_COLUMN_P99_DURATION*count + r];
+    data.incremental_p999_duration_ns = columns[RECORDING_COLUMN_P999_DURATION*count + r];
+    data.sample_period = columns[RECORDING_COLUMN_SAMPLE_PERIOD*count + r];
+    std::memcpy(&data.incremental_duration_error,
+                &columns[RECORDING_COLUMN_DURATION_ERROR*count + r],
+                sizeof(data.incremental_duration_error));
+    data.incremental_cpu_duration_ns = columns[RECORDING_COLUMN_CPU_DURATION*count + r];
+    data.incremental_alloc_count = columns[RECORDING_COLUMN_ALLOC_COUNT*count + r];
+    data.incremental_alloc_bytes = columns[RECORDING_COLUMN_ALLOC_BYTES*count + r];
+    data.compiled_level = interval->compiled_level;
+    data.compiled_categories = interval->compiled_categories;
+
+    out_data.push_back(data);
+    last_data[data.label] = data;
+    reported.insert(data.label);
+  }
+
+  if (interval->keyframe) {
+    return true;
+  }
+
+  for (auto &pair : last_data) {
+    if (reported.count(pair.first)) {
+      continue;
+    }
+
+    NewProfileData &data = pair.second;
+    data.wall_stamp_ns = interval->wall_stamp_ns;
+    data.period_ns = interval->period_ns;
+    data.ros_stamp_ns = interval->ros_stamp_ns;
+    data.incremental_inclusive_duration_ns = 0;
+    data.incremental_max_duration_ns = 0;
+    data.incremental_cpu_duration_ns = 0;
+    data.incremental_alloc_count = 0;
+    data.incremental_alloc_bytes = 0;
+    data.incremental_p50_duration_ns = 0;
+    data.incremental_p90_duration_ns = 0;
+    data.incremental_p99_duration_ns = 0;
+    data.incremental_p999_duration_ns = 0;
+    data.incremental_duration_error = 0.0;
+    out_data.push_back(data);
+  }
+
+  return true;
+}
+}  // namespace swri_profiler_tools
@@ -0,0 +1,124 @@
+// *****************************************************************************
+//
+// Copyright (c) 2015, Southwest Research Institute® (SwRI®)
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Southwest Research Institute® (SwRI®) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL Southwest Research Institute® BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT 
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY 
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// *****************************************************************************
+#include <swri_profiler_tools/recording_source.h>
+#include <swri_profiler_tools/recording_source_backend.h>
+#include <swri_profiler_tools/profile_database.h>
+
+#include <QFileInfo>
+
+namespace swri_profiler_tools
+{
+RecordingSource::RecordingSource(ProfileDatabase *db, const QString &filename, QObject *parent)
+  :
+  QObject(parent),
+  db_(db),
+  filename_(filename),
+  backend_(NULL),
+  profile_key_(-1)
+{
+}
+
+RecordingSource::~RecordingSource()
+{
+  // The backend never reads more than one batch before returning to
+  // its event loop, so this doesn't take long.
+  thread_.quit();
+  thread_.wait();
+}
+
+void RecordingSource::start()
+{
+  if (backend_) {
+    return;
+  }
+
+  backend_ = new RecordingSourceBackend();
+  backend_->moveToThread(&thread_);
+
+  QObject::connect(&thread_, SIGNAL(finished()),
+                   backend_, SLOT(deleteLater()));
+
+  QObject::connect(backend_, SIGNAL(opened()),
+                   this, SLOT(handleOpened()));
+  QObject::connect(backend_, SIGNAL(failed(QString)),
+                   this, SLOT(handleFailed(QString)));
+  QObject::connect(backend_, SIGNAL(dataRead(swri_profiler_tools::NewProfileDataVector)),
+                   this, SLOT(handleData(swri_profiler_tools::NewProfileDataVector)));
+  QObject::connect(backend_, SIGNAL(finished(int)),
+                   this, SLOT(handleFinished(int)));
+  QObject::connect(this, SIGNAL(openRequested(QString)),
+                   backend_, SLOT(open(QString)));
+  QObject::connect(this, SIGNAL(batchRequested()),
+                   backend_, SLOT(readBatch()));
+
+  thread_.start();
+  Q_EMIT openRequested(filename_);
+}
+
+void RecordingSource::handleOpened()
+{
+  profile_key_ = db_->createProfile(QFileInfo(filename_).fileName());
+  if (profile_key_ < 0) {
+    qWarning("Failed to create a new profile for '%s'.", qPrintable(filename_));
+    Q_EMIT finished();
+    return;
+  }
+
+  Q_EMIT batchRequested();
+}
+
+void RecordingSource::handleFailed(QString error)
+{
+  qWarning("Failed to open recording '%s': %s",
+           qPrintable(filename_), qPrintable(error));
+  Q_EMIT failed(filename_, error);
+  Q_EMIT finished();
+}
+
+void RecordingSource::handleData(NewProfileDataVector data)
+{
+  Profile &profile = db_->profile(profile_key_);
+  if (!profile.isValid()) {
+    Q_EMIT finished();
+    return;
+  }
+
+  profile.addData(data);
+  Q_EMIT batchRequested();
+}
+
+void RecordingSource::handleFinished(int corrupt)
+{
+  if (corrupt) {
+    qWarning("Skipped %d corrupt intervals in '%s'.", corrupt, qPrintable(filename_));
+  }
+  Q_EMIT finished();
+}
+}  // namespace swri_profiler_tools
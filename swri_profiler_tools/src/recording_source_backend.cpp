@@ -0,0 +1,76 @@
+// *****************************************************************************
+//
+// Copyright (c) 2015, Southwest Research Institute® (SwRI®)
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Southwest Research Institute® (SwRI®) nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL Southwest Research Institute® BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT 
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY 
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// *****************************************************************************
+#include <swri_profiler_tools/recording_source_backend.h>
+
+namespace swri_profiler_tools
+{
+// The data is sent in batches, since every batch updates the views.
+static const size_t BATCH_SIZE = 100000;
+
+RecordingSourceBackend::RecordingSourceBackend()
+  :
+  next_interval_(0),
+  corrupt_(0)
+{
+}
+
+RecordingSourceBackend::~RecordingSourceBackend()
+{
+}
+
+void RecordingSourceBackend::open(QString filename)
+{
+  next_interval_ = 0;
+  corrupt_ = 0;
+  if (!reader_.open(filename)) {
+    Q_EMIT failed(reader_.errorString());
+    return;
+  }
+  Q_EMIT opened();
+}
+
+void RecordingSourceBackend::readBatch()
+{
+  if (next_interval_ >= reader_.intervalCount()) {
+    reader_.close();
+    Q_EMIT finished(corrupt_);
+    return;
+  }
+
+  NewProfileDataVector data;
+  while (next_interval_ < reader_.intervalCount() && data.size() < BATCH_SIZE) {
+    if (!reader_.readInterval(data, next_interval_)) {
+      corrupt_++;
+    }
+    next_interval_++;
+  }
+  Q_EMIT dataRead(data);
+}
+}  // namespace swri_profiler_tools
@@ -1,6 +1,7 @@
 #include <QMetaType>
 #include <swri_profiler_msgs/ProfileIndexArray.h>
 #include <swri_profiler_msgs/ProfileDataArray.h>
+#include <swri_profiler_tools/new_profile_data.h>
 
 namespace swri_profiler_tools
 {
@@ -10,6 +11,7 @@ void registerMetaTypes()
   // pass them in Qt queued signals/slots (across threads).
   qRegisterMetaType<swri_profiler_msgs::ProfileIndexArray>("swri_profiler_msgs::ProfileIndexArray");
   qRegisterMetaType<swri_profiler_msgs::ProfileDataArray>("swri_profiler_msgs::ProfileDataArray");
+  qRegisterMetaType<NewProfileDataVector>("swri_profiler_tools::NewProfileDataVector");
 }
 }  // namespace swri_profiler_tools
 
@@ -78,6 +78,8 @@ void RosSource::start()
                    this, SLOT(handleIndex(swri_profiler_msgs::ProfileIndexArray)));
   QObject::connect(backend_, SIGNAL(dataReceived(swri_profiler_msgs::ProfileDataArray)),
                    this, SLOT(handleData(swri_profiler_msgs::ProfileDataArray)));
+  QObject::connect(this, SIGNAL(indexRequested(QString)),
+                   backend_, SLOT(requestIndex(QString)));
 
   ros_thread_.start();
 }
@@ -109,7 +111,16 @@ void RosSource::handleIndex(swri_profiler_msgs::ProfileIndexArray msg)
 void RosSource::handleData(swri_profiler_msgs::ProfileDataArray msg)
 {
   NewProfileDataVector new_data;
-  if (!msg_adapter_.processData(new_data, msg)) {
+  const bool valid = msg_adapter_.processData(new_data, msg);
+
+  // Index messages only contain new blocks, so if we joined late or
+  // missed one, we need to ask the node for its full index.
+  const QString node_name = QString::fromStdString(msg.header.frame_id);
+  if (msg_adapter_.needsFullIndex(node_name)) {
+    Q_EMIT indexRequested(node_name);
+  }
+
+  if (!valid) {
     return;
   }
 
@@ -31,6 +31,7 @@
 #include <swri_profiler_tools/ros_source_backend.h>
 #include <QCoreApplication>
 #include <ros/ros.h>
+#include <swri_profiler_msgs/GetProfileIndex.h>
 
 namespace swri_profiler_tools
 {
@@ -73,6 +74,7 @@ void RosSourceBackend::stopRos()
 {
   ros::shutdown();
   is_connected_ = false;
+  last_index_request_.clear();
   Q_EMIT connected(false, QString());
 }
 
@@ -89,6 +91,30 @@ void RosSourceBackend::timerEvent(QTimerEvent *event)
   }    
 }
 
+void RosSourceBackend::requestIndex(QString node_name)
+{
+  if (!is_connected_) {
+    return;
+  }
+
+  // Data keeps arriving while we wait for the index, so we only ask
+  // every few seconds.
+  const std::string name = node_name.toStdString();
+  const ros::WallTime now = ros::WallTime::now();
+  auto const it = last_index_request_.find(name);
+  if (it != last_index_request_.end() && now - it->second < ros::WallDuration(5.0)) {
+    return;
+  }
+  last_index_request_[name] = now;
+
+  swri_profiler_msgs::GetProfileIndex srv;
+  if (!ros::service::call(name + "/swri_profiler/get_index", srv)) {
+    qWarning("Failed to get the index for node '%s'.", qPrintable(node_name));
+    return;
+  }
+  Q_EMIT indexReceived(srv.response.index);
+}
+
 void RosSourceBackend::handleIndex(const swri_profiler_msgs::ProfileIndexArray &msg)
 {
   Q_EMIT indexReceived(msg);
@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+#include <swri_profiler_tools/profiler_msg_adapter.h>
+
+namespace spm = swri_profiler_msgs;
+using swri_profiler_tools::NewProfileData;
+using swri_profiler_tools::NewProfileDataVector;
+using swri_profiler_tools::ProfilerMsgAdapter;
+
+static spm::ProfileIndexArray makeIndex(uint32_t sequence, bool full)
+{
+  spm::ProfileIndexArray msg;
+  msg.header.frame_id = "/node";
+  msg.sequence = sequence;
+  msg.full = full;
+  return msg;
+}
+
+static void addLabel(spm::ProfileIndexArray &msg, uint32_t key, const std::string &label)
+{
+  msg.data.emplace_back();
+  msg.data.back().key = key;
+  msg.data.back().label = label;
+}
+
+static spm::ProfileDataArray makeData(int seconds, bool keyframe)
+{
+  spm::ProfileDataArray msg;
+  msg.header.frame_id = "/node";
+  msg.header.stamp = ros::Time(seconds, 0);
+  msg.report_period = ros::Duration(1, 0);
+  msg.keyframe = keyframe;
+  return msg;
+}
+
+static void addBlock(spm::ProfileDataArray &msg, uint32_t key, uint64_t calls, int64_t rel_ms)
+{
+  msg.data.emplace_back();
+  msg.data.back().key = key;
+  msg.data.back().abs_call_count = calls;
+  msg.data.back().abs_total_duration = ros::Duration(calls * 0.001);
+  msg.data.back().rel_total_duration = ros::Duration(rel_ms * 0.001);
+  msg.data.back().sample_period = 1;
+}
+
+// Returns the output rows by label.
+static std::map<std::string, NewProfileData> byLabel(const NewProfileDataVector &data)
+{
+  std::map<std::string, NewProfileData> result;
+  for (auto const &item : data) {
+    result[item.label.toStdString()] = item;
+  }
+  return result;
+}
+
+class ProfilerMsgAdapterTest : public ::testing::Test
+{
+ protected:
+  ProfilerMsgAdapter adapter_;
+
+  void SetUp()
+  {
+    spm::ProfileIndexArray index = makeIndex(1, true);
+    addLabel(index, 1, "/a");
+    addLabel(index, 2, "/a/b");
+    adapter_.processIndex(index);
+  }
+};
+
+TEST_F(ProfilerMsgAdapterTest, KeyframeReportsEveryBlock)
+{
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 1, 10, 100);
+  addBlock(msg, 2, 5, 40);
+
+  NewProfileDataVector out;
+  ASSERT_TRUE(adapter_.processData(out, msg));
+  auto rows = byLabel(out);
+  ASSERT_EQ(2u, rows.size());
+  EXPECT_EQ(10u, rows["/node/a"].cumulative_call_count);
+  EXPECT_EQ(100000000u, rows["/node/a"].incremental_inclusive_duration_ns);
+  EXPECT_EQ(5u, rows["/node/a/b"].cumulative_call_count);
+  EXPECT_EQ(1000000000u, rows["/node/a"].period_ns);
+}
+
+TEST_F(ProfilerMsgAdapterTest, DeltaFillsInOmittedBlocks)
+{
+  spm::ProfileDataArray keyframe = makeData(1, true);
+  addBlock(keyframe, 1, 10, 100);
+  addBlock(keyframe, 2, 5, 40);
+  NewProfileDataVector out;
+  ASSERT_TRUE(adapter_.processData(out, keyframe));
+
+  // Only /a ran during the second interval.
+  spm::ProfileDataArray delta = makeData(2, false);
+  addBlock(delta, 1, 12, 20);
+  out.clear();
+  ASSERT_TRUE(adapter_.processData(out, delta));
+  auto rows = byLabel(out);
+  ASSERT_EQ(2u, rows.size());
+  EXPECT_EQ(12u, rows["/node/a"].cumulative_call_count);
+  EXPECT_EQ(20000000u, rows["/node/a"].incremental_inclusive_duration_ns);
+
+  // The omitted block keeps its cumulative values, has no
+  // incremental time, and is stamped with the new interval.
+  EXPECT_EQ(5u, rows["/node/a/b"].cumulative_call_count);
+  EXPECT_EQ(5000000u, rows["/node/a/b"].cumulative_inclusive_duration_ns);
+  EXPECT_EQ(0u, rows["/node/a/b"].incremental_inclusive_duration_ns);
+  EXPECT_EQ(2000000000u, rows["/node/a/b"].wall_stamp_ns);
+}
+
+TEST_F(ProfilerMsgAdapterTest, KeyframeForgetsOmittedBlocks)
+{
+  spm::ProfileDataArray first = makeData(1, true);
+  addBlock(first, 1, 10, 100);
+  addBlock(first, 2, 5, 40);
+  NewProfileDataVector out;
+  ASSERT_TRUE(adapter_.processData(out, first));
+
+  // A keyframe is complete, so blocks it doesn't have aren't filled in.
+  spm::ProfileDataArray second = makeData(2, true);
+  addBlock(second, 1, 11, 10);
+  out.clear();
+  ASSERT_TRUE(adapter_.processData(out, second));
+  ASSERT_EQ(1u, out.size());
+  EXPECT_EQ("/node/a", out[0].label.toStdString());
+}
+
+TEST_F(ProfilerMsgAdapterTest, DataWithoutIndexIsDropped)
+{
+  spm::ProfileDataArray msg = makeData(1, true);
+  msg.header.frame_id = "/other";
+  addBlock(msg, 1, 10, 100);
+
+  NewProfileDataVector out;
+  EXPECT_FALSE(adapter_.processData(out, msg));
+  EXPECT_TRUE(out.empty());
+  EXPECT_TRUE(adapter_.needsFullIndex("/other"));
+}
+
+TEST(ProfilerMsgAdapterIndex, IncrementalIndexAddsBlocks)
+{
+  ProfilerMsgAdapter adapter;
+  spm::ProfileIndexArray first = makeIndex(1, true);
+  addLabel(first, 1, "/a");
+  adapter.processIndex(first);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  spm::ProfileIndexArray second = makeIndex(2, false);
+  addLabel(second, 2, "/b");
+  adapter.processIndex(second);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 1, 1, 1);
+  addBlock(msg, 2, 1, 1);
+  NewProfileDataVector out;
+  ASSERT_TRUE(adapter.processData(out, msg));
+  auto rows = byLabel(out);
+  EXPECT_EQ(1u, rows.count("/node/a"));
+  EXPECT_EQ(1u, rows.count("/node/b"));
+}
+
+TEST(ProfilerMsgAdapterIndex, GapRequiresFullIndex)
+{
+  ProfilerMsgAdapter adapter;
+  spm::ProfileIndexArray first = makeIndex(1, true);
+  addLabel(first, 1, "/a");
+  adapter.processIndex(first);
+
+  // Sequence 2 was lost.
+  spm::ProfileIndexArray third = makeIndex(3, false);
+  addLabel(third, 3, "/c");
+  adapter.processIndex(third);
+  EXPECT_TRUE(adapter.needsFullIndex("/node"));
+
+  // The requested full index catches us up.
+  spm::ProfileIndexArray full = makeIndex(3, true);
+  addLabel(full, 1, "/a");
+  addLabel(full, 2, "/b");
+  addLabel(full, 3, "/c");
+  adapter.processIndex(full);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 2, 1, 1);
+  NewProfileDataVector out;
+  EXPECT_TRUE(adapter.processData(out, msg));
+}
+
+TEST(ProfilerMsgAdapterIndex, StaleFullIndexIsMerged)
+{
+  ProfilerMsgAdapter adapter;
+  spm::ProfileIndexArray first = makeIndex(1, true);
+  addLabel(first, 1, "/a");
+  adapter.processIndex(first);
+
+  // A full index requested at sequence 2 arrives after sequence 3.
+  spm::ProfileIndexArray second = makeIndex(2, false);
+  addLabel(second, 2, "/b");
+  adapter.processIndex(second);
+  spm::ProfileIndexArray third = makeIndex(3, false);
+  addLabel(third, 3, "/c");
+  adapter.processIndex(third);
+  spm::ProfileIndexArray stale = makeIndex(2, true);
+  addLabel(stale, 1, "/a");
+  addLabel(stale, 2, "/b");
+  adapter.processIndex(stale);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  // Block 3 must not have been forgotten.
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 3, 1, 1);
+  NewProfileDataVector out;
+  EXPECT_TRUE(adapter.processData(out, msg));
+}
+
+TEST(ProfilerMsgAdapterIndex, RestartReplacesIndex)
+{
+  ProfilerMsgAdapter adapter;
+  spm::ProfileIndexArray first = makeIndex(1, true);
+  addLabel(first, 1, "/a");
+  addLabel(first, 2, "/b");
+  adapter.processIndex(first);
+  spm::ProfileIndexArray second = makeIndex(5, false);
+  adapter.processIndex(second);
+
+  // The node restarted and reused key 1 for a different block.
+  spm::ProfileIndexArray restarted = makeIndex(1, true);
+  addLabel(restarted, 1, "/z");
+  adapter.processIndex(restarted);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 1, 1, 1);
+  NewProfileDataVector out;
+  ASSERT_TRUE(adapter.processData(out, msg));
+  ASSERT_EQ(1u, out.size());
+  EXPECT_EQ("/node/z", out[0].label.toStdString());
+
+  msg.data.clear();
+  addBlock(msg, 2, 1, 1);
+  EXPECT_FALSE(adapter.processData(out, msg));
+}
+
+TEST(ProfilerMsgAdapterIndex, LegacyIndexIsAlwaysFull)
+{
+  ProfilerMsgAdapter adapter;
+  spm::ProfileIndexArray first = makeIndex(0, false);
+  addLabel(first, 1, "/a");
+  adapter.processIndex(first);
+  spm::ProfileIndexArray second = makeIndex(0, false);
+  addLabel(second, 2, "/b");
+  adapter.processIndex(second);
+  EXPECT_FALSE(adapter.needsFullIndex("/node"));
+
+  spm::ProfileDataArray msg = makeData(1, true);
+  addBlock(msg, 1, 1, 1);
+  NewProfileDataVector out;
+  EXPECT_FALSE(adapter.processData(out, msg));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include <swri_profiler/recording_writer.h>
+#include <swri_profiler_tools/recording_reader.h>
+
+namespace spm = swri_profiler_msgs;
+using swri_profiler::RecordingWriter;
+using swri_profiler_tools::NewProfileData;
+using swri_profiler_tools::NewProfileDataVector;
+using swri_profiler_tools::RecordingReader;
+
+class Recording : public testing::Test
+{
+ protected:
+  std::string filename_;
+
+  virtual void SetUp()
+  {
+    char filename[] = "/tmp/test_recording_XXXXXX";
+    const int fd = mkstemp(filename);
+    ASSERT_GE(fd, 0);
+    ::close(fd);
+    filename_ = filename;
+  }
+
+  virtual void TearDown()
+  {
+    std::remove(filename_.c_str());
+  }
+
+  off_t fileSize() const
+  {
+    struct stat st;
+    return stat(filename_.c_str(), &st) == 0 ? st.st_size : -1;
+  }
+
+  static spm::ProfileIndexArray makeIndex()
+  {
+    spm::ProfileIndexArray msg;
+    msg.header.frame_id = "/node";
+    msg.sequence = 1;
+    msg.full = true;
+    msg.data.resize(2);
+    msg.data[0].key = 1;
+    msg.data[0].label = "/a";
+    msg.data[1].key = 2;
+    msg.data[1].label = "/a/b";
+    return msg;
+  }
+
+  // A report with 10 calls of block 1 in bucket 70, and block 2 if
+  // requested.
+  static spm::ProfileDataArray makeData(int seconds, bool keyframe, bool with_b)
+  {
+    spm::ProfileDataArray msg;
+    msg.header.frame_id = "/node";
+    msg.header.stamp = ros::Time(seconds, 0);
+    msg.rostime_stamp = ros::Time(seconds, 500);
+    msg.report_period = ros::Duration(1.0);
+    msg.keyframe = keyframe;
+    msg.histogram_sub_bucket_bits = 5;
+    msg.histogram_ns_per_unit = 1.0;
+
+    spm::ProfileData a;
+    a.key = 1;
+    a.abs_call_count = 10 * seconds;
+    a.abs_total_duration = ros::Duration(0, 1000 * seconds);
+    a.rel_total_duration = ros::Duration(0, 1000);
+    a.rel_max_duration = ros::Duration(0, 100);
+    a.sample_period = 1;
+    a.rel_timed_count = 10;
+    a.rel_alloc_count = 3;
+    msg.data.push_back(a);
+
+    spm::ProfileHistogram histogram;
+    histogram.key = 1;
+    histogram.buckets.push_back(70);
+    histogram.counts.push_back(10);
+    msg.histograms.push_back(histogram);
+
+    if (with_b) {
+      spm::ProfileData b;
+      b.key = 2;
+      b.abs_call_count = seconds;
+      b.abs_total_duration = ros::Duration(0, 500 * seconds);
+      b.rel_total_duration = ros::Duration(0, 500);
+      b.sample_period = 1;
+      msg.data.push_back(b);
+    }
+    return msg;
+  }
+
+  static std::map<QString, NewProfileData> byLabel(const NewProfileDataVector &data)
+  {
+    std::map<QString, NewProfileData> out;
+    for (auto const &item : data) {
+      out[item.label] = item;
+    }
+    return out;
+  }
+};
+
+TEST_F(Recording, RoundTrip)
+{
+  RecordingWriter writer;
+  ASSERT_TRUE(writer.open(filename_));
+  writer.addIndex(makeIndex());
+  EXPECT_TRUE(writer.addData(makeData(1, true, true)));
+  EXPECT_TRUE(writer.addData(makeData(2, false, false)));
+  writer.close();
+
+  RecordingReader reader;
+  ASSERT_TRUE(reader.open(QString::fromStdString(filename_)));
+  ASSERT_EQ(2u, reader.intervalCount());
+
+  NewProfileDataVector data;
+  ASSERT_TRUE(reader.readInterval(data, 0));
+  std::map<QString, NewProfileData> blocks = byLabel(data);
+  ASSERT_EQ(2u, blocks.size());
+  const NewProfileData &a = blocks["/node/a"];
+  EXPECT_EQ(1000000000, a.wall_stamp_ns);
+  EXPECT_EQ(1000000500, a.ros_stamp_ns);
+  EXPECT_EQ(1000000000, a.period_ns);
+  EXPECT_EQ(10u, a.cumulative_call_count);
+  EXPECT_EQ(1000u, a.cumulative_inclusive_duration_ns);
+  EXPECT_EQ(1000u, a.incremental_inclusive_duration_ns);
+  EXPECT_EQ(100u, a.incremental_max_duration_ns);
+  EXPECT_EQ(3u, a.incremental_alloc_count);
+  // Bucket 70 holds [76, 78) with 5 sub-bucket bits.
+  EXPECT_EQ(77u, a.incremental_p50_duration_ns);
+  EXPECT_EQ(500u, blocks["/node/a/b"].incremental_inclusive_duration_ns);
+
+  // The second interval omits block b, which is filled in from the
+  // first with no incremental time.
+  data.clear();
+  ASSERT_TRUE(reader.readInterval(data, 1));
+  blocks = byLabel(data);
+  ASSERT_EQ(2u, blocks.size());
+  EXPECT_EQ(20u, blocks["/node/a"].cumulative_call_count);
+  EXPECT_EQ(2000000000, blocks["/node/a/b"].wall_stamp_ns);
+  EXPECT_EQ(1u, blocks["/node/a/b"].cumulative_call_count);
+  EXPECT_EQ(0u, blocks["/node/a/b"].incremental_inclusive_duration_ns);
+
+  EXPECT_FALSE(reader.readInterval(data, 2));
+}
+
+TEST_F(Recording, TruncatedWithoutTrailer)
+{
+  // Record the size after each interval, then cut the file in the
+  // middle of the last interval, which also removes the index and
+  // trailer, as if the recorder had been killed.
+  RecordingWriter writer;
+  ASSERT_TRUE(writer.open(filename_));
+  writer.addIndex(makeIndex());
+  writer.addData(makeData(1, true, true));
+  writer.addData(makeData(2, true, true));
+  const off_t complete = fileSize();
+  writer.addData(makeData(3, true, true));
+  const off_t partial = fileSize();
+  writer.close();
+  ASSERT_LT(complete, partial);
+
+  ASSERT_EQ(0, truncate(filename_.c_str(), (complete + partial) / 2));
+  RecordingReader reader;
+  ASSERT_TRUE(reader.open(QString::fromStdString(filename_)));
+  ASSERT_EQ(2u, reader.intervalCount());
+
+  NewProfileDataVector data;
+  ASSERT_TRUE(reader.readInterval(data, 0));
+  ASSERT_TRUE(reader.readInterval(data, 1));
+  std::map<QString, NewProfileData> blocks = byLabel(data);
+  EXPECT_EQ(20u, blocks["/node/a"].cumulative_call_count);
+
+  // A file cut at a chunk boundary is read up to the boundary.
+  reader.close();
+  ASSERT_EQ(0, truncate(filename_.c_str(), complete));
+  ASSERT_TRUE(reader.open(QString::fromStdString(filename_)));
+  EXPECT_EQ(2u, reader.intervalCount());
+}
+
+TEST_F(Recording, RejectsOtherFiles)
+{
+  FILE *file = std::fopen(filename_.c_str(), "w");
+  ASSERT_TRUE(file != NULL);
+  std::fputs("This is not a recording.", file);
+  std::fclose(file);
+
+  RecordingReader reader;
+  EXPECT_FALSE(reader.open(QString::fromStdString(filename_)));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <set>
+#include <string>
+
+#include <ros/init.h>
+#include <ros/master.h>
+#include <swri_profiler/profiler.h>
+#include <swri_profiler_tools/recording_reader.h>
+
+using swri_profiler::Profiler;
+using swri_profiler_tools::NewProfileDataVector;
+using swri_profiler_tools::RecordingReader;
+
+// The recording that the record sink writes to.  It is selected in
+// main(), since the sinks are loaded when the profiler is initialized.
+static std::string filename_;
+
+// Blocks profiled before ros::init() are reported under the program's
+// name and then under the node name, so the record sink needs a full
+// index under the new name to label them.
+TEST(RosAttach, BlocksProfiledBeforeRosInitAreLabelled)
+{
+  {
+    SWRI_PROFILE("before_init");
+  }
+  ros::WallDuration(0.3).sleep();
+
+  // Without a master, every call to it fails after the retry timeout
+  // instead of blocking the publishing thread.
+  int argc = 0;
+  ros::master::setRetryTimeout(ros::WallDuration(0.1));
+  ros::init(argc, NULL, "test_ros_attach",
+            ros::init_options::NoRosout | ros::init_options::NoSigintHandler);
+  ros::WallDuration(2.0).sleep();
+
+  {
+    SWRI_PROFILE("after_init");
+  }
+  ros::WallDuration(0.3).sleep();
+  Profiler::stopCollector();
+
+  RecordingReader reader;
+  ASSERT_TRUE(reader.open(QString::fromStdString(filename_)));
+  ASSERT_GT(reader.intervalCount(), 0u);
+
+  std::set<QString> labels;
+  NewProfileDataVector data;
+  for (size_t i = 0; i < reader.intervalCount(); i++) {
+    data.clear();
+    ASSERT_TRUE(reader.readInterval(data, i));
+    for (auto const &item : data) {
+      labels.insert(item.label);
+    }
+  }
+  EXPECT_EQ(1u, labels.count("/test_ros_attach/before_init"));
+  EXPECT_EQ(1u, labels.count("/test_ros_attach/after_init"));
+}
+
+int main(int argc, char **argv)
+{
+  char filename[] = "/tmp/test_ros_attach_XXXXXX";
+  const int fd = mkstemp(filename);
+  if (fd < 0) {
+    return 1;
+  }
+  ::close(fd);
+  filename_ = filename;
+
+  setenv("SWRI_PROFILER_SINK", ("record:" + filename_).c_str(), 1);
+  setenv("SWRI_PROFILER_PERIOD", "0.05", 1);
+  setenv("ROS_MASTER_URI", "http://localhost:11311", 0);
+
+  testing::InitGoogleTest(&argc, argv);
+  const int result = RUN_ALL_TESTS();
+  std::remove(filename_.c_str());
+  return result;
+}